@@ -25,6 +25,10 @@ endif
 
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
 
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
 LOCAL_SRC_FILES:= \
 	AndroidRuntime.cpp \
 	Time.cpp \
@@ -88,9 +92,12 @@ LOCAL_SRC_FILES:= \
 	android/graphics/AutoDecodeCancel.cpp \
 	android/graphics/Bitmap.cpp \
 	android/graphics/BitmapFactory.cpp \
+	android/graphics/BitmapPool.cpp \
+	android/graphics/CachingMovie.cpp \
 	android/graphics/Camera.cpp \
 	android/graphics/Canvas.cpp \
 	android/graphics/ColorFilter.cpp \
+	android/graphics/ColorProcs.cpp \
 	android/graphics/DrawFilter.cpp \
 	android/graphics/CreateJavaOutputStreamAdaptor.cpp \
 	android/graphics/Graphics.cpp \
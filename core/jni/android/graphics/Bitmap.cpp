@@ -11,6 +11,7 @@
 #include "android_util_Binder.h"
 #include "android_nio_utils.h"
 #include "CreateJavaOutputStreamAdaptor.h"
+#include "ColorProcs.h"
 
 #include <jni.h>
 
@@ -29,15 +30,6 @@
 typedef void (*FromColorProc)(void* dst, const SkColor src[], int width,
                               int x, int y);
 
-static void FromColor_D32(void* dst, const SkColor src[], int width,
-                          int, int) {
-    SkPMColor* d = (SkPMColor*)dst;
-
-    for (int i = 0; i < width; i++) {
-        *d++ = SkPreMultiplyColor(*src++);
-    }
-}
-
 static void FromColor_D565(void* dst, const SkColor src[], int width,
                            int x, int y) {
     uint16_t* d = (uint16_t*)dst;
@@ -66,7 +58,11 @@ static void FromColor_D4444(void* dst, const SkColor src[], int width,
 static FromColorProc ChooseFromColorProc(SkBitmap::Config config) {
     switch (config) {
         case SkBitmap::kARGB_8888_Config:
+#if USE_SIMD_COLOR_PROCS
+            return FromColor_D32_SIMD;
+#else
             return FromColor_D32;
+#endif
         case SkBitmap::kARGB_4444_Config:
             return FromColor_D4444;
         case SkBitmap::kRGB_565_Config:
@@ -113,26 +109,6 @@ bool GraphicsJNI::SetPixels(JNIEnv* env, jintArray srcColors,
 typedef void (*ToColorProc)(SkColor dst[], const void* src, int width,
                             SkColorTable*);
 
-static void ToColor_S32_Alpha(SkColor dst[], const void* src, int width,
-                              SkColorTable*) {
-    SkASSERT(width > 0);
-    const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        *dst++ = SkUnPreMultiply::PMColorToColor(*s++);
-    } while (--width != 0);
-}
-
-static void ToColor_S32_Opaque(SkColor dst[], const void* src, int width,
-                               SkColorTable*) {
-    SkASSERT(width > 0);
-    const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        SkPMColor c = *s++;
-        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
-                               SkGetPackedB32(c));
-    } while (--width != 0);
-}
-
 static void ToColor_S4444_Alpha(SkColor dst[], const void* src, int width,
                                 SkColorTable*) {
     SkASSERT(width > 0);
@@ -153,17 +129,6 @@ static void ToColor_S4444_Opaque(SkColor dst[], const void* src, int width,
     } while (--width != 0);
 }
 
-static void ToColor_S565(SkColor dst[], const void* src, int width,
-                         SkColorTable*) {
-    SkASSERT(width > 0);
-    const uint16_t* s = (const uint16_t*)src;
-    do {
-        uint16_t c = *s++;
-        *dst++ =  SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c),
-                                SkPacked16ToB32(c));
-    } while (--width != 0);
-}
-
 static void ToColor_SI8_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable* ctable) {
     SkASSERT(width > 0);
@@ -192,11 +157,19 @@ static void ToColor_SI8_Opaque(SkColor dst[], const void* src, int width,
 static ToColorProc ChooseToColorProc(const SkBitmap& src) {
     switch (src.config()) {
         case SkBitmap::kARGB_8888_Config:
+#if USE_SIMD_COLOR_PROCS
+            return src.isOpaque() ? ToColor_S32_Opaque_SIMD : ToColor_S32_Alpha_SIMD;
+#else
             return src.isOpaque() ? ToColor_S32_Opaque : ToColor_S32_Alpha;
+#endif
         case SkBitmap::kARGB_4444_Config:
             return src.isOpaque() ? ToColor_S4444_Opaque : ToColor_S4444_Alpha;
         case SkBitmap::kRGB_565_Config:
+#if USE_SIMD_COLOR_PROCS
+            return ToColor_S565_SIMD;
+#else
             return ToColor_S565;
+#endif
         case SkBitmap::kIndex8_Config:
             if (src.getColorTable() == NULL) {
                 return NULL;
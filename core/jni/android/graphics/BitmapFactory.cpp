@@ -1,6 +1,7 @@
 #define LOG_TAG "BitmapFactory"
 
 #include "BitmapFactory.h"
+#include "BitmapPool.h"
 #include "NinePatchPeeker.h"
 #include "SkImageDecoder.h"
 #include "SkImageRef_ashmem.h"
@@ -36,6 +37,7 @@ jfieldID gOptions_mCancelID;
 jfieldID gOptions_bitmapFieldID;
 jfieldID gBitmap_nativeBitmapFieldID;
 jfieldID gBitmap_layoutBoundsFieldID;
+jfieldID gBitmap_bufferFieldID;
 
 #if 0
     #define TRACE_BITMAP(code)  code
@@ -152,6 +154,53 @@ static SkPixelRef* installPixelRef(SkBitmap* bitmap, SkStream* stream,
     return pr;
 }
 
+/** Allocator which decodes into the pixels of an existing bitmap. The
+ *  decoded image must have the same config and dimensions as the reused
+ *  bitmap, whose dimensions are cached by the Java Bitmap, and fit in the
+ *  capacity of its pixel storage.
+ */
+class ReusePixelAllocator : public SkBitmap::Allocator {
+public:
+    ReusePixelAllocator(SkBitmap* reused, size_t capacity)
+            : fReused(reused), fCapacity(capacity) {}
+
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+        SkPixelRef* pr = fReused->pixelRef();
+        if (pr == NULL || ctable != NULL || bitmap->config() != fReused->config()) {
+            return false;
+        }
+        if (bitmap->width() != fReused->width() || bitmap->height() != fReused->height()) {
+            return false;
+        }
+
+        Sk64 size64 = bitmap->getSize64();
+        if (size64.isNeg() || !size64.is32() || size64.get32() > fCapacity) {
+            return false;
+        }
+
+        bitmap->setPixelRef(pr);
+        bitmap->lockPixels();
+        return true;
+    }
+
+private:
+    SkBitmap* fReused;
+    size_t fCapacity;
+};
+
+/** Returns the number of bytes of pixel storage of the specified bitmap,
+ *  which may be larger than its current size if it was reused before.
+ */
+static size_t getReuseCapacity(JNIEnv* env, jobject javaBitmap, SkBitmap* bitmap) {
+    jbyteArray buffer = (jbyteArray) env->GetObjectField(javaBitmap, gBitmap_bufferFieldID);
+    if (buffer != NULL) {
+        size_t capacity = env->GetArrayLength(buffer);
+        env->DeleteLocalRef(buffer);
+        return capacity;
+    }
+    return bitmap->getSize();
+}
+
 // since we "may" create a purgeable imageref, we require the stream be ref'able
 // i.e. dynamically allocated, since its lifetime may exceed the current stack
 // frame.
@@ -172,6 +221,7 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
     bool preferQualityOverSpeed = false;
 
     jobject javaBitmap = NULL;
+    size_t reuseCapacity = 0;
 
     if (options != NULL) {
         sampleSize = env->GetIntField(options, gOptions_sampleSizeFieldID);
@@ -196,6 +246,10 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
     if (willScale && javaBitmap != NULL) {
         return nullObjectReturn("Cannot pre-scale a reused bitmap");
     }
+    if (javaBitmap != NULL) {
+        // the pixels of the reused bitmap are the storage, never purge them
+        isPurgeable = false;
+    }
 
     SkImageDecoder* decoder = SkImageDecoder::Factory(stream);
     if (decoder == NULL) {
@@ -207,25 +261,26 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
     decoder->setPreferQualityOverSpeed(preferQualityOverSpeed);
 
     NinePatchPeeker peeker(decoder);
-    JavaPixelAllocator javaAllocator(env);
+    PooledPixelAllocator javaAllocator(env);
 
     SkBitmap* bitmap;
     if (javaBitmap == NULL) {
         bitmap = new SkBitmap;
     } else {
-        if (sampleSize != 1) {
-            return nullObjectReturn("SkImageDecoder: Cannot reuse bitmap with sampleSize != 1");
-        }
         bitmap = (SkBitmap*) env->GetIntField(javaBitmap, gBitmap_nativeBitmapFieldID);
         // config of supplied bitmap overrules config set in options
         prefConfig = bitmap->getConfig();
+        reuseCapacity = getReuseCapacity(env, javaBitmap, bitmap);
     }
+    ReusePixelAllocator reuseAllocator(bitmap, reuseCapacity);
 
     SkAutoTDelete<SkImageDecoder> add(decoder);
     SkAutoTDelete<SkBitmap> adb(bitmap, javaBitmap == NULL);
 
     decoder->setPeeker(&peeker);
-    if (!isPurgeable) {
+    if (javaBitmap != NULL) {
+        decoder->setAllocator(&reuseAllocator);
+    } else if (!isPurgeable) {
         decoder->setAllocator(&javaAllocator);
     }
 
@@ -243,15 +298,19 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
         decodeMode = SkImageDecoder::kDecodeBounds_Mode;
     }
 
+    // a reused bitmap is only updated once the decode succeeded
+    SkBitmap reused;
     SkBitmap* decoded;
     if (willScale) {
         decoded = new SkBitmap;
+    } else if (javaBitmap != NULL) {
+        decoded = &reused;
     } else {
         decoded = bitmap;
     }
     SkAutoTDelete<SkBitmap> adb2(willScale ? decoded : NULL);
 
-    if (!decoder->decode(stream, decoded, prefConfig, decodeMode, javaBitmap != NULL)) {
+    if (!decoder->decode(stream, decoded, prefConfig, decodeMode)) {
         return nullObjectReturn("decoder->decode returned false");
     }
 
@@ -276,6 +335,12 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
         return NULL;
     }
 
+    if (javaBitmap != NULL) {
+        // the reused bitmap takes the state of the decoded image
+        *bitmap = reused;
+        bitmap->notifyPixelsChanged();
+    }
+
     jbyteArray ninePatchChunk = NULL;
     if (peeker.fPatch != NULL) {
         if (willScale) {
@@ -445,34 +510,6 @@ static jobject nativeDecodeFileDescriptor(JNIEnv* env, jobject clazz, jobject fi
     return doDecode(env, stream, padding, bitmapFactoryOptions, weOwnTheFD);
 }
 
-/*  make a deep copy of the asset, and return it as a stream, or NULL if there
-    was an error.
- */
-static SkStream* copyAssetToStream(Asset* asset) {
-    // if we could "ref/reopen" the asset, we may not need to copy it here
-    off64_t size = asset->seek(0, SEEK_SET);
-    if ((off64_t)-1 == size) {
-        SkDebugf("---- copyAsset: asset rewind failed\n");
-        return NULL;
-    }
-
-    size = asset->getLength();
-    if (size <= 0) {
-        SkDebugf("---- copyAsset: asset->getLength() returned %d\n", size);
-        return NULL;
-    }
-
-    SkStream* stream = new SkMemoryStream(size);
-    void* data = const_cast<void*>(stream->getMemoryBase());
-    off64_t len = asset->read(data, size);
-    if (len != size) {
-        SkDebugf("---- copyAsset: asset->read(%d) returned %d\n", size, len);
-        delete stream;
-        stream = NULL;
-    }
-    return stream;
-}
-
 static jobject nativeDecodeAssetScaled(JNIEnv* env, jobject clazz, jint native_asset,
         jobject padding, jobject options, jboolean applyScale, jfloat scale) {
 
@@ -480,16 +517,20 @@ static jobject nativeDecodeAssetScaled(JNIEnv* env, jobject clazz, jint native_a
     Asset* asset = reinterpret_cast<Asset*>(native_asset);
     bool forcePurgeable = optionsPurgeable(env, options);
     if (forcePurgeable) {
-        // if we could "ref/reopen" the asset, we may not need to copy it here
-        // and we could assume optionsShareable, since assets are always RO
-        stream = copyAssetToStream(asset);
+        // the stream outlives the asset: map the asset's file if it is not
+        // compressed, and otherwise copy it. We can assume optionsShareable,
+        // since assets are always RO
+        stream = CreateMappedAssetStream(asset);
+        if (stream == NULL) {
+            stream = CopyAssetToStream(asset);
+        }
         if (stream == NULL) {
             return NULL;
         }
     } else {
         // since we know we'll be done with the asset when we return, we can
-        // just use a simple wrapper
-        stream = new AssetStreamAdaptor(asset);
+        // read it in place
+        stream = CreateAssetStream(asset);
     }
     SkAutoUnref aur(stream);
     return doDecode(env, stream, padding, options, true, forcePurgeable, applyScale, scale);
@@ -516,6 +557,35 @@ static jobject nativeDecodeByteArray(JNIEnv* env, jobject, jbyteArray byteArray,
     return doDecode(env, stream, NULL, options, purgeable);
 }
 
+/*  Gives the pixel storage of a bitmap to the BitmapPool, so that it can be
+    reused by the next decode of an image of the same size. The storage is
+    only pooled once the native bitmap, and any other bitmap sharing its
+    pixels, is freed. For a bitmap drawn by the hardware renderer, this is
+    once the ResourceCache no longer references it. The bitmap must be
+    recycled right after this call.
+ */
+static jboolean nativeReleaseToPool(JNIEnv* env, jobject, jobject javaBitmap) {
+    NPE_CHECK_RETURN_ZERO(env, javaBitmap);
+
+    jbyteArray buffer = (jbyteArray) env->GetObjectField(javaBitmap, gBitmap_bufferFieldID);
+    if (buffer == NULL) {
+        // pixels not allocated in the Java heap (purgeable, ashmem)
+        return JNI_FALSE;
+    }
+
+    SkBitmap* bitmap = (SkBitmap*) env->GetIntField(javaBitmap, gBitmap_nativeBitmapFieldID);
+    // a bitmap whose pixels are on the Java heap always has an AndroidPixelRef
+    AndroidPixelRef* pr = (AndroidPixelRef*) bitmap->pixelRef();
+    bool released = pr != NULL && pr->releaseToPoolOnFree(env, buffer);
+
+    env->DeleteLocalRef(buffer);
+    return released ? JNI_TRUE : JNI_FALSE;
+}
+
+static void nativeClearPool(JNIEnv* env, jobject) {
+    BitmapPool::getInstance().clear(env);
+}
+
 static void nativeRequestCancel(JNIEnv*, jobject joptions) {
     (void)AutoDecoderCancel::RequestCancel(joptions);
 }
@@ -566,6 +636,16 @@ static JNINativeMethod gMethods[] = {
         "(Ljava/io/FileDescriptor;)Z",
         (void*)nativeIsSeekable
     },
+
+    {   "nativeReleaseToPool",
+        "(Landroid/graphics/Bitmap;)Z",
+        (void*)nativeReleaseToPool
+    },
+
+    {   "nativeClearPool",
+        "()V",
+        (void*)nativeClearPool
+    },
 };
 
 static JNINativeMethod gOptionsMethods[] = {
@@ -603,6 +683,7 @@ int register_android_graphics_BitmapFactory(JNIEnv* env) {
     SkASSERT(bitmap_class);
     gBitmap_nativeBitmapFieldID = getFieldIDCheck(env, bitmap_class, "mNativeBitmap", "I");
     gBitmap_layoutBoundsFieldID = getFieldIDCheck(env, bitmap_class, "mLayoutBounds", "[I");
+    gBitmap_bufferFieldID = getFieldIDCheck(env, bitmap_class, "mBuffer", "[B");
     int ret = AndroidRuntime::registerNativeMethods(env,
                                     "android/graphics/BitmapFactory$Options",
                                     gOptionsMethods,
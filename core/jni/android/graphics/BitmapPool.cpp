@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BitmapPool"
+
+#include "BitmapPool.h"
+
+#include "JNIHelp.h"
+
+// Maximum number of bytes held by the pool
+#define DEFAULT_BITMAP_POOL_SIZE (8 * 1024 * 1024)
+
+using namespace android;
+
+BitmapPool& BitmapPool::getInstance() {
+    static BitmapPool gPool;
+    return gPool;
+}
+
+BitmapPool::BitmapPool() : fPooledSize(0), fMaxPooledSize(DEFAULT_BITMAP_POOL_SIZE),
+        fActive(false) {
+}
+
+/** Size classes are 2^n, 2^n * 5/4, 2^n * 6/4 and 2^n * 7/4. Returns -1 if
+ *  the size is out of the range of the pool.
+ */
+int BitmapPool::getSizeClassCeil(size_t size) {
+    if (size <= (1U << kMinSizeShift)) {
+        return 0;
+    }
+
+    int shift = 31 - __builtin_clz(size);
+    size_t step = (size_t(1) << shift) / kClassesPerPowerOfTwo;
+    int index = ((size - (size_t(1) << shift)) + step - 1) / step;
+    if (index == kClassesPerPowerOfTwo) {
+        shift++;
+        index = 0;
+    }
+    if (shift > kMaxSizeShift) {
+        return -1;
+    }
+    return (shift - kMinSizeShift) * kClassesPerPowerOfTwo + index;
+}
+
+int BitmapPool::getSizeClassFloor(size_t size) {
+    if (size < (1U << kMinSizeShift)) {
+        return -1;
+    }
+
+    int shift = 31 - __builtin_clz(size);
+    if (shift > kMaxSizeShift) {
+        return -1;
+    }
+    size_t step = (size_t(1) << shift) / kClassesPerPowerOfTwo;
+    int index = (size - (size_t(1) << shift)) / step;
+    return (shift - kMinSizeShift) * kClassesPerPowerOfTwo + index;
+}
+
+size_t BitmapPool::getSizeClassSize(int sizeClass) {
+    size_t base = size_t(1) << (kMinSizeShift + sizeClass / kClassesPerPowerOfTwo);
+    return base + (base / kClassesPerPowerOfTwo) * (sizeClass % kClassesPerPowerOfTwo);
+}
+
+size_t BitmapPool::getAllocationSize(size_t size) {
+    {
+        Mutex::Autolock _l(fLock);
+        if (!fActive) {
+            return size;
+        }
+    }
+
+    int sizeClass = getSizeClassCeil(size);
+    return sizeClass < 0 ? size : getSizeClassSize(sizeClass);
+}
+
+jbyteArray BitmapPool::acquire(JNIEnv* env, size_t size) {
+    int sizeClass = getSizeClassCeil(size);
+    if (sizeClass < 0) {
+        return NULL;
+    }
+
+    jbyteArray array;
+    {
+        Mutex::Autolock _l(fLock);
+        Vector<jbyteArray>& arrays = fClasses[sizeClass];
+        if (arrays.isEmpty()) {
+            return NULL;
+        }
+        array = arrays.top();
+        arrays.pop();
+        fPooledSize -= env->GetArrayLength(array);
+    }
+
+    jbyteArray localArray = (jbyteArray) env->NewLocalRef(array);
+    env->DeleteGlobalRef(array);
+    return localArray;
+}
+
+bool BitmapPool::release(JNIEnv* env, jbyteArray array) {
+    size_t size = env->GetArrayLength(array);
+    int sizeClass = getSizeClassFloor(size);
+    if (sizeClass < 0) {
+        return false;
+    }
+
+    Mutex::Autolock _l(fLock);
+    fActive = true;
+    if (fPooledSize + size > fMaxPooledSize) {
+        return false;
+    }
+
+    fClasses[sizeClass].push((jbyteArray) env->NewGlobalRef(array));
+    fPooledSize += size;
+    return true;
+}
+
+void BitmapPool::clear(JNIEnv* env) {
+    Mutex::Autolock _l(fLock);
+    for (int i = 0; i < kClassCount; i++) {
+        Vector<jbyteArray>& arrays = fClasses[i];
+        for (size_t j = 0; j < arrays.size(); j++) {
+            env->DeleteGlobalRef(arrays[j]);
+        }
+        arrays.clear();
+    }
+    fPooledSize = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool PooledPixelAllocator::allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+    Sk64 size64 = bitmap->getSize64();
+    if (size64.isNeg() || !size64.is32()) {
+        jniThrowException(fEnv, "java/lang/IllegalArgumentException",
+                          "bitmap size exceeds 32bits");
+        return false;
+    }
+
+    BitmapPool& pool = BitmapPool::getInstance();
+    size_t size = size64.get32();
+
+    jbyteArray arrayObj = pool.acquire(fEnv, size);
+    if (arrayObj == NULL) {
+        arrayObj = fEnv->NewByteArray(pool.getAllocationSize(size));
+        if (arrayObj == NULL) {
+            return false;
+        }
+    }
+
+    fStorageObj = arrayObj;
+    return GraphicsJNI::installJavaPixelRef(fEnv, bitmap, ctable, arrayObj);
+}
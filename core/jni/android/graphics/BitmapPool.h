@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BitmapPool_DEFINED
+#define BitmapPool_DEFINED
+
+#include "GraphicsJNI.h"
+
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+/** Process-wide pool of the Java arrays used as pixel storage by decoded
+ *  bitmaps. Arrays are grouped in size classes, four per power of two, so
+ *  that an array released after a decode can back the next decode of an
+ *  image of the same size without any allocation.
+ *
+ *  The pool only holds arrays explicitly released to it, and stays inactive
+ *  (no rounding of allocations) until the first release.
+ */
+class BitmapPool {
+public:
+    static BitmapPool& getInstance();
+
+    /** Returns a local reference to a pooled array of at least size bytes,
+     *  removed from the pool, or NULL if no such array is available.
+     */
+    jbyteArray acquire(JNIEnv* env, size_t size);
+
+    /** Adds the array to the pool. The array must not be used as the pixel
+     *  storage of a live bitmap anymore, see
+     *  AndroidPixelRef::releaseToPoolOnFree(). Returns false if the array
+     *  was not pooled because it is too small, too large or the pool is full.
+     */
+    bool release(JNIEnv* env, jbyteArray array);
+
+    /** Drops every pooled array. */
+    void clear(JNIEnv* env);
+
+    /** Returns the size of the array to allocate to hold size bytes so that
+     *  the array can be pooled once released.
+     */
+    size_t getAllocationSize(size_t size);
+
+private:
+    BitmapPool();
+
+    static int getSizeClassCeil(size_t size);
+    static int getSizeClassFloor(size_t size);
+    static size_t getSizeClassSize(int sizeClass);
+
+    enum {
+        kMinSizeShift = 12,
+        kMaxSizeShift = 25,
+        kClassesPerPowerOfTwo = 4,
+        kClassCount = (kMaxSizeShift - kMinSizeShift + 1) * kClassesPerPowerOfTwo
+    };
+
+    android::Vector<jbyteArray> fClasses[kClassCount];
+    size_t fPooledSize;
+    size_t fMaxPooledSize;
+    bool fActive;
+    android::Mutex fLock;
+};
+
+/** Allocator which takes the pixel storage from the BitmapPool when
+ *  possible, and otherwise allocates a poolable array in the Java heap.
+ *  Like JavaPixelAllocator, getStorageObj() returns the array of the last
+ *  allocation.
+ */
+class PooledPixelAllocator : public SkBitmap::Allocator {
+public:
+    PooledPixelAllocator(JNIEnv* env) : fEnv(env), fStorageObj(NULL) {}
+
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable);
+
+    jbyteArray getStorageObj() { return fStorageObj; }
+
+private:
+    JNIEnv* fEnv;
+    jbyteArray fStorageObj;
+};
+
+#endif // BitmapPool_DEFINED
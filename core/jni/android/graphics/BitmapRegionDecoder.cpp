@@ -40,6 +40,10 @@
 #include <jni.h>
 #include <androidfw/Asset.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
 
 #if 0
     #define TRACE_BITMAP(code)  code
@@ -49,6 +53,113 @@
 
 using namespace android;
 
+// Maximum number of threads decoding the regions of a batch
+#define MAX_REGION_WORKERS 4
+// Interval at which a batch checks whether it was cancelled, in ms
+#define REGION_CANCEL_POLL_INTERVAL 20
+
+static jmethodID gBitmapRegionDecoder_onTileDecodedMethodID;
+
+/*
+ * Region decoder able to decode batches of regions on several threads.
+ *
+ * The tile index built by buildTileIndex() lives in the decoder itself (for
+ * JPEG it holds the libjpeg state) and cannot be shared between threads.
+ * Each worker thread therefore owns a decoder and a tile index of its own,
+ * built lazily over a read-only view of the data of the source stream and
+ * kept for the following batches. Sources that are not held in memory
+ * (shareable file descriptors) are decoded serially by this decoder.
+ */
+class ParallelRegionDecoder : public SkBitmapRegionDecoder {
+public:
+    ParallelRegionDecoder(SkImageDecoder* decoder, SkStream* stream, int width, int height)
+            : SkBitmapRegionDecoder(decoder, stream, width, height), fStream(stream) {
+        fStream->ref();
+        for (int i = 0; i < MAX_REGION_WORKERS; i++) {
+            fWorkers[i] = NULL;
+        }
+    }
+
+    virtual ~ParallelRegionDecoder() {
+        for (int i = 0; i < MAX_REGION_WORKERS; i++) {
+            delete fWorkers[i];
+        }
+        fStream->unref();
+    }
+
+    bool canDecodeInParallel() const {
+        return fStream->getMemoryBase() != NULL;
+    }
+
+    /*
+     * Returns the decoder used by the specified worker, or NULL if its tile
+     * index could not be built. Must only be invoked by that worker. The
+     * workers are published under the lock of the current batch, which
+     * cancelWorkers() holds.
+     */
+    SkBitmapRegionDecoder* getWorker(JNIEnv* env, int index, Mutex& batchLock) {
+        if (!canDecodeInParallel()) {
+            return this;
+        }
+        {
+            Mutex::Autolock _l(batchLock);
+            if (fWorkers[index] != NULL) {
+                return fWorkers[index];
+            }
+        }
+
+        // Building the tile index can be slow, it is done without the lock
+        SkBitmapRegionDecoder* worker = buildWorker(env);
+
+        Mutex::Autolock _l(batchLock);
+        fWorkers[index] = worker;
+        return worker;
+    }
+
+    /*
+     * Cancels the decodes in progress. Must be invoked with the lock of the
+     * current batch held.
+     */
+    void cancelWorkers() {
+        getDecoder()->cancelDecode();
+        for (int i = 0; i < MAX_REGION_WORKERS; i++) {
+            if (fWorkers[i]) fWorkers[i]->getDecoder()->cancelDecode();
+        }
+    }
+
+    Mutex& getBatchLock() {
+        return fBatchLock;
+    }
+
+private:
+    SkBitmapRegionDecoder* buildWorker(JNIEnv* env) {
+        // The view does not own the data, fStream outlives the workers
+        SkStream* view = new SkMemoryStream(fStream->getMemoryBase(),
+                fStream->getLength(), false);
+        SkImageDecoder* decoder = SkImageDecoder::Factory(view);
+        if (decoder == NULL) {
+            view->unref();
+            return NULL;
+        }
+
+        JavaPixelAllocator* javaAllocator = new JavaPixelAllocator(env);
+        decoder->setAllocator(javaAllocator);
+        javaAllocator->unref();
+
+        int width, height;
+        if (!decoder->buildTileIndex(view, &width, &height)) {
+            delete decoder;
+            view->unref();
+            return NULL;
+        }
+        return new SkBitmapRegionDecoder(decoder, view, width, height);
+    }
+
+    SkStream* fStream;
+    SkBitmapRegionDecoder* fWorkers[MAX_REGION_WORKERS];
+    Mutex fBatchLock;
+};
+
 static SkMemoryStream* buildSkMemoryStream(SkStream *stream) {
     size_t bufferSize = 4096;
     size_t streamLen = 0;
@@ -90,7 +201,7 @@ static jobject doBuildTileIndex(JNIEnv* env, SkStream* stream) {
         return nullObjectReturn("decoder->buildTileIndex returned false");
     }
 
-    SkBitmapRegionDecoder *bm = new SkBitmapRegionDecoder(decoder, stream, width, height);
+    SkBitmapRegionDecoder *bm = new ParallelRegionDecoder(decoder, stream, width, height);
 
     return GraphicsJNI::createBitmapRegionDecoder(env, bm);
 }
@@ -166,11 +277,17 @@ static jobject nativeNewInstanceFromStream(JNIEnv* env, jobject clazz,
 static jobject nativeNewInstanceFromAsset(JNIEnv* env, jobject clazz,
                                  jint native_asset, // Asset
                                  jboolean isShareable) {
-    SkStream* stream, *assStream;
     Asset* asset = reinterpret_cast<Asset*>(native_asset);
-    assStream = new AssetStreamAdaptor(asset);
-    stream = buildSkMemoryStream(assStream);
-    assStream->unref();
+    // The decoder outlives the asset: map the asset's file if it is not
+    // compressed, and otherwise copy it
+    SkStream* stream = CreateMappedAssetStream(asset);
+    if (stream == NULL) {
+        stream = CopyAssetToStream(asset);
+    }
+    if (stream == NULL) {
+        doThrowIOE(env, "broken asset");
+        return nullObjectReturn("failed to read the asset");
+    }
     return doBuildTileIndex(env, stream);
 }
 
@@ -260,6 +377,275 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
     return GraphicsJNI::createBitmap(env, bitmap, buff, false, NULL, NULL, -1);
 }
 
+/*
+ * A region decoded by a worker. The pixels are held by a global reference
+ * so they can be handed over to the thread that issued the batch.
+ */
+struct DecodedTile {
+    int index;
+    SkBitmap* bitmap;
+    jbyteArray buffer;
+};
+
+struct RegionBatch {
+    ParallelRegionDecoder* brd;
+    const jint* rects;
+    int count;
+    SkBitmap::Config prefConfig;
+    int sampleSize;
+    bool doDither;
+    bool preferQualityOverSpeed;
+
+    // The following fields are protected by lock
+    Mutex lock;
+    Condition condition;
+    int nextTile;
+    int activeWorkers;
+    bool cancelled;
+    Vector<DecodedTile> completed;
+};
+
+struct RegionWorker {
+    RegionBatch* batch;
+    int index;
+};
+
+static void decodeTile(JNIEnv* env, RegionBatch* batch, SkBitmapRegionDecoder* brd,
+        int index, DecodedTile* tile) {
+    tile->index = index;
+    tile->bitmap = NULL;
+    tile->buffer = NULL;
+    if (brd == NULL) {
+        return;
+    }
+
+    const jint* rect = batch->rects + index * 4;
+    SkIRect region;
+    region.fLeft = rect[0];
+    region.fTop = rect[1];
+    region.fRight = rect[0] + rect[2];
+    region.fBottom = rect[1] + rect[3];
+
+    SkBitmap* bitmap = new SkBitmap;
+    JavaPixelAllocator* allocator = (JavaPixelAllocator*) brd->getDecoder()->getAllocator();
+    bool decoded = brd->decodeRegion(bitmap, region, batch->prefConfig, batch->sampleSize);
+    jbyteArray buffer = allocator->getStorageObjAndReset();
+
+    if (env->ExceptionCheck()) {
+        // Most likely an OutOfMemoryError thrown while allocating the pixels
+        env->ExceptionClear();
+        decoded = false;
+    }
+    if (!decoded) {
+        SkDebugf("BitmapRegionDecoder: failed to decode tile %d\n", index);
+        if (buffer) env->DeleteLocalRef(buffer);
+        delete bitmap;
+        return;
+    }
+
+    tile->bitmap = bitmap;
+    if (buffer) {
+        tile->buffer = (jbyteArray) env->NewGlobalRef(buffer);
+        env->DeleteLocalRef(buffer);
+    }
+}
+
+static void decodeTiles(void* arg) {
+    RegionWorker* worker = (RegionWorker*) arg;
+    RegionBatch* batch = worker->batch;
+    JNIEnv* env = AndroidRuntime::getJNIEnv();
+
+    SkBitmapRegionDecoder* brd = batch->brd->getWorker(env, worker->index, batch->lock);
+    if (brd) {
+        brd->getDecoder()->setDitherImage(batch->doDither);
+        brd->getDecoder()->setPreferQualityOverSpeed(batch->preferQualityOverSpeed);
+    }
+
+    while (true) {
+        int index;
+        {
+            Mutex::Autolock _l(batch->lock);
+            if (batch->cancelled || batch->nextTile >= batch->count) break;
+            index = batch->nextTile++;
+        }
+
+        DecodedTile tile;
+        decodeTile(env, batch, brd, index, &tile);
+
+        Mutex::Autolock _l(batch->lock);
+        batch->completed.push(tile);
+        batch->condition.signal();
+    }
+
+    Mutex::Autolock _l(batch->lock);
+    batch->activeWorkers--;
+    batch->condition.signal();
+}
+
+static void releaseTile(JNIEnv* env, const DecodedTile& tile) {
+    if (tile.buffer) env->DeleteGlobalRef(tile.buffer);
+    delete tile.bitmap;
+}
+
+/*
+ * Wraps a decoded tile in a Java bitmap, stores it in the result array and
+ * notifies the BitmapRegionDecoder. Returns false if the tile could not be
+ * decoded.
+ */
+static bool publishTile(JNIEnv* env, jobject obj, jobjectArray tiles, const DecodedTile& tile) {
+    if (tile.bitmap == NULL) {
+        return false;
+    }
+
+    jbyteArray buffer = NULL;
+    if (tile.buffer) {
+        buffer = (jbyteArray) env->NewLocalRef(tile.buffer);
+        env->DeleteGlobalRef(tile.buffer);
+        // The pixel ref still points to the worker's local reference
+        ((AndroidPixelRef*) tile.bitmap->pixelRef())->setLocalJNIRef(buffer);
+    }
+
+    jobject bitmap = GraphicsJNI::createBitmap(env, tile.bitmap, buffer, false, NULL, NULL, -1);
+    if (buffer) env->DeleteLocalRef(buffer);
+    if (bitmap == NULL) {
+        return false;
+    }
+
+    env->SetObjectArrayElement(tiles, tile.index, bitmap);
+    env->CallVoidMethod(obj, gBitmapRegionDecoder_onTileDecodedMethodID, tile.index, bitmap);
+    env->DeleteLocalRef(bitmap);
+    return !env->ExceptionCheck();
+}
+
+/*
+ * Decodes a batch of regions, described by (x, y, width, height) quadruplets.
+ * Tiles are stored in the tiles array and reported through onTileDecoded()
+ * as soon as they are decoded, in completion order. Returns the number of
+ * tiles decoded.
+ *
+ * options.inBitmap is ignored, nine patch and purgeable are not supported.
+ */
+static jint nativeDecodeRegions(JNIEnv* env, jobject obj, SkBitmapRegionDecoder *brd,
+        jintArray rects, jobject options, jobjectArray tiles) {
+    ParallelRegionDecoder* decoder = static_cast<ParallelRegionDecoder*>(brd);
+
+    int count = env->GetArrayLength(rects) / 4;
+    if (env->GetArrayLength(tiles) < count) {
+        doThrowAIOOBE(env);
+        return 0;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    RegionBatch batch;
+    batch.brd = decoder;
+    batch.count = count;
+    batch.prefConfig = SkBitmap::kNo_Config;
+    batch.sampleSize = 1;
+    batch.doDither = true;
+    batch.preferQualityOverSpeed = false;
+    batch.nextTile = 0;
+    batch.activeWorkers = 0;
+    batch.cancelled = false;
+
+    if (NULL != options) {
+        batch.sampleSize = env->GetIntField(options, gOptions_sampleSizeFieldID);
+        env->SetIntField(options, gOptions_widthFieldID, -1);
+        env->SetIntField(options, gOptions_heightFieldID, -1);
+        env->SetObjectField(options, gOptions_mimeFieldID, 0);
+
+        jobject jconfig = env->GetObjectField(options, gOptions_configFieldID);
+        batch.prefConfig = GraphicsJNI::getNativeBitmapConfig(env, jconfig);
+        batch.doDither = env->GetBooleanField(options, gOptions_ditherFieldID);
+        batch.preferQualityOverSpeed = env->GetBooleanField(options,
+                gOptions_preferQualityOverSpeedFieldID);
+
+        if (env->GetBooleanField(options, gOptions_mCancelID)) {
+            return 0;
+        }
+    }
+
+    // Only one batch at a time can use the workers of a decoder
+    Mutex::Autolock _b(decoder->getBatchLock());
+
+    AutoJavaIntArray rectsArray(env, rects, count * 4);
+    batch.rects = rectsArray.ptr();
+
+    RegionWorker workers[MAX_REGION_WORKERS];
+    int workerCount = 0;
+    if (decoder->canDecodeInParallel()) {
+        long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = cpuCount > 1 ? cpuCount : 1;
+        if (workerCount > MAX_REGION_WORKERS) workerCount = MAX_REGION_WORKERS;
+        if (workerCount > count) workerCount = count;
+    }
+
+    {
+        Mutex::Autolock _l(batch.lock);
+        for (int i = 0; i < workerCount; i++) {
+            workers[batch.activeWorkers].batch = &batch;
+            workers[batch.activeWorkers].index = batch.activeWorkers;
+            if (AndroidRuntime::createJavaThread("BitmapRegionDecoder",
+                    decodeTiles, &workers[batch.activeWorkers])) {
+                batch.activeWorkers++;
+            }
+        }
+    }
+
+    if (batch.activeWorkers == 0) {
+        // No thread could be started, or the source is not held in memory
+        RegionWorker worker;
+        worker.batch = &batch;
+        worker.index = 0;
+        batch.activeWorkers = 1;
+        decodeTiles(&worker);
+    }
+
+    int decoded = 0;
+    while (true) {
+        DecodedTile tile;
+        {
+            Mutex::Autolock _l(batch.lock);
+            while (batch.completed.isEmpty() && batch.activeWorkers > 0) {
+                batch.condition.waitRelative(batch.lock,
+                        milliseconds_to_nanoseconds(REGION_CANCEL_POLL_INTERVAL));
+                if (!batch.cancelled && NULL != options &&
+                        env->GetBooleanField(options, gOptions_mCancelID)) {
+                    batch.cancelled = true;
+                    decoder->cancelWorkers();
+                }
+            }
+            if (batch.completed.isEmpty()) break;
+            tile = batch.completed[0];
+            batch.completed.removeAt(0);
+        }
+
+        if (batch.cancelled) {
+            releaseTile(env, tile);
+            continue;
+        }
+        if (publishTile(env, obj, tiles, tile)) {
+            decoded++;
+        }
+
+        // onTileDecoded() threw, or the tile could not be wrapped: the
+        // remaining tiles are dropped, stop decoding them
+        if (env->ExceptionCheck()) {
+            Mutex::Autolock _l(batch.lock);
+            batch.cancelled = true;
+            decoder->cancelWorkers();
+        }
+    }
+
+    if (NULL != options && decoded > 0) {
+        env->SetObjectField(options, gOptions_mimeFieldID,
+                            getMimeTypeString(env, decoder->getDecoder()->getFormat()));
+    }
+
+    return decoded;
+}
+
 static int nativeGetHeight(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
     return brd->getHeight();
 }
@@ -269,7 +655,8 @@ static int nativeGetWidth(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
 }
 
 static void nativeClean(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
-    delete brd;
+    // Every decoder is created by doBuildTileIndex()
+    delete static_cast<ParallelRegionDecoder*>(brd);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -281,6 +668,10 @@ static JNINativeMethod gBitmapRegionDecoderMethods[] = {
         "(IIIIILandroid/graphics/BitmapFactory$Options;)Landroid/graphics/Bitmap;",
         (void*)nativeDecodeRegion},
 
+    {   "nativeDecodeRegions",
+        "(I[ILandroid/graphics/BitmapFactory$Options;[Landroid/graphics/Bitmap;)I",
+        (void*)nativeDecodeRegions},
+
     {   "nativeGetHeight", "(I)I", (void*)nativeGetHeight},
 
     {   "nativeGetWidth", "(I)I", (void*)nativeGetWidth},
@@ -312,6 +703,12 @@ static JNINativeMethod gBitmapRegionDecoderMethods[] = {
 
 int register_android_graphics_BitmapRegionDecoder(JNIEnv* env)
 {
+    jclass clazz = env->FindClass(kClassPathName);
+    SkASSERT(clazz);
+    gBitmapRegionDecoder_onTileDecodedMethodID = env->GetMethodID(clazz, "onTileDecoded",
+            "(ILandroid/graphics/Bitmap;)V");
+    SkASSERT(gBitmapRegionDecoder_onTileDecodedMethodID);
+
     return android::AndroidRuntime::registerNativeMethods(env, kClassPathName,
             gBitmapRegionDecoderMethods, SK_ARRAY_COUNT(gBitmapRegionDecoderMethods));
 }
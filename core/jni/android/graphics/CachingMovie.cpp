@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CachingMovie"
+
+#include "CachingMovie.h"
+
+#include <string.h>
+
+#include <utils/Log.h>
+
+using namespace android;
+
+///////////////////////////////////////////////////////////////////////////////
+
+class CachingMovie::Predecoder : public Thread {
+public:
+    Predecoder(CachingMovie* movie) : Thread(false), fMovie(movie) {}
+
+private:
+    virtual bool threadLoop() {
+        return fMovie->predecode();
+    }
+
+    CachingMovie* fMovie;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+CachingMovie::CachingMovie(SkMovie* movie, const void* data, size_t length)
+        : fMovie(movie), fCacheBytes(0), fMaxCacheBytes(0), fPrefetchCount(0),
+          fCurrIndex(0), fLastDrawIndex(-1), fResync(false), fPredecodeFailed(false),
+          fExit(false) {
+    if (data != NULL && !ReadGifFrameEnds(static_cast<const uint8_t*>(data), length,
+            &fFrameEnds)) {
+        fFrameEnds.clear();
+    }
+}
+
+CachingMovie::~CachingMovie() {
+    {
+        Mutex::Autolock _l(fCacheLock);
+        fExit = true;
+        fCacheCondition.broadcast();
+    }
+    if (fPredecoder != NULL) {
+        fPredecoder->requestExitAndWait();
+        fPredecoder.clear();
+    }
+    fMovie->unref();
+}
+
+bool CachingMovie::setFrameCache(size_t maxBytes, int prefetchCount) {
+    if (fFrameEnds.isEmpty()) {
+        return false;
+    }
+
+    Mutex::Autolock _l(fCacheLock);
+    if (maxBytes == 0) {
+        // The wrapped movie may have been moved to another frame by the
+        // predecoder, make sure the next frame is fetched from it
+        if (fMaxCacheBytes > 0) {
+            fResync = true;
+        }
+    } else if (fMaxCacheBytes == 0) {
+        // The last bitmap returned shares its pixels with the wrapped movie,
+        // nothing may decode in the background until it has been replaced
+        // by a cached frame
+        fLastDrawIndex = -1;
+    }
+    trimFrames_l(maxBytes);
+    fMaxCacheBytes = maxBytes;
+    fPrefetchCount = prefetchCount > 0 ? prefetchCount : 0;
+
+    if (fPrefetchCount > 0 && fPredecoder == NULL) {
+        fPredecoder = new Predecoder(this);
+        if (fPredecoder->run("MoviePredecoder", ANDROID_PRIORITY_BACKGROUND) != NO_ERROR) {
+            ALOGW("Could not start the movie predecoder");
+            fPredecoder.clear();
+        }
+    }
+    fCacheCondition.broadcast();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool CachingMovie::onGetInfo(Info* info) {
+    Mutex::Autolock _l(fMovieLock);
+    info->fDuration = fMovie->duration();
+    info->fWidth = fMovie->width();
+    info->fHeight = fMovie->height();
+    info->fIsOpaque = fMovie->isOpaque();
+    return true;
+}
+
+bool CachingMovie::onSetTime(SkMSec time) {
+    bool resync;
+    {
+        Mutex::Autolock _l(fCacheLock);
+        if (!fFrameEnds.isEmpty()) {
+            const int index = getFrameIndex(time);
+            if (index != fCurrIndex) {
+                fCurrIndex = index;
+                fPredecodeFailed = false;
+                fCacheCondition.broadcast();
+            }
+            if (fMaxCacheBytes > 0) {
+                return index != fLastDrawIndex;
+            }
+        }
+        resync = fResync;
+    }
+
+    Mutex::Autolock _l(fMovieLock);
+    return fMovie->setTime(time) || resync;
+}
+
+bool CachingMovie::onGetBitmap(SkBitmap* bitmap) {
+    int index = -1;
+    {
+        Mutex::Autolock _l(fCacheLock);
+        if (fMaxCacheBytes > 0) {
+            index = fCurrIndex;
+            if (findFrame_l(index, bitmap)) {
+                fLastDrawIndex = index;
+                fCacheCondition.broadcast();
+                return true;
+            }
+        } else {
+            fResync = false;
+        }
+    }
+
+    if (index < 0) {
+        Mutex::Autolock _l(fMovieLock);
+        *bitmap = fMovie->bitmap();
+        return true;
+    }
+
+    SkBitmap frame;
+    if (!decodeFrame(index, &frame)) {
+        return false;
+    }
+    *bitmap = frame;
+
+    Mutex::Autolock _l(fCacheLock);
+    addFrame_l(index, frame);
+    fLastDrawIndex = index;
+    fCacheCondition.broadcast();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool SkipSubBlocks(const uint8_t* data, size_t length, size_t* pos) {
+    for (;;) {
+        if (*pos >= length) {
+            return false;
+        }
+        const size_t size = data[*pos];
+        *pos += 1 + size;
+        if (size == 0) {
+            return true;
+        }
+    }
+}
+
+/** Computes the end time of each frame the way SkGIFMovie does: the delay
+ *  of a frame is taken from the first graphic control extension preceding
+ *  its image descriptor, in hundredths of a second.
+ */
+bool CachingMovie::ReadGifFrameEnds(const uint8_t* data, size_t length,
+                                    Vector<SkMSec>* frameEnds) {
+    if (length < 13 || memcmp(data, "GIF", 3)) {
+        return false;
+    }
+
+    size_t pos = 13;
+    if (data[10] & 0x80) {
+        pos += 3 * (1 << ((data[10] & 0x07) + 1));
+    }
+
+    SkMSec end = 0;
+    SkMSec delay = 0;
+    bool hasDelay = false;
+    for (;;) {
+        if (pos >= length) {
+            return false;
+        }
+        switch (data[pos]) {
+            case 0x21: // Extension
+                if (pos + 2 >= length) {
+                    return false;
+                }
+                if (data[pos + 1] == 0xF9 && !hasDelay && data[pos + 2] >= 3 &&
+                        pos + 5 < length) {
+                    delay = ((data[pos + 5] << 8) | data[pos + 4]) * 10;
+                    hasDelay = true;
+                }
+                pos += 2;
+                if (!SkipSubBlocks(data, length, &pos)) {
+                    return false;
+                }
+                break;
+            case 0x2C: { // Image descriptor
+                if (pos + 10 >= length) {
+                    return false;
+                }
+                const uint8_t flags = data[pos + 9];
+                pos += 10;
+                if (flags & 0x80) {
+                    pos += 3 * (1 << ((flags & 0x07) + 1));
+                }
+                // LZW minimum code size
+                pos++;
+                if (!SkipSubBlocks(data, length, &pos)) {
+                    return false;
+                }
+                end += hasDelay ? delay : 0;
+                frameEnds->add(end);
+                hasDelay = false;
+                break;
+            }
+            case 0x3B: // Trailer
+                return !frameEnds->isEmpty();
+            default:
+                return false;
+        }
+    }
+}
+
+/** Matches SkGIFMovie::onSetTime(): the first frame ending at or after
+ *  the specified time.
+ */
+int CachingMovie::getFrameIndex(SkMSec time) const {
+    const size_t count = fFrameEnds.size();
+    for (size_t i = 0; i < count; i++) {
+        if (fFrameEnds[i] >= time) {
+            return i;
+        }
+    }
+    return count - 1;
+}
+
+bool CachingMovie::decodeFrame(int index, SkBitmap* bitmap) {
+    Mutex::Autolock _l(fMovieLock);
+    fMovie->setTime(fFrameEnds[index]);
+    const SkBitmap& frame = fMovie->bitmap();
+    if (frame.isNull() || !frame.copyTo(bitmap, frame.config())) {
+        return false;
+    }
+    bitmap->setImmutable();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool CachingMovie::findFrame_l(int index, SkBitmap* bitmap) {
+    for (size_t i = 0; i < fFrames.size(); i++) {
+        if (fFrames[i].fIndex == index) {
+            Frame frame = fFrames[i];
+            fFrames.removeAt(i);
+            fFrames.add(frame);
+            *bitmap = frame.fBitmap;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CachingMovie::containsFrame_l(int index) const {
+    for (size_t i = 0; i < fFrames.size(); i++) {
+        if (fFrames[i].fIndex == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CachingMovie::addFrame_l(int index, const SkBitmap& bitmap) {
+    const size_t size = bitmap.getSize();
+    if (size > fMaxCacheBytes || containsFrame_l(index)) {
+        return;
+    }
+    trimFrames_l(fMaxCacheBytes - size);
+
+    Frame frame;
+    frame.fIndex = index;
+    frame.fBitmap = bitmap;
+    fFrames.add(frame);
+    fCacheBytes += size;
+}
+
+void CachingMovie::trimFrames_l(size_t maxBytes) {
+    while (fCacheBytes > maxBytes && !fFrames.isEmpty()) {
+        fCacheBytes -= fFrames[0].fBitmap.getSize();
+        fFrames.removeAt(0);
+    }
+}
+
+/** Never prefetches more frames than the cache can hold next to the
+ *  current one, the frames would evict each other.
+ */
+int CachingMovie::getPrefetchCount_l() const {
+    const size_t frameBytes = fFrames.isEmpty() ? 0 : fFrames[0].fBitmap.getSize();
+    int count = fPrefetchCount;
+    if (frameBytes > 0) {
+        const size_t maxFrames = fMaxCacheBytes / frameBytes;
+        if (maxFrames < 2) {
+            return 0;
+        }
+        if (size_t(count) > maxFrames - 1) {
+            count = maxFrames - 1;
+        }
+    }
+    if (size_t(count) > fFrameEnds.size() - 1) {
+        count = fFrameEnds.size() - 1;
+    }
+    return count;
+}
+
+int CachingMovie::nextPredecodeFrame_l() const {
+    if (fMaxCacheBytes == 0 || fLastDrawIndex < 0 || fPredecodeFailed) {
+        return -1;
+    }
+
+    const int count = getPrefetchCount_l();
+    const int frameCount = fFrameEnds.size();
+    for (int i = 1; i <= count; i++) {
+        const int index = (fCurrIndex + i) % frameCount;
+        if (!containsFrame_l(index)) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+bool CachingMovie::predecode() {
+    int index;
+    {
+        Mutex::Autolock _l(fCacheLock);
+        while (!fExit && (index = nextPredecodeFrame_l()) < 0) {
+            fCacheCondition.wait(fCacheLock);
+        }
+        if (fExit) {
+            return false;
+        }
+    }
+
+    SkBitmap frame;
+    const bool decoded = decodeFrame(index, &frame);
+
+    Mutex::Autolock _l(fCacheLock);
+    if (decoded) {
+        addFrame_l(index, frame);
+    } else {
+        fPredecodeFailed = true;
+    }
+    return !fExit;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CachingMovie_DEFINED
+#define CachingMovie_DEFINED
+
+#include "SkBitmap.h"
+#include "SkMovie.h"
+
+#include <utils/threads.h>
+#include <utils/StrongPointer.h>
+#include <utils/Vector.h>
+
+/** Movie wrapping the SkMovie decoded by Skia, which can keep the
+ *  composited frames around instead of compositing them again each time the
+ *  animation loops. Cached frames are immutable bitmaps, drawing one only
+ *  costs the blit (or the texture upload, once).
+ *
+ *  A background thread can also decode the frames following the current
+ *  one ahead of time, so that playback rarely has to decode at all.
+ *
+ *  Frame caching needs the frame timeline, which is read from the encoded
+ *  GIF. For other formats, or until setFrameCache() is called, the movie
+ *  behaves exactly like the wrapped one.
+ */
+class CachingMovie : public SkMovie {
+public:
+    /** Takes ownership of the movie. The encoded data is only read during
+     *  the call and can be released afterwards. It may be NULL, frame
+     *  caching is then not supported.
+     */
+    CachingMovie(SkMovie* movie, const void* data, size_t length);
+    virtual ~CachingMovie();
+
+    /** Caches up to maxBytes of composited frames, and decodes up to
+     *  prefetchCount frames ahead of the current one in the background.
+     *  A maxBytes of 0 disables the cache and drops the cached frames.
+     *  Returns false if frame caching is not supported for this movie.
+     */
+    bool setFrameCache(size_t maxBytes, int prefetchCount);
+
+protected:
+    virtual bool onGetInfo(Info*);
+    virtual bool onSetTime(SkMSec);
+    virtual bool onGetBitmap(SkBitmap*);
+
+private:
+    class Predecoder;
+
+    struct Frame {
+        int fIndex;
+        SkBitmap fBitmap;
+    };
+
+    static bool ReadGifFrameEnds(const uint8_t* data, size_t length,
+                                 android::Vector<SkMSec>* frameEnds);
+
+    int getFrameIndex(SkMSec time) const;
+    bool decodeFrame(int index, SkBitmap* bitmap);
+
+    // The following methods must be called with fCacheLock held
+    bool findFrame_l(int index, SkBitmap* bitmap);
+    bool containsFrame_l(int index) const;
+    void addFrame_l(int index, const SkBitmap& bitmap);
+    void trimFrames_l(size_t maxBytes);
+    int getPrefetchCount_l() const;
+    int nextPredecodeFrame_l() const;
+
+    // Invoked in a loop by the predecoder thread, returns false to stop it
+    bool predecode();
+
+    // Protects the wrapped movie, shared with the predecoder thread
+    android::Mutex fMovieLock;
+    SkMovie* fMovie;
+
+    // End time of each frame, empty if frame caching is not supported
+    android::Vector<SkMSec> fFrameEnds;
+
+    // The following fields are protected by fCacheLock
+    android::Mutex fCacheLock;
+    android::Condition fCacheCondition;
+    android::Vector<Frame> fFrames; // least recently used first
+    size_t fCacheBytes;
+    size_t fMaxCacheBytes;
+    int fPrefetchCount;
+    int fCurrIndex;
+    int fLastDrawIndex;
+    // Set when the current frame must be returned even if the wrapped
+    // movie thinks it did not change
+    bool fResync;
+    // Set when a frame failed to decode, until the current frame changes
+    bool fPredecodeFailed;
+    bool fExit;
+
+    android::sp<Predecoder> fPredecoder;
+};
+
+#endif // CachingMovie_DEFINED
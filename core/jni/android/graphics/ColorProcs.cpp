@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorProcs.h"
+#include "SkUnPreMultiply.h"
+
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+void FromColor_D32(void* dst, const SkColor src[], int width,
+                   int, int) {
+    SkPMColor* d = (SkPMColor*)dst;
+
+    for (int i = 0; i < width; i++) {
+        *d++ = SkPreMultiplyColor(*src++);
+    }
+}
+
+void ToColor_S32_Alpha(SkColor dst[], const void* src, int width,
+                       SkColorTable*) {
+    SkASSERT(width > 0);
+    const SkPMColor* s = (const SkPMColor*)src;
+    do {
+        *dst++ = SkUnPreMultiply::PMColorToColor(*s++);
+    } while (--width != 0);
+}
+
+void ToColor_S32_Opaque(SkColor dst[], const void* src, int width,
+                        SkColorTable*) {
+    SkASSERT(width > 0);
+    const SkPMColor* s = (const SkPMColor*)src;
+    do {
+        SkPMColor c = *s++;
+        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
+                               SkGetPackedB32(c));
+    } while (--width != 0);
+}
+
+void ToColor_S565(SkColor dst[], const void* src, int width,
+                  SkColorTable*) {
+    SkASSERT(width > 0);
+    const uint16_t* s = (const uint16_t*)src;
+    do {
+        uint16_t c = *s++;
+        *dst++ =  SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c),
+                                SkPacked16ToB32(c));
+    } while (--width != 0);
+}
+
+#if USE_SIMD_COLOR_PROCS
+
+// Same as FromColor_D32, 8 (NEON) or 4 (SSE2) pixels at a time. The
+// premultiplication rounds like SkMulDiv255Round()
+void FromColor_D32_SIMD(void* dst, const SkColor src[], int width,
+                        int x, int y) {
+    SkPMColor* d = (SkPMColor*)dst;
+
+#if defined(__ARM_HAVE_NEON)
+    const uint16x8_t half = vdupq_n_u16(128);
+    for (; width >= 8; width -= 8) {
+        // SkColor is BGRA in memory
+        const uint8x8x4_t c = vld4_u8((const uint8_t*)src);
+        uint8x8x4_t p;
+        for (int i = 0; i < 3; i++) {
+            uint16x8_t prod = vaddq_u16(vmull_u8(c.val[2 - i], c.val[3]), half);
+            p.val[i] = vshrn_n_u16(vaddq_u16(prod, vshrq_n_u16(prod, 8)), 8);
+        }
+        p.val[3] = c.val[3];
+        vst4_u8((uint8_t*)d, p);
+        src += 8;
+        d += 8;
+    }
+#else
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    // multiplying the alpha by 255 leaves it unchanged
+    const __m128i opaque = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    for (; width >= 4; width -= 4) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)src);
+        __m128i halves[2] = { _mm_unpacklo_epi8(c, zero), _mm_unpackhi_epi8(c, zero) };
+        for (int i = 0; i < 2; i++) {
+            __m128i alpha = _mm_shufflelo_epi16(halves[i], _MM_SHUFFLE(3, 3, 3, 3));
+            alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+            alpha = _mm_or_si128(alpha, opaque);
+
+            __m128i prod = _mm_add_epi16(_mm_mullo_epi16(halves[i], alpha), half);
+            prod = _mm_srli_epi16(_mm_add_epi16(prod, _mm_srli_epi16(prod, 8)), 8);
+            // BGRA to RGBA
+            prod = _mm_shufflelo_epi16(prod, _MM_SHUFFLE(3, 0, 1, 2));
+            halves[i] = _mm_shufflehi_epi16(prod, _MM_SHUFFLE(3, 0, 1, 2));
+        }
+        _mm_storeu_si128((__m128i*)d, _mm_packus_epi16(halves[0], halves[1]));
+        src += 4;
+        d += 4;
+    }
+#endif
+
+    if (width > 0) {
+        FromColor_D32(d, src, width, x, y);
+    }
+}
+
+#endif // USE_SIMD_COLOR_PROCS
+
+#if USE_SIMD_COLOR_PROCS
+
+#if defined(__ARM_HAVE_NEON)
+
+// Converts 8 RGBA pixels to opaque SkColors (BGRA in memory)
+static inline void ToColor_S32_Opaque_8(SkColor dst[], const uint8x8x4_t& c) {
+    uint8x8x4_t d;
+    d.val[0] = c.val[2];
+    d.val[1] = c.val[1];
+    d.val[2] = c.val[0];
+    d.val[3] = vdup_n_u8(0xFF);
+    vst4_u8((uint8_t*)dst, d);
+}
+
+#else
+
+// Converts 4 RGBA pixels to opaque SkColors (BGRA in memory)
+static inline __m128i ToColor_S32_Opaque_4(__m128i c) {
+    const __m128i green = _mm_set1_epi32(0x0000FF00);
+    const __m128i red = _mm_set1_epi32(0x000000FF);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+    __m128i d = _mm_or_si128(_mm_and_si128(c, green), alpha);
+    d = _mm_or_si128(d, _mm_slli_epi32(_mm_and_si128(c, red), 16));
+    return _mm_or_si128(d, _mm_and_si128(_mm_srli_epi32(c, 16), red));
+}
+
+#endif
+
+void ToColor_S32_Opaque_SIMD(SkColor dst[], const void* src, int width,
+                             SkColorTable* ctable) {
+    SkASSERT(width > 0);
+    const SkPMColor* s = (const SkPMColor*)src;
+
+#if defined(__ARM_HAVE_NEON)
+    for (; width >= 8; width -= 8) {
+        ToColor_S32_Opaque_8(dst, vld4_u8((const uint8_t*)s));
+        s += 8;
+        dst += 8;
+    }
+#else
+    for (; width >= 4; width -= 4) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)s);
+        _mm_storeu_si128((__m128i*)dst, ToColor_S32_Opaque_4(c));
+        s += 4;
+        dst += 4;
+    }
+#endif
+
+    if (width > 0) {
+        ToColor_S32_Opaque(dst, s, width, ctable);
+    }
+}
+
+// Unpremultiplying requires a division per pixel, done with a table lookup
+// by SkUnPreMultiply. Runs of opaque pixels, the common case, are only
+// swizzled and the other pixels go through the scalar proc.
+void ToColor_S32_Alpha_SIMD(SkColor dst[], const void* src, int width,
+                            SkColorTable* ctable) {
+    SkASSERT(width > 0);
+    const SkPMColor* s = (const SkPMColor*)src;
+
+#if defined(__ARM_HAVE_NEON)
+    for (; width >= 8; width -= 8) {
+        const uint8x8x4_t c = vld4_u8((const uint8_t*)s);
+        if (vget_lane_u64(vreinterpret_u64_u8(vmvn_u8(c.val[3])), 0) == 0) {
+            ToColor_S32_Opaque_8(dst, c);
+        } else {
+            ToColor_S32_Alpha(dst, s, 8, ctable);
+        }
+        s += 8;
+        dst += 8;
+    }
+#else
+    const __m128i ones = _mm_set1_epi32(0xFFFFFFFF);
+    const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+    for (; width >= 4; width -= 4) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)s);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(c, rgb), ones)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i*)dst, ToColor_S32_Opaque_4(c));
+        } else {
+            ToColor_S32_Alpha(dst, s, 4, ctable);
+        }
+        s += 4;
+        dst += 4;
+    }
+#endif
+
+    if (width > 0) {
+        ToColor_S32_Alpha(dst, s, width, ctable);
+    }
+}
+
+void ToColor_S565_SIMD(SkColor dst[], const void* src, int width,
+                       SkColorTable* ctable) {
+    SkASSERT(width > 0);
+    const uint16_t* s = (const uint16_t*)src;
+
+#if defined(__ARM_HAVE_NEON)
+    const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+    const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+    for (; width >= 8; width -= 8) {
+        const uint16x8_t c = vld1q_u16(s);
+        const uint16x8_t r = vshrq_n_u16(c, 11);
+        const uint16x8_t g = vandq_u16(vshrq_n_u16(c, 5), mask6);
+        const uint16x8_t b = vandq_u16(c, mask5);
+
+        // Same expansion as SkR16ToR32(), SkG16ToG32() and SkB16ToB32()
+        uint8x8x4_t d;
+        d.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+        d.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+        d.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+        d.val[3] = vdup_n_u8(0xFF);
+        vst4_u8((uint8_t*)dst, d);
+        s += 8;
+        dst += 8;
+    }
+#else
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i alpha = _mm_set1_epi16(0xFF00);
+    for (; width >= 8; width -= 8) {
+        const __m128i c = _mm_loadu_si128((const __m128i*)s);
+        __m128i r = _mm_srli_epi16(c, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask6);
+        __m128i b = _mm_and_si128(c, mask5);
+
+        // Same expansion as SkR16ToR32(), SkG16ToG32() and SkB16ToB32()
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        const __m128i ra = _mm_or_si128(r, alpha);
+        _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(bg, ra));
+        s += 8;
+        dst += 8;
+    }
+#endif
+
+    if (width > 0) {
+        ToColor_S565(dst, s, width, ctable);
+    }
+}
+
+#endif // USE_SIMD_COLOR_PROCS
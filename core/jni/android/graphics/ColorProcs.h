@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ColorProcs_DEFINED
+#define ColorProcs_DEFINED
+
+#include "SkColor.h"
+#include "SkColorPriv.h"
+#include "SkColorTable.h"
+
+// The vectorized color procs assume the Android pixel layouts: RGBA in
+// memory for 32 bit pixels and RGB from the high bits for 565
+#if (defined(__ARM_HAVE_NEON) || defined(__SSE2__)) && \
+        SK_R32_SHIFT == 0 && SK_G32_SHIFT == 8 && SK_B32_SHIFT == 16 && SK_A32_SHIFT == 24 && \
+        SK_R16_SHIFT == 11 && SK_G16_SHIFT == 5 && SK_B16_SHIFT == 0 && \
+        !defined(SK_CPU_BENDIAN)
+    #define USE_SIMD_COLOR_PROCS 1
+#endif
+
+/*  Row converters between SkColors and the pixels of 8888 and 565 bitmaps,
+    used by get/setPixels. The _SIMD variants produce exactly the same
+    results as the scalar procs they replace.
+ */
+
+void FromColor_D32(void* dst, const SkColor src[], int width, int x, int y);
+
+void ToColor_S32_Alpha(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+void ToColor_S32_Opaque(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+void ToColor_S565(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+
+#if USE_SIMD_COLOR_PROCS
+void FromColor_D32_SIMD(void* dst, const SkColor src[], int width, int x, int y);
+
+void ToColor_S32_Alpha_SIMD(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+void ToColor_S32_Opaque_SIMD(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+void ToColor_S565_SIMD(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+#endif
+
+#endif
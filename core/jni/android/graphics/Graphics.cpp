@@ -3,6 +3,7 @@
 #include "jni.h"
 #include "JNIHelp.h"
 #include "GraphicsJNI.h"
+#include "BitmapPool.h"
 
 #include "SkCanvas.h"
 #include "SkDevice.h"
@@ -409,6 +410,7 @@ AndroidPixelRef::AndroidPixelRef(JNIEnv* env, void* storage, size_t size, jbyteA
     fStorageObj = storageObj;
     fHasGlobalRef = false;
     fGlobalRefCnt = 0;
+    fPoolObj = NULL;
 
     // If storageObj is NULL, the memory was NOT allocated on the Java heap
     fOnJavaHeap = (storageObj != NULL);
@@ -424,6 +426,12 @@ AndroidPixelRef::~AndroidPixelRef() {
         }
         fStorageObj = NULL;
 
+        if (fPoolObj) {
+            BitmapPool::getInstance().release(env, fPoolObj);
+            env->DeleteGlobalRef(fPoolObj);
+            fPoolObj = NULL;
+        }
+
         // Set this to NULL to prevent the SkMallocPixelRef destructor
         // from freeing the memory.
         fStorage = NULL;
@@ -474,6 +482,16 @@ void AndroidPixelRef::globalUnref() {
     unref();
 }
 
+bool AndroidPixelRef::releaseToPoolOnFree(JNIEnv* env, jbyteArray storageObj) {
+    if (!fOnJavaHeap) {
+        return false;
+    }
+    if (fPoolObj == NULL) {
+        fPoolObj = (jbyteArray) env->NewGlobalRef(storageObj);
+    }
+    return fPoolObj != NULL;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 extern "C" jbyte* jniGetNonMovableArrayElements(C_JNIEnv* env, jarray arrayObj);
@@ -490,20 +508,29 @@ jbyteArray GraphicsJNI::allocateJavaPixelRef(JNIEnv* env, SkBitmap* bitmap,
     size_t size = size64.get32();
     jbyteArray arrayObj = env->NewByteArray(size);
     if (arrayObj) {
-        // TODO: make this work without jniGetNonMovableArrayElements
-        jbyte* addr = jniGetNonMovableArrayElements(&env->functions, arrayObj);
-        if (addr) {
-            SkPixelRef* pr = new AndroidPixelRef(env, (void*) addr, size, arrayObj, ctable);
-            bitmap->setPixelRef(pr)->unref();
-            // since we're already allocated, we lockPixels right away
-            // HeapAllocator behaves this way too
-            bitmap->lockPixels();
-        }
+        installJavaPixelRef(env, bitmap, ctable, arrayObj);
     }
 
     return arrayObj;
 }
 
+bool GraphicsJNI::installJavaPixelRef(JNIEnv* env, SkBitmap* bitmap, SkColorTable* ctable,
+                                      jbyteArray arrayObj) {
+    // TODO: make this work without jniGetNonMovableArrayElements
+    jbyte* addr = jniGetNonMovableArrayElements(&env->functions, arrayObj);
+    if (addr == NULL) {
+        return false;
+    }
+
+    size_t size = env->GetArrayLength(arrayObj);
+    SkPixelRef* pr = new AndroidPixelRef(env, (void*) addr, size, arrayObj, ctable);
+    bitmap->setPixelRef(pr)->unref();
+    // since we're already allocated, we lockPixels right away
+    // HeapAllocator behaves this way too
+    bitmap->lockPixels();
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 JavaPixelAllocator::JavaPixelAllocator(JNIEnv* env)
@@ -66,6 +66,13 @@ public:
     static jbyteArray allocateJavaPixelRef(JNIEnv* env, SkBitmap* bitmap,
                                      SkColorTable* ctable);
 
+    /** Use an existing Java array, at least as large as the bitmap, as the
+        pixel storage of the bitmap. Returns false if the array could not
+        be pinned.
+     */
+    static bool installJavaPixelRef(JNIEnv* env, SkBitmap* bitmap, SkColorTable* ctable,
+                                    jbyteArray arrayObj);
+
     /** Copy the colors in colors[] to the bitmap, convert to the correct
         format along the way.
     */
@@ -99,6 +106,13 @@ public:
     /** Release a ref that was acquired using globalRef(). */
     virtual void globalUnref();
 
+    /** Gives 'storageObj', the Java byte[] holding the pixels, to the
+     *  BitmapPool once this pixel ref is destroyed, that is once no bitmap
+     *  uses the pixels anymore. Returns false if the pixels are not on the
+     *  Java heap.
+     */
+    bool releaseToPoolOnFree(JNIEnv* env, jbyteArray storageObj);
+
 private:
     JavaVM* fVM;
     bool fOnJavaHeap; // If true, the memory was allocated on the Java heap
@@ -106,6 +120,8 @@ private:
     jbyteArray fStorageObj; // The Java byte[] object used as the bitmap backing store
     bool fHasGlobalRef; // If true, fStorageObj holds a JNI global ref
 
+    jbyteArray fPoolObj; // JNI global ref to the byte[] to pool on destruction
+
     mutable int32_t fGlobalRefCnt;
 };
 
@@ -1,3 +1,4 @@
+#include "CachingMovie.h"
 #include "SkMovie.h"
 #include "SkStream.h"
 #include "GraphicsJNI.h"
@@ -19,12 +20,20 @@ static jclass       gMovie_class;
 static jmethodID    gMovie_constructorMethodID;
 static jfieldID     gMovie_nativeInstanceID;
 
-jobject create_jmovie(JNIEnv* env, SkMovie* moov) {
+// Every movie handed to Java is wrapped in a CachingMovie, which takes
+// ownership of moov. The frame timeline is parsed from the encoded data,
+// frame caching is not supported without it.
+static jobject create_jmovie(JNIEnv* env, SkMovie* moov, const void* data, size_t length) {
     if (NULL == moov) {
         return NULL;
     }
+    SkMovie* movie = new CachingMovie(moov, data, length);
     return env->NewObject(gMovie_class, gMovie_constructorMethodID,
-            static_cast<jint>(reinterpret_cast<uintptr_t>(moov)));
+            static_cast<jint>(reinterpret_cast<uintptr_t>(movie)));
+}
+
+jobject create_jmovie(JNIEnv* env, SkMovie* moov) {
+    return create_jmovie(env, moov, NULL, 0);
 }
 
 static SkMovie* J2Movie(JNIEnv* env, jobject movie) {
@@ -36,6 +45,11 @@ static SkMovie* J2Movie(JNIEnv* env, jobject movie) {
     return m;
 }
 
+// Every movie is wrapped by create_jmovie()
+static CachingMovie* J2CachingMovie(JNIEnv* env, jobject movie) {
+    return static_cast<CachingMovie*>(J2Movie(env, movie));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 static int movie_width(JNIEnv* env, jobject movie) {
@@ -63,6 +77,16 @@ static jboolean movie_setTime(JNIEnv* env, jobject movie, int ms) {
     return J2Movie(env, movie)->setTime(ms);
 }
 
+static jboolean movie_setFrameCache(JNIEnv* env, jobject movie, int maxBytes,
+                                    int prefetchCount) {
+    NPE_CHECK_RETURN_ZERO(env, movie);
+    if (maxBytes < 0) {
+        doThrowIAE(env);
+        return false;
+    }
+    return J2CachingMovie(env, movie)->setFrameCache(maxBytes, prefetchCount);
+}
+
 static void movie_draw(JNIEnv* env, jobject movie, jobject canvas,
                        jfloat fx, jfloat fy, jobject jpaint) {
     NPE_CHECK_RETURN_VOID(env, movie);
@@ -90,9 +114,26 @@ static jobject movie_decodeStream(JNIEnv* env, jobject clazz, jobject istream) {
         return 0;
     }
 
-    SkMovie* moov = SkMovie::DecodeStream(strm);
+    // Read the whole stream into a single buffer, the frame timeline is
+    // parsed from the data the movie is decoded from. The decoder would
+    // read it all anyway.
+    size_t bufferSize = 16 * 1024;
+    size_t length = 0;
+    size_t len;
+    char* data = (char*)sk_malloc_throw(bufferSize);
+
+    while ((len = strm->read(data + length, bufferSize - length)) != 0) {
+        length += len;
+        if (length == bufferSize) {
+            bufferSize *= 2;
+            data = (char*)sk_realloc_throw(data, bufferSize);
+        }
+    }
     strm->unref();
-    return create_jmovie(env, moov);
+    SkAutoFree storage(data);
+
+    SkMovie* moov = SkMovie::DecodeMemory(data, length);
+    return create_jmovie(env, moov, data, length);
 }
 
 static jobject movie_decodeByteArray(JNIEnv* env, jobject clazz,
@@ -109,7 +150,7 @@ static jobject movie_decodeByteArray(JNIEnv* env, jobject clazz,
 
     AutoJavaByteArray   ar(env, byteArray);
     SkMovie* moov = SkMovie::DecodeMemory(ar.ptr() + offset, length);
-    return create_jmovie(env, moov);
+    return create_jmovie(env, moov, ar.ptr() + offset, length);
 }
 
 static void movie_destructor(JNIEnv* env, jobject, SkMovie* movie) {
@@ -126,6 +167,7 @@ static JNINativeMethod gMethods[] = {
     {   "isOpaque", "()Z",  (void*)movie_isOpaque  },
     {   "duration", "()I",  (void*)movie_duration  },
     {   "setTime",  "(I)Z", (void*)movie_setTime  },
+    {   "setFrameCache", "(II)Z", (void*)movie_setFrameCache },
     {   "draw",     "(Landroid/graphics/Canvas;FFLandroid/graphics/Paint;)V",
                             (void*)movie_draw  },
     { "decodeStream", "(Ljava/io/InputStream;)Landroid/graphics/Movie;",
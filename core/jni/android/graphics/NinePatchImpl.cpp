@@ -18,13 +18,20 @@
 #define LOG_TAG "NinePatch"
 #define LOG_NDEBUG 1
 
+#include <string.h>
+
 #include <androidfw/ResourceTypes.h>
+#include <utils/GenerationCache.h>
 #include <utils/Log.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #include "SkBitmap.h"
 #include "SkCanvas.h"
-#include "SkNinePatch.h"
 #include "SkPaint.h"
+#include "SkRegion.h"
+#include "SkShader.h"
 #include "SkUnPreMultiply.h"
 
 #define USE_TRACE
@@ -67,31 +74,6 @@ static SkColor modAlpha(SkColor c, int alpha) {
     return SkColorSetA(c, a);
 }
 
-static void drawStretchyPatch(SkCanvas* canvas, SkIRect& src, const SkRect& dst,
-                              const SkBitmap& bitmap, const SkPaint& paint,
-                              SkColor initColor, uint32_t colorHint,
-                              bool hasXfer) {
-    if (colorHint !=  android::Res_png_9patch::NO_COLOR) {
-        ((SkPaint*)&paint)->setColor(modAlpha(colorHint, paint.getAlpha()));
-        canvas->drawRect(dst, paint);
-        ((SkPaint*)&paint)->setColor(initColor);
-    } else if (src.width() == 1 && src.height() == 1) {
-        SkColor c;
-        if (!getColor(bitmap, src.fLeft, src.fTop, &c)) {
-            goto SLOW_CASE;
-        }
-        if (0 != c || hasXfer) {
-            SkColor prev = paint.getColor();
-            ((SkPaint*)&paint)->setColor(c);
-            canvas->drawRect(dst, paint);
-            ((SkPaint*)&paint)->setColor(prev);
-        }
-    } else {
-    SLOW_CASE:
-        canvas->drawBitmapRect(bitmap, &src, dst, &paint);
-    }
-}
-
 SkScalar calculateStretch(SkScalar boundsLimit, SkScalar startingPoint,
                           int srcSpace, int numStrechyPixelsRemaining,
                           int numFixedPixelsRemaining) {
@@ -102,78 +84,270 @@ SkScalar calculateStretch(SkScalar boundsLimit, SkScalar startingPoint,
                           numStrechyPixelsRemaining);
 }
 
-void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
-                       const SkBitmap& bitmap, const android::Res_png_9patch& chunk,
-                       const SkPaint* paint, SkRegion** outRegion) {
-    if (canvas && canvas->quickReject(bounds, SkCanvas::kBW_EdgeType)) {
-        return;
+namespace android {
+
+// Number of nine-patch layouts kept around. A layout is a few hundred bytes
+// and there is usually a handful of nine-patches on screen, each drawn at
+// one or two sizes.
+#define NINE_PATCH_MESH_CACHE_SIZE 64
+
+/**
+ * Identifies the layout of a nine-patch: the content of its chunk, the
+ * size of its bitmap and the bounds it is drawn into. The generation ID of
+ * the bitmap is part of the key because 1x1 patches are turned into solid
+ * colors read from the pixels.
+ */
+class NinePatchMeshKey {
+public:
+    NinePatchMeshKey(): mWidth(0), mHeight(0), mGenerationId(0), mHash(0) {
+        mBounds.setEmpty();
     }
 
-    SkPaint defaultPaint;
-    if (NULL == paint) {
-        // matches default dither in NinePatchDrawable.java.
-        defaultPaint.setDither(true);
-        paint = &defaultPaint;
+    NinePatchMeshKey(const SkRect& bounds, const SkBitmap& bitmap, const Res_png_9patch& chunk):
+            mBounds(bounds), mWidth(bitmap.width()), mHeight(bitmap.height()),
+            mGenerationId(bitmap.getGenerationID()) {
+        mChunk.setCapacity(3 + chunk.numXDivs + chunk.numYDivs + chunk.numColors);
+        mChunk.add(chunk.numXDivs);
+        mChunk.add(chunk.numYDivs);
+        mChunk.add(chunk.numColors);
+        mChunk.appendArray(chunk.xDivs, chunk.numXDivs);
+        mChunk.appendArray(chunk.yDivs, chunk.numYDivs);
+        mChunk.appendArray(reinterpret_cast<const int32_t*>(chunk.colors), chunk.numColors);
+        computeHash();
     }
-    
-    // if our SkCanvas were back by GL we should enable this and draw this as
-    // a mesh, which will be faster in most cases.
-    if (false) {
-        SkNinePatch::DrawMesh(canvas, bounds, bitmap,
-                              chunk.xDivs, chunk.numXDivs,
-                              chunk.yDivs, chunk.numYDivs,
-                              paint);
-        return;
+
+    static int compare(const NinePatchMeshKey& lhs, const NinePatchMeshKey& rhs) {
+        if (lhs.mHash != rhs.mHash) return lhs.mHash < rhs.mHash ? -1 : 1;
+        int deltaInt = lhs.mWidth - rhs.mWidth;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.mHeight - rhs.mHeight;
+        if (deltaInt != 0) return deltaInt;
+        if (lhs.mGenerationId != rhs.mGenerationId) {
+            return lhs.mGenerationId < rhs.mGenerationId ? -1 : 1;
+        }
+        // Compare the bits to stay consistent with the hash
+        deltaInt = memcmp(&lhs.mBounds, &rhs.mBounds, sizeof(SkRect));
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = int(lhs.mChunk.size()) - int(rhs.mChunk.size());
+        if (deltaInt != 0) return deltaInt;
+        return memcmp(lhs.mChunk.array(), rhs.mChunk.array(), lhs.mChunk.size() * sizeof(int32_t));
     }
 
-#ifdef USE_TRACE
-    gTrace = true;
-#endif
+private:
+    static inline uint32_t hashMix(uint32_t hash, uint32_t data) {
+        hash += data;
+        hash += (hash << 10);
+        hash ^= (hash >> 6);
+        return hash;
+    }
 
-    SkASSERT(canvas || outRegion);
+    void computeHash() {
+        uint32_t hash = 0;
+        hash = hashMix(hash, uint32_t(mWidth));
+        hash = hashMix(hash, uint32_t(mHeight));
+        hash = hashMix(hash, mGenerationId);
+        const uint32_t* bounds = reinterpret_cast<const uint32_t*>(&mBounds);
+        for (size_t i = 0; i < sizeof(SkRect) / sizeof(uint32_t); i++) {
+            hash = hashMix(hash, bounds[i]);
+        }
+        for (size_t i = 0; i < mChunk.size(); i++) {
+            hash = hashMix(hash, uint32_t(mChunk[i]));
+        }
+        hash += (hash << 3);
+        hash ^= (hash >> 11);
+        hash += (hash << 15);
+        mHash = hash;
+    }
 
-#ifdef USE_TRACE
-    if (canvas) {
-        const SkMatrix& m = canvas->getTotalMatrix();
-        ALOGV("ninepatch [%g %g %g] [%g %g %g]\n",
-                 SkScalarToFloat(m[0]), SkScalarToFloat(m[1]), SkScalarToFloat(m[2]),
-                 SkScalarToFloat(m[3]), SkScalarToFloat(m[4]), SkScalarToFloat(m[5]));
+    SkRect mBounds;
+    int mWidth;
+    int mHeight;
+    uint32_t mGenerationId;
+    uint32_t mHash;
+    // Flattened chunk: counts followed by the divs and colors
+    Vector<int32_t> mChunk;
+}; // class NinePatchMeshKey
+
+inline int strictly_order_type(const NinePatchMeshKey& lhs, const NinePatchMeshKey& rhs) {
+    return NinePatchMeshKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const NinePatchMeshKey& lhs, const NinePatchMeshKey& rhs) {
+    return NinePatchMeshKey::compare(lhs, rhs);
+}
+
+/**
+ * Precomputed layout of a nine-patch drawn into given bounds. Patches that
+ * sample the bitmap are gathered into a single triangle mesh; patches that
+ * are a solid color, or transparent, are kept as plain rectangles and never
+ * sample the bitmap.
+ */
+class NinePatchMesh: public LightRefBase<NinePatchMesh> {
+public:
+    enum ColorType {
+        // Color hint from the chunk, modulated by the alpha of the paint
+        kColorType_Hint,
+        // Color of a 1x1 patch, read from the bitmap
+        kColorType_Pixel,
+        // Transparent patch, only drawn when the paint has a transfer mode
+        kColorType_Transparent
+    };
+
+    struct ColorPatch {
+        SkRect dst;
+        SkColor color;
+        ColorType type;
+    };
+
+    void addBitmapPatch(const SkIRect& src, const SkRect& dst,
+            int bitmapWidth, int bitmapHeight) {
+        mSrcRects.add(src);
+        mDstRects.add(dst);
+
+        const size_t index = mVertices.size();
+        SkPoint* vertices = mVertices.editArray() + mVertices.insertAt(index, 4);
+        vertices[0].set(dst.fLeft, dst.fTop);
+        vertices[1].set(dst.fRight, dst.fTop);
+        vertices[2].set(dst.fLeft, dst.fBottom);
+        vertices[3].set(dst.fRight, dst.fBottom);
+
+        SkPoint* texCoords = mTexCoords.editArray() + mTexCoords.insertAt(index, 4);
+        texCoords[0].iset(src.fLeft, src.fTop);
+        texCoords[1].iset(src.fRight, src.fTop);
+        texCoords[2].iset(src.fLeft, src.fBottom);
+        texCoords[3].iset(src.fRight, src.fBottom);
+
+        // Bilinear filtering of a scaled patch samples the texels of the
+        // neighbouring patches across its interior edges. The coordinates
+        // used with filtering are inset by half a texel along those edges,
+        // so that the edge pixels sample the center of the edge texels.
+        SkRect inset;
+        inset.set(src);
+        if (dst.width() != SkIntToScalar(src.width())) {
+            if (src.fLeft > 0) inset.fLeft += SK_ScalarHalf;
+            if (src.fRight < bitmapWidth) inset.fRight -= SK_ScalarHalf;
+        }
+        if (dst.height() != SkIntToScalar(src.height())) {
+            if (src.fTop > 0) inset.fTop += SK_ScalarHalf;
+            if (src.fBottom < bitmapHeight) inset.fBottom -= SK_ScalarHalf;
+        }
+
+        SkPoint* filterTexCoords = mFilterTexCoords.editArray() +
+                mFilterTexCoords.insertAt(index, 4);
+        filterTexCoords[0].set(inset.fLeft, inset.fTop);
+        filterTexCoords[1].set(inset.fRight, inset.fTop);
+        filterTexCoords[2].set(inset.fLeft, inset.fBottom);
+        filterTexCoords[3].set(inset.fRight, inset.fBottom);
+
+        // Indices past 0xFFFF cannot be represented, draw() falls back to
+        // drawing each patch on its own in this case
+        uint16_t* indices = mIndices.editArray() + mIndices.insertAt(mIndices.size(), 6);
+        indices[0] = index;
+        indices[1] = index + 1;
+        indices[2] = index + 2;
+        indices[3] = index + 1;
+        indices[4] = index + 3;
+        indices[5] = index + 2;
     }
-#endif
 
-#ifdef USE_TRACE
-    if (gTrace) {
-        ALOGV("======== ninepatch bounds [%g %g]\n", SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()));
-        ALOGV("======== ninepatch paint bm [%d,%d]\n", bitmap.width(), bitmap.height());
-        ALOGV("======== ninepatch xDivs [%d,%d]\n", chunk.xDivs[0], chunk.xDivs[1]);
-        ALOGV("======== ninepatch yDivs [%d,%d]\n", chunk.yDivs[0], chunk.yDivs[1]);
+    void addColorPatch(const SkRect& dst, SkColor color, ColorType type) {
+        ColorPatch patch;
+        patch.dst = dst;
+        patch.color = color;
+        patch.type = type;
+        mColorPatches.add(patch);
     }
-#endif
 
-    if (bounds.isEmpty() ||
-        bitmap.width() == 0 || bitmap.height() == 0 ||
-        (paint && paint->getXfermode() == NULL && paint->getAlpha() == 0))
-    {
-#ifdef USE_TRACE
-        if (gTrace) ALOGV("======== abort ninepatch draw\n");
-#endif
-        return;
+    void getTransparentRegion(SkRegion** outRegion) const {
+        for (size_t i = 0; i < mColorPatches.size(); i++) {
+            const ColorPatch& patch = mColorPatches[i];
+            if (patch.type != kColorType_Transparent) continue;
+
+            if (*outRegion == NULL) {
+                *outRegion = new SkRegion();
+            }
+            SkIRect idst;
+            patch.dst.round(&idst);
+            (*outRegion)->op(idst, SkRegion::kUnion_Op);
+        }
     }
-    
-    // should try a quick-reject test before calling lockPixels 
 
-    SkAutoLockPixels alp(bitmap);
-    // after the lock, it is valid to check getPixels()
-    if (bitmap.getPixels() == NULL)
-        return;
+    void draw(SkCanvas* canvas, const SkBitmap& bitmap, const SkPaint& paint,
+            bool hasXfer) const {
+        if (!mColorPatches.isEmpty()) {
+            SkPaint colorPaint(paint);
+            for (size_t i = 0; i < mColorPatches.size(); i++) {
+                const ColorPatch& patch = mColorPatches[i];
+                switch (patch.type) {
+                    case kColorType_Transparent:
+                        if (!hasXfer) continue;
+                        // fall through
+                    case kColorType_Hint:
+                        colorPaint.setColor(modAlpha(patch.color, paint.getAlpha()));
+                        break;
+                    case kColorType_Pixel:
+                        if (patch.color == 0 && !hasXfer) continue;
+                        colorPaint.setColor(patch.color);
+                        break;
+                }
+                canvas->drawRect(patch.dst, colorPaint);
+            }
+        }
+
+        if (mSrcRects.isEmpty()) return;
+
+        // The inset coordinates only prevent bleeding when the patches
+        // are not scaled any further by the canvas. drawBitmapRect() never
+        // samples outside of the source rectangle
+        const bool filter = paint.isFilterBitmap();
+        const bool canUseMesh = !filter ||
+                (canvas->getTotalMatrix().getType() & ~SkMatrix::kTranslate_Mask) == 0;
+
+        // The mesh replaces the shader of the paint, if any
+        if (canUseMesh && paint.getShader() == NULL && mVertices.size() <= 0x10000) {
+            SkPaint meshPaint(paint);
+            SkShader* shader = SkShader::CreateBitmapShader(bitmap,
+                    SkShader::kClamp_TileMode, SkShader::kClamp_TileMode);
+            meshPaint.setShader(shader)->unref();
+
+            const SkPoint* texCoords = filter ? mFilterTexCoords.array() : mTexCoords.array();
+            canvas->drawVertices(SkCanvas::kTriangles_VertexMode, mVertices.size(),
+                    mVertices.array(), texCoords, NULL, NULL,
+                    mIndices.array(), mIndices.size(), meshPaint);
+        } else {
+            for (size_t i = 0; i < mSrcRects.size(); i++) {
+                canvas->drawBitmapRect(bitmap, &mSrcRects[i], mDstRects[i], &paint);
+            }
+        }
+    }
+
+private:
+    Vector<SkIRect> mSrcRects;
+    Vector<SkRect> mDstRects;
+    Vector<SkPoint> mVertices;
+    Vector<SkPoint> mTexCoords;
+    // Texture coordinates used when the bitmap is filtered
+    Vector<SkPoint> mFilterTexCoords;
+    Vector<uint16_t> mIndices;
+    Vector<ColorPatch> mColorPatches;
+}; // class NinePatchMesh
+
+static Mutex gMeshCacheLock;
+static GenerationCache<NinePatchMeshKey, sp<NinePatchMesh> >
+        gMeshCache(NINE_PATCH_MESH_CACHE_SIZE);
+
+/**
+ * Computes the destination of each patch. The bitmap must be locked.
+ */
+static NinePatchMesh* buildMesh(const SkRect& bounds, const SkBitmap& bitmap,
+                                const Res_png_9patch& chunk) {
+    NinePatchMesh* mesh = new NinePatchMesh();
 
-    const bool hasXfer = paint->getXfermode() != NULL;
     SkRect      dst;
     SkIRect     src;
 
     const int32_t x0 = chunk.xDivs[0];
     const int32_t y0 = chunk.yDivs[0];
-    const SkColor initColor = ((SkPaint*)paint)->getColor();
     const uint8_t numXDivs = chunk.numXDivs;
     const uint8_t numYDivs = chunk.numYDivs;
     int i;
@@ -289,32 +463,26 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
             if (dst.fRight <= dst.fLeft || dst.fBottom <= dst.fTop) {
                 goto nextDiv;
             }
-            // If this patch is transparent, skip and don't draw.
-            if (color == android::Res_png_9patch::TRANSPARENT_COLOR && !hasXfer) {
-                if (outRegion) {
-                    if (*outRegion == NULL) {
-                        *outRegion = new SkRegion();
-                    }
-                    SkIRect idst;
-                    dst.round(&idst);
-                    //ALOGI("Adding trans rect: (%d,%d)-(%d,%d)\n",
-                    //     idst.fLeft, idst.fTop, idst.fRight, idst.fBottom);
-                    (*outRegion)->op(idst, SkRegion::kUnion_Op);
-                }
-                goto nextDiv;
-            }
-            if (canvas) {
+
 #ifdef USE_TRACE
-                ALOGV("-- src [%d %d %d %d] dst [%g %g %g %g]\n",
-                         src.fLeft, src.fTop, src.width(), src.height(),
-                         SkScalarToFloat(dst.fLeft), SkScalarToFloat(dst.fTop),
-                         SkScalarToFloat(dst.width()), SkScalarToFloat(dst.height()));
-                if (2 == src.width() && SkIntToScalar(5) == dst.width()) {
-                    ALOGV("--- skip patch\n");
-                }
+            ALOGV("-- src [%d %d %d %d] dst [%g %g %g %g]\n",
+                     src.fLeft, src.fTop, src.width(), src.height(),
+                     SkScalarToFloat(dst.fLeft), SkScalarToFloat(dst.fTop),
+                     SkScalarToFloat(dst.width()), SkScalarToFloat(dst.height()));
 #endif
-                drawStretchyPatch(canvas, src, dst, bitmap, *paint, initColor,
-                                  color, hasXfer);
+
+            if (color == Res_png_9patch::TRANSPARENT_COLOR) {
+                mesh->addColorPatch(dst, color, NinePatchMesh::kColorType_Transparent);
+            } else if (color != Res_png_9patch::NO_COLOR) {
+                mesh->addColorPatch(dst, color, NinePatchMesh::kColorType_Hint);
+            } else {
+                SkColor c;
+                if (src.width() == 1 && src.height() == 1 &&
+                        getColor(bitmap, src.fLeft, src.fTop, &c)) {
+                    mesh->addColorPatch(dst, c, NinePatchMesh::kColorType_Pixel);
+                } else {
+                    mesh->addBitmapPatch(src, dst, bitmapWidth, bitmapHeight);
+                }
             }
 
 nextDiv:
@@ -325,4 +493,98 @@ nextDiv:
         dst.fTop = dst.fBottom;
         dstRightsHaveBeenCached = true;
     }
+
+    return mesh;
+}
+
+static sp<NinePatchMesh> getMesh(const SkRect& bounds, const SkBitmap& bitmap,
+                                 const Res_png_9patch& chunk) {
+    NinePatchMeshKey key(bounds, bitmap, chunk);
+    {
+        Mutex::Autolock _l(gMeshCacheLock);
+        sp<NinePatchMesh> mesh = gMeshCache.get(key);
+        if (mesh != NULL) {
+            return mesh;
+        }
+    }
+
+    // Build the mesh outside of the lock, another thread may race us to
+    // it, in which case both meshes are equivalent
+    sp<NinePatchMesh> mesh = buildMesh(bounds, bitmap, chunk);
+
+    Mutex::Autolock _l(gMeshCacheLock);
+    if (!gMeshCache.contains(key)) {
+        gMeshCache.put(key, mesh);
+    }
+    return mesh;
+}
+
+}; // namespace android
+
+void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
+                       const SkBitmap& bitmap, const android::Res_png_9patch& chunk,
+                       const SkPaint* paint, SkRegion** outRegion) {
+    if (canvas && canvas->quickReject(bounds, SkCanvas::kBW_EdgeType)) {
+        return;
+    }
+
+    SkPaint defaultPaint;
+    if (NULL == paint) {
+        // matches default dither in NinePatchDrawable.java.
+        defaultPaint.setDither(true);
+        paint = &defaultPaint;
+    }
+    
+#ifdef USE_TRACE
+    gTrace = true;
+#endif
+
+    SkASSERT(canvas || outRegion);
+
+#ifdef USE_TRACE
+    if (canvas) {
+        const SkMatrix& m = canvas->getTotalMatrix();
+        ALOGV("ninepatch [%g %g %g] [%g %g %g]\n",
+                 SkScalarToFloat(m[0]), SkScalarToFloat(m[1]), SkScalarToFloat(m[2]),
+                 SkScalarToFloat(m[3]), SkScalarToFloat(m[4]), SkScalarToFloat(m[5]));
+    }
+#endif
+
+#ifdef USE_TRACE
+    if (gTrace) {
+        ALOGV("======== ninepatch bounds [%g %g]\n", SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()));
+        ALOGV("======== ninepatch paint bm [%d,%d]\n", bitmap.width(), bitmap.height());
+        ALOGV("======== ninepatch xDivs [%d,%d]\n", chunk.xDivs[0], chunk.xDivs[1]);
+        ALOGV("======== ninepatch yDivs [%d,%d]\n", chunk.yDivs[0], chunk.yDivs[1]);
+    }
+#endif
+
+    if (bounds.isEmpty() ||
+        bitmap.width() == 0 || bitmap.height() == 0 ||
+        (paint && paint->getXfermode() == NULL && paint->getAlpha() == 0))
+    {
+#ifdef USE_TRACE
+        if (gTrace) ALOGV("======== abort ninepatch draw\n");
+#endif
+        return;
+    }
+    
+    // should try a quick-reject test before calling lockPixels 
+
+    SkAutoLockPixels alp(bitmap);
+    // after the lock, it is valid to check getPixels()
+    if (bitmap.getPixels() == NULL)
+        return;
+
+    const bool hasXfer = paint->getXfermode() != NULL;
+    android::sp<android::NinePatchMesh> mesh = android::getMesh(bounds, bitmap, chunk);
+
+    // Transparent patches are skipped and reported, unless the transfer
+    // mode of the paint needs them drawn
+    if (outRegion && !hasXfer) {
+        mesh->getTransparentRegion(outRegion);
+    }
+    if (canvas) {
+        mesh->draw(canvas, bitmap, *paint, hasXfer);
+    }
 }
@@ -19,6 +19,7 @@
 #include "TextLayoutCache.h"
 #include "TextLayout.h"
 #include "SkFontHost.h"
+#include <cutils/atomic.h>
 #include <unicode/unistr.h>
 #include <unicode/normlzr.h>
 #include <unicode/uchar.h>
@@ -43,20 +44,19 @@ ANDROID_SINGLETON_STATIC_INSTANCE(TextLayoutEngine);
 
 //--------------------------------------------------------------------------------------------------
 
-TextLayoutCache::TextLayoutCache(TextLayoutShaper* shaper) :
-        mShaper(shaper),
-        mCache(GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
+TextLayoutCache::TextLayoutCache() :
+        mNewest(NULL), mOldest(NULL), mEntryCount(0),
         mSize(0), mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB)),
-        mCacheHitCount(0), mNanosecondsSaved(0) {
+        mCacheHitCount(0), mCacheMissCount(0), mEvictionCount(0), mNanosecondsSaved(0) {
     init();
 }
 
 TextLayoutCache::~TextLayoutCache() {
-    mCache.clear();
+    clearEntries();
 }
 
 void TextLayoutCache::init() {
-    mCache.setOnEntryRemovedListener(this);
+    mBuckets.insertAt((Entry*) NULL, 0, DEFAULT_TEXT_LAYOUT_CACHE_BUCKET_COUNT);
 
     mDebugLevel = readRtlDebugLevel();
     mDebugEnabled = mDebugLevel & kRtlDebugCaches;
@@ -71,14 +71,107 @@ void TextLayoutCache::init() {
     mInitialized = true;
 }
 
-/**
- *  Callbacks
+/*
+ * Hash table
  */
-void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc) {
-    size_t totalSizeToDelete = text.getSize() + desc->getSize();
+TextLayoutCache::Entry::Entry(const TextLayoutCacheKey& key, const sp<TextLayoutValue>& value) :
+        key(key), value(value), nextInBucket(NULL), newer(NULL), older(NULL) {
+}
+
+TextLayoutCache::Entry* TextLayoutCache::findEntry(const TextLayoutCacheKey& key) const {
+    const size_t index = key.getHash() & (mBuckets.size() - 1);
+    for (Entry* entry = mBuckets[index]; entry; entry = entry->nextInBucket) {
+        if (entry->key.getHash() == key.getHash() &&
+                TextLayoutCacheKey::compare(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void TextLayoutCache::addEntry(Entry* entry) {
+    if (mEntryCount >= mBuckets.size()) {
+        rehash(mBuckets.size() * 2);
+    }
+
+    const size_t index = entry->key.getHash() & (mBuckets.size() - 1);
+    entry->nextInBucket = mBuckets[index];
+    mBuckets.editItemAt(index) = entry;
+    mEntryCount++;
+
+    linkNewest(entry);
+}
+
+void TextLayoutCache::removeEntry(Entry* entry) {
+    const size_t index = entry->key.getHash() & (mBuckets.size() - 1);
+    Entry** link = &mBuckets.editItemAt(index);
+    while (*link != entry) {
+        link = &(*link)->nextInBucket;
+    }
+    *link = entry->nextInBucket;
+    mEntryCount--;
+
+    unlink(entry);
+
+    size_t totalSizeToDelete = entry->key.getSize() + entry->value->getSize();
     mSize -= totalSizeToDelete;
     if (mDebugEnabled) {
-        ALOGD("Cache value %p deleted, size = %d", desc.get(), totalSizeToDelete);
+        ALOGD("Cache value %p deleted, size = %d", entry->value.get(), totalSizeToDelete);
+    }
+
+    delete entry;
+}
+
+void TextLayoutCache::clearEntries() {
+    Entry* entry = mNewest;
+    while (entry) {
+        Entry* next = entry->older;
+        delete entry;
+        entry = next;
+    }
+    mNewest = mOldest = NULL;
+    mEntryCount = 0;
+    mSize = 0;
+
+    for (size_t i = 0; i < mBuckets.size(); i++) {
+        mBuckets.editItemAt(i) = NULL;
+    }
+}
+
+void TextLayoutCache::rehash(size_t bucketCount) {
+    Vector<Entry*> buckets;
+    buckets.insertAt((Entry*) NULL, 0, bucketCount);
+
+    for (Entry* entry = mNewest; entry; entry = entry->older) {
+        const size_t index = entry->key.getHash() & (bucketCount - 1);
+        entry->nextInBucket = buckets[index];
+        buckets.editItemAt(index) = entry;
+    }
+
+    mBuckets = buckets;
+}
+
+void TextLayoutCache::linkNewest(Entry* entry) {
+    entry->older = mNewest;
+    entry->newer = NULL;
+    if (mNewest) {
+        mNewest->newer = entry;
+    } else {
+        mOldest = entry;
+    }
+    mNewest = entry;
+}
+
+void TextLayoutCache::unlink(Entry* entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else {
+        mNewest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else {
+        mOldest = entry->newer;
     }
 }
 
@@ -86,15 +179,15 @@ void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>&
  * Cache clearing
  */
 void TextLayoutCache::clear() {
-    mCache.clear();
+    AutoMutex _l(mLock);
+    clearEntries();
 }
 
 /*
  * Caching
  */
-sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
+sp<TextLayoutValue> TextLayoutCache::getValue(TextLayoutShaper* shaper, const SkPaint* paint,
             const jchar* text, jint start, jint count, jint contextCount, jint dirFlags) {
-    AutoMutex _l(mLock);
     nsecs_t startTime = 0;
     if (mDebugEnabled) {
         startTime = systemTime(SYSTEM_TIME_MONOTONIC);
@@ -104,127 +197,162 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
     TextLayoutCacheKey key(paint, text, start, count, contextCount, dirFlags);
 
     // Get value from cache if possible
-    sp<TextLayoutValue> value = mCache.get(key);
+    {
+        AutoMutex _l(mLock);
+        Entry* entry = findEntry(key);
 
-    // Value not found for the key, we need to add a new value in the cache
-    if (value == NULL) {
-        if (mDebugEnabled) {
-            startTime = systemTime(SYSTEM_TIME_MONOTONIC);
-        }
-
-        value = new TextLayoutValue(contextCount);
+        if (entry) {
+            // Move the entry to the front of the LRU list
+            unlink(entry);
+            linkNewest(entry);
 
-        // Compute advances and store them
-        mShaper->computeValues(value.get(), paint,
-                reinterpret_cast<const UChar*>(text), start, count,
-                size_t(contextCount), int(dirFlags));
-
-        if (mDebugEnabled) {
-            value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
-        }
+            ++mCacheHitCount;
+            sp<TextLayoutValue> value = entry->value;
 
-        // Don't bother to add in the cache if the entry is too big
-        size_t size = key.getSize() + value->getSize();
-        if (size <= mMaxSize) {
-            // Cleanup to make some room if needed
-            if (mSize + size > mMaxSize) {
-                if (mDebugEnabled) {
-                    ALOGD("Need to clean some entries for making some room for a new entry");
+            // This is a cache hit, just log timestamp and user infos
+            if (mDebugEnabled) {
+                nsecs_t elapsedTimeThruCacheGet = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+                mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
+
+                if (value->getElapsedTime() > 0) {
+                    float deltaPercent = 100 * ((value->getElapsedTime() - elapsedTimeThruCacheGet)
+                            / ((float)value->getElapsedTime()));
+                    ALOGD("CACHE HIT #%d with start = %d, count = %d, contextCount = %d"
+                            "- Compute time %0.6f ms - "
+                            "Cache get time %0.6f ms - Gain in percent: %2.2f - Text = '%s'",
+                            mCacheHitCount, start, count, contextCount,
+                            value->getElapsedTime() * 0.000001f,
+                            elapsedTimeThruCacheGet * 0.000001f,
+                            deltaPercent,
+                            String8(text + start, count).string());
                 }
-                while (mSize + size > mMaxSize) {
-                    // This will call the callback
-                    bool removedOne = mCache.removeOldest();
-                    LOG_ALWAYS_FATAL_IF(!removedOne, "The cache is non-empty but we "
-                            "failed to remove the oldest entry.  "
-                            "mSize = %u, size = %u, mMaxSize = %u, mCache.size() = %u",
-                            mSize, size, mMaxSize, mCache.size());
+                if (mCacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0) {
+                    dumpCacheStats();
                 }
             }
+            return value;
+        }
+    }
 
-            // Update current cache size
-            mSize += size;
+    // Value not found for the key, compute it without holding the lock so that other
+    // threads can keep using the cache meanwhile
+    if (mDebugEnabled) {
+        startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
 
-            // Copy the text when we insert the new entry
-            key.internalTextCopy();
+    sp<TextLayoutValue> value = new TextLayoutValue(contextCount);
 
-            bool putOne = mCache.put(key, value);
-            LOG_ALWAYS_FATAL_IF(!putOne, "Failed to put an entry into the cache.  "
-                    "This indicates that the cache already has an entry with the "
-                    "same key but it should not since we checked earlier!"
-                    " - start = %d, count = %d, contextCount = %d - Text = '%s'",
+    // Compute advances and store them
+    shaper->computeValues(value.get(), paint,
+            reinterpret_cast<const UChar*>(text), start, count,
+            size_t(contextCount), int(dirFlags));
+
+    if (mDebugEnabled) {
+        value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+    }
+
+    AutoMutex _l(mLock);
+    ++mCacheMissCount;
+
+    // Another thread may have computed and inserted the same value in the meantime
+    Entry* existingEntry = findEntry(key);
+    if (existingEntry) {
+        if (mDebugEnabled) {
+            ALOGD("CACHE MISS: Entry computed concurrently by another thread "
+                    "with start = %d, count = %d, contextCount = %d - Text = '%s'",
                     start, count, contextCount, String8(text + start, count).string());
+        }
+        return existingEntry->value;
+    }
 
+    // Don't bother to add in the cache if the entry is too big
+    size_t size = key.getSize() + value->getSize();
+    if (size <= mMaxSize) {
+        // Cleanup to make some room if needed
+        if (mSize + size > mMaxSize) {
             if (mDebugEnabled) {
-                nsecs_t totalTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
-                ALOGD("CACHE MISS: Added entry %p "
-                        "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
-                        " - Compute time %0.6f ms - Put time %0.6f ms - Text = '%s'",
-                        value.get(), start, count, contextCount, size, mMaxSize - mSize,
-                        value->getElapsedTime() * 0.000001f,
-                        (totalTime - value->getElapsedTime()) * 0.000001f,
-                        String8(text + start, count).string());
+                ALOGD("Need to clean some entries for making some room for a new entry");
             }
-        } else {
-            if (mDebugEnabled) {
-                ALOGD("CACHE MISS: Calculated but not storing entry because it is too big "
-                        "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
-                        " - Compute time %0.6f ms - Text = '%s'",
-                        start, count, contextCount, size, mMaxSize - mSize,
-                        value->getElapsedTime() * 0.000001f,
-                        String8(text + start, count).string());
+            while (mSize + size > mMaxSize) {
+                LOG_ALWAYS_FATAL_IF(!mOldest, "The cache is non-empty but we "
+                        "failed to remove the oldest entry.  "
+                        "mSize = %u, size = %u, mMaxSize = %u, mEntryCount = %u",
+                        mSize, size, mMaxSize, mEntryCount);
+                removeEntry(mOldest);
+                ++mEvictionCount;
             }
         }
+
+        // Update current cache size
+        mSize += size;
+
+        // The entry copies the text of the key
+        addEntry(new Entry(key, value));
+
+        if (mDebugEnabled) {
+            nsecs_t totalTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+            ALOGD("CACHE MISS: Added entry %p "
+                    "with start = %d, count = %d, contextCount = %d, "
+                    "entry size %d bytes, remaining space %d bytes"
+                    " - Compute time %0.6f ms - Put time %0.6f ms - Text = '%s'",
+                    value.get(), start, count, contextCount, size, mMaxSize - mSize,
+                    value->getElapsedTime() * 0.000001f,
+                    (totalTime - value->getElapsedTime()) * 0.000001f,
+                    String8(text + start, count).string());
+        }
     } else {
-        // This is a cache hit, just log timestamp and user infos
         if (mDebugEnabled) {
-            nsecs_t elapsedTimeThruCacheGet = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
-            mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
-            ++mCacheHitCount;
-
-            if (value->getElapsedTime() > 0) {
-                float deltaPercent = 100 * ((value->getElapsedTime() - elapsedTimeThruCacheGet)
-                        / ((float)value->getElapsedTime()));
-                ALOGD("CACHE HIT #%d with start = %d, count = %d, contextCount = %d"
-                        "- Compute time %0.6f ms - "
-                        "Cache get time %0.6f ms - Gain in percent: %2.2f - Text = '%s'",
-                        mCacheHitCount, start, count, contextCount,
-                        value->getElapsedTime() * 0.000001f,
-                        elapsedTimeThruCacheGet * 0.000001f,
-                        deltaPercent,
-                        String8(text + start, count).string());
-            }
-            if (mCacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0) {
-                dumpCacheStats();
-            }
+            ALOGD("CACHE MISS: Calculated but not storing entry because it is too big "
+                    "with start = %d, count = %d, contextCount = %d, "
+                    "entry size %d bytes, remaining space %d bytes"
+                    " - Compute time %0.6f ms - Text = '%s'",
+                    start, count, contextCount, size, mMaxSize - mSize,
+                    value->getElapsedTime() * 0.000001f,
+                    String8(text + start, count).string());
         }
     }
     return value;
 }
 
 void TextLayoutCache::dumpCacheStats() {
+    String8 log;
+    dumpCacheStatsLocked(log);
+    ALOGD("------------------------------------------------");
+    ALOGD("Cache stats");
+    ALOGD("------------------------------------------------");
+    ALOGD("%s", log.string());
+    ALOGD("saved     : %0.6f ms", mNanosecondsSaved * 0.000001f);
+    ALOGD("------------------------------------------------");
+}
+
+void TextLayoutCache::dumpCacheStats(String8& log) {
+    AutoMutex _l(mLock);
+    dumpCacheStatsLocked(log);
+}
+
+void TextLayoutCache::dumpCacheStatsLocked(String8& log) {
     float remainingPercent = 100 * ((mMaxSize - mSize) / ((float)mMaxSize));
     float timeRunningInSec = (systemTime(SYSTEM_TIME_MONOTONIC) - mCacheStartTime) / 1000000000;
 
     size_t bytes = 0;
-    size_t cacheSize = mCache.size();
-    for (size_t i = 0; i < cacheSize; i++) {
-        bytes += mCache.getKeyAt(i).getSize() + mCache.getValueAt(i)->getSize();
+    for (Entry* entry = mNewest; entry; entry = entry->older) {
+        bytes += entry->key.getSize() + entry->value->getSize();
     }
 
-    ALOGD("------------------------------------------------");
-    ALOGD("Cache stats");
-    ALOGD("------------------------------------------------");
-    ALOGD("pid       : %d", getpid());
-    ALOGD("running   : %.0f seconds", timeRunningInSec);
-    ALOGD("entries   : %d", cacheSize);
-    ALOGD("max size  : %d bytes", mMaxSize);
-    ALOGD("used      : %d bytes according to mSize, %d bytes actual", mSize, bytes);
-    ALOGD("remaining : %d bytes or %2.2f percent", mMaxSize - mSize, remainingPercent);
-    ALOGD("hits      : %d", mCacheHitCount);
-    ALOGD("saved     : %0.6f ms", mNanosecondsSaved * 0.000001f);
-    ALOGD("------------------------------------------------");
+    uint32_t lookups = mCacheHitCount + mCacheMissCount;
+    float hitRate = lookups > 0 ? 100.0f * mCacheHitCount / lookups : 0.0f;
+
+    log.appendFormat("pid       : %d\n", getpid());
+    log.appendFormat("running   : %.0f seconds\n", timeRunningInSec);
+    log.appendFormat("entries   : %d in %d buckets\n", mEntryCount, mBuckets.size());
+    log.appendFormat("max size  : %d bytes\n", mMaxSize);
+    log.appendFormat("used      : %d bytes according to mSize, %d bytes actual\n", mSize, bytes);
+    log.appendFormat("remaining : %d bytes or %2.2f percent\n", mMaxSize - mSize,
+            remainingPercent);
+    log.appendFormat("hits      : %d\n", mCacheHitCount);
+    log.appendFormat("misses    : %d\n", mCacheMissCount);
+    log.appendFormat("hit rate  : %2.2f percent\n", hitRate);
+    log.appendFormat("evictions : %d\n", mEvictionCount);
 }
 
 /**
@@ -232,7 +360,7 @@ void TextLayoutCache::dumpCacheStats() {
  */
 TextLayoutCacheKey::TextLayoutCacheKey(): text(NULL), start(0), count(0), contextCount(0),
         dirFlags(0), typeface(NULL), textSize(0), textSkewX(0), textScaleX(0), flags(0),
-        hinting(SkPaint::kNo_Hinting)  {
+        hinting(SkPaint::kNo_Hinting), hash(0)  {
 }
 
 TextLayoutCacheKey::TextLayoutCacheKey(const SkPaint* paint, const UChar* text,
@@ -245,6 +373,7 @@ TextLayoutCacheKey::TextLayoutCacheKey(const SkPaint* paint, const UChar* text,
     textScaleX = paint->getTextScaleX();
     flags = paint->getFlags();
     hinting = paint->getHinting();
+    computeHash();
 }
 
 TextLayoutCacheKey::TextLayoutCacheKey(const TextLayoutCacheKey& other) :
@@ -259,13 +388,52 @@ TextLayoutCacheKey::TextLayoutCacheKey(const TextLayoutCacheKey& other) :
         textSkewX(other.textSkewX),
         textScaleX(other.textScaleX),
         flags(other.flags),
-        hinting(other.hinting) {
+        hinting(other.hinting),
+        hash(other.hash) {
     if (other.text) {
         textCopy.setTo(other.text, other.contextCount);
     }
 }
 
+// 64 bits FNV-1a
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+static inline uint64_t hashValue(uint64_t hash, const T& value) {
+    return hashBytes(hash, &value, sizeof(T));
+}
+
+void TextLayoutCacheKey::computeHash() {
+    uint64_t h = FNV_OFFSET_BASIS;
+    h = hashValue(h, start);
+    h = hashValue(h, count);
+    h = hashValue(h, contextCount);
+    h = hashValue(h, dirFlags);
+    h = hashValue(h, typeface);
+    h = hashValue(h, textSize);
+    h = hashValue(h, textSkewX);
+    h = hashValue(h, textScaleX);
+    h = hashValue(h, flags);
+    h = hashValue(h, hinting);
+    h = hashBytes(h, getText(), contextCount * sizeof(UChar));
+    hash = h;
+}
+
 int TextLayoutCacheKey::compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs) {
+    // Different hashes imply different keys, the text is only compared on collisions
+    if (lhs.hash < rhs.hash) return -1;
+    if (lhs.hash > rhs.hash) return +1;
+
     int deltaInt = lhs.start - rhs.start;
     if (deltaInt != 0) return (deltaInt);
 
@@ -331,7 +499,8 @@ uint32_t TextLayoutValue::getElapsedTime() {
     return mElapsedTime;
 }
 
-TextLayoutShaper::TextLayoutShaper() : mShaperItemGlyphArraySize(0) {
+TextLayoutShaper::TextLayoutShaper() : mShaperItemGlyphArraySize(0),
+        mWordCache(DEFAULT_WORD_CACHE_CAPACITY) {
     init();
 
     mFontRec.klass = &harfbuzzSkiaClass;
@@ -537,6 +706,79 @@ void TextLayoutShaper::computeRunValues(const SkPaint* paint, const UChar* chars
         size_t count, bool isRTL,
         Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
         Vector<jchar>* const outGlyphs) {
+    if (canSplitWords(chars, count, isRTL)) {
+        computeWordValues(paint, chars, count, outAdvances, outTotalAdvance, outGlyphs);
+    } else {
+        shapeRun(paint, chars, count, isRTL, outAdvances, outTotalAdvance, outGlyphs);
+    }
+}
+
+/**
+ * Words can be shaped independently when the run is LTR, contains at least one space and
+ * only uses scripts that don't need any context across spaces: the characters below the first
+ * RTL character (Latin, Greek, Cyrillic, Armenian and the combining marks).
+ */
+bool TextLayoutShaper::canSplitWords(const UChar* chars, size_t count, bool isRTL) {
+    if (isRTL) return false;
+
+    bool hasSpace = false;
+    for (size_t i = 0; i < count; i++) {
+        UChar ch = chars[i];
+        if (ch >= UNICODE_FIRST_RTL_CHAR) return false;
+        hasSpace |= ch == ' ';
+    }
+    return hasSpace;
+}
+
+void TextLayoutShaper::computeWordValues(const SkPaint* paint, const UChar* chars,
+        size_t count, Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+        Vector<jchar>* const outGlyphs) {
+    jfloat totalAdvance = 0;
+
+    size_t wordStart = 0;
+    while (wordStart < count) {
+        // A word is made of its characters and the spaces that follow them
+        size_t wordEnd = wordStart;
+        while (wordEnd < count && chars[wordEnd] != ' ') wordEnd++;
+        while (wordEnd < count && chars[wordEnd] == ' ') wordEnd++;
+
+        const size_t wordCount = wordEnd - wordStart;
+        TextLayoutCacheKey key(paint, chars + wordStart, 0, wordCount, wordCount,
+                kBidi_Force_LTR);
+
+        sp<TextLayoutValue> value = mWordCache.get(key);
+        if (value == NULL) {
+            value = new TextLayoutValue(wordCount);
+            shapeRun(paint, chars + wordStart, wordCount, false,
+                    &value->mAdvances, &value->mTotalAdvance, &value->mGlyphs);
+
+            // Copy the text when we insert the new entry, the oldest word is evicted
+            // if the cache is full
+            key.internalTextCopy();
+            mWordCache.put(key, value);
+        }
+#if DEBUG_GLYPHS
+        else {
+            ALOGD("Word cache hit for '%s'", String8(chars + wordStart, wordCount).string());
+        }
+#endif
+
+        outAdvances->appendVector(value->mAdvances);
+        if (outGlyphs) {
+            outGlyphs->appendVector(value->mGlyphs);
+        }
+        totalAdvance += value->mTotalAdvance;
+
+        wordStart = wordEnd;
+    }
+
+    *outTotalAdvance = totalAdvance;
+}
+
+void TextLayoutShaper::shapeRun(const SkPaint* paint, const UChar* chars,
+        size_t count, bool isRTL,
+        Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+        Vector<jchar>* const outGlyphs) {
     if (!count) {
         // We cannot shape an empty run.
         *outTotalAdvance = 0;
@@ -992,6 +1234,8 @@ HB_Face TextLayoutShaper::getCachedHBFace(SkTypeface* typeface) {
 }
 
 void TextLayoutShaper::purgeCaches() {
+    mWordCache.clear();
+
     size_t cacheSize = mCachedHBFaces.size();
     for (size_t i = 0; i < cacheSize; i++) {
         HB_FreeFace(mCachedHBFaces.valueAt(i));
@@ -1001,10 +1245,18 @@ void TextLayoutShaper::purgeCaches() {
     init();
 }
 
-TextLayoutEngine::TextLayoutEngine() {
-    mShaper = new TextLayoutShaper();
+/**
+ * Shaper of a thread, and value of mPurgeGeneration when its caches were last purged
+ */
+struct TextLayoutEngine::ThreadShaper {
+    TextLayoutShaper shaper;
+    int32_t purgeGeneration;
+};
+
+TextLayoutEngine::TextLayoutEngine() : mPurgeGeneration(0) {
+    pthread_key_create(&mShaperKey, destroyShaper);
 #if USE_TEXT_LAYOUT_CACHE
-    mTextLayoutCache = new TextLayoutCache(mShaper);
+    mTextLayoutCache = new TextLayoutCache();
 #else
     mTextLayoutCache = NULL;
 #endif
@@ -1012,14 +1264,34 @@ TextLayoutEngine::TextLayoutEngine() {
 
 TextLayoutEngine::~TextLayoutEngine() {
     delete mTextLayoutCache;
-    delete mShaper;
+    // Shapers of threads still alive are leaked, this only happens when the process exits
+    pthread_key_delete(mShaperKey);
+}
+
+void TextLayoutEngine::destroyShaper(void* shaper) {
+    delete reinterpret_cast<ThreadShaper*>(shaper);
+}
+
+TextLayoutShaper* TextLayoutEngine::getShaper() {
+    int32_t purgeGeneration = android_atomic_acquire_load(&mPurgeGeneration);
+    ThreadShaper* threadShaper = reinterpret_cast<ThreadShaper*>(
+            pthread_getspecific(mShaperKey));
+    if (!threadShaper) {
+        threadShaper = new ThreadShaper();
+        threadShaper->purgeGeneration = purgeGeneration;
+        pthread_setspecific(mShaperKey, threadShaper);
+    } else if (threadShaper->purgeGeneration != purgeGeneration) {
+        threadShaper->shaper.purgeCaches();
+        threadShaper->purgeGeneration = purgeGeneration;
+    }
+    return &threadShaper->shaper;
 }
 
 sp<TextLayoutValue> TextLayoutEngine::getValue(const SkPaint* paint, const jchar* text,
         jint start, jint count, jint contextCount, jint dirFlags) {
     sp<TextLayoutValue> value;
 #if USE_TEXT_LAYOUT_CACHE
-    value = mTextLayoutCache->getValue(paint, text, start, count,
+    value = mTextLayoutCache->getValue(getShaper(), paint, text, start, count,
             contextCount, dirFlags);
     if (value == NULL) {
         ALOGE("Cannot get TextLayoutCache value for text = '%s'",
@@ -1027,16 +1299,25 @@ sp<TextLayoutValue> TextLayoutEngine::getValue(const SkPaint* paint, const jchar
     }
 #else
     value = new TextLayoutValue(count);
-    mShaper->computeValues(value.get(), paint,
+    getShaper()->computeValues(value.get(), paint,
             reinterpret_cast<const UChar*>(text), start, count, contextCount, dirFlags);
 #endif
     return value;
 }
 
+void TextLayoutEngine::dumpCacheStats(String8& log) {
+#if USE_TEXT_LAYOUT_CACHE
+    log.append("TextLayoutCache:\n");
+    mTextLayoutCache->dumpCacheStats(log);
+#endif
+}
+
 void TextLayoutEngine::purgeCaches() {
 #if USE_TEXT_LAYOUT_CACHE
     mTextLayoutCache->clear();
-    mShaper->purgeCaches();
+    // The shapers can only be used by their own thread, they purge their caches the next
+    // time they are used
+    android_atomic_inc(&mPurgeGeneration);
 #if DEBUG_GLYPHS
     ALOGD("Purged TextLayoutEngine caches");
 #endif
@@ -20,7 +20,9 @@
 #include "RtlProperties.h"
 
 #include <stddef.h>
+#include <pthread.h>
 #include <utils/threads.h>
+#include <utils/String8.h>
 #include <utils/String16.h>
 #include <utils/GenerationCache.h>
 #include <utils/KeyedVector.h>
@@ -58,9 +60,15 @@
 // Define the default cache size in Mb
 #define DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB 0.250f
 
+// Define the initial number of buckets of the cache, must be a power of 2
+#define DEFAULT_TEXT_LAYOUT_CACHE_BUCKET_COUNT 256
+
 // Define the interval in number of cache hits between two statistics dump
 #define DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL 100
 
+// Define the number of words cached by each shaper
+#define DEFAULT_WORD_CACHE_CAPACITY 512
+
 namespace android {
 
 /**
@@ -86,6 +94,11 @@ public:
      */
     size_t getSize() const;
 
+    /**
+     * Get the hash of the content of the key, computed when the key is created.
+     */
+    inline uint64_t getHash() const { return hash; }
+
     static int compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs);
 
 private:
@@ -101,9 +114,12 @@ private:
     SkScalar textScaleX;
     uint32_t flags;
     SkPaint::Hinting hinting;
+    uint64_t hash;
 
     inline const UChar* getText() const { return text ? text : textCopy.string(); }
 
+    void computeHash();
+
 }; // TextLayoutCacheKey
 
 inline int strictly_order_type(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs) {
@@ -160,6 +176,9 @@ private:
 
 /**
  * The TextLayoutShaper is responsible for shaping (with the Harfbuzz library)
+ *
+ * A shaper holds mutable state (Harfbuzz item and glyph arrays, typefaces and faces) and
+ * must only be used by one thread at a time.
  */
 class TextLayoutShaper {
 public:
@@ -220,6 +239,12 @@ private:
      */
     UnicodeString mBuffer;
 
+    /**
+     * Cache of shaped words, used to assemble the values of runs which can be split at
+     * word boundaries
+     */
+    GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> > mWordCache;
+
     void init();
     void unrefTypefaces();
 
@@ -238,6 +263,17 @@ private:
             Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
             Vector<jchar>* const outGlyphs);
 
+    static bool canSplitWords(const UChar* chars, size_t count, bool isRTL);
+
+    void computeWordValues(const SkPaint* paint, const UChar* chars,
+            size_t count, Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+            Vector<jchar>* const outGlyphs);
+
+    void shapeRun(const SkPaint* paint, const UChar* chars,
+            size_t count, bool isRTL,
+            Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+            Vector<jchar>* const outGlyphs);
+
     SkTypeface* getCachedTypeface(SkTypeface** typeface, const char path[]);
     HB_Face getCachedHBFace(SkTypeface* typeface);
 
@@ -249,11 +285,17 @@ private:
 
 /**
  * Cache of text layout information.
+ *
+ * The cache lock is only held for lookups and insertions. On a miss, the value is computed
+ * outside of the lock with the shaper of the calling thread; if several threads compute the
+ * same value concurrently, the first inserted value is kept.
+ *
+ * Entries are stored in a hash table indexed by the precomputed hash of their key, and
+ * evicted in least recently used order when the cache exceeds its maximum size.
  */
-class TextLayoutCache : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> >
-{
+class TextLayoutCache {
 public:
-    TextLayoutCache(TextLayoutShaper* shaper);
+    TextLayoutCache();
 
     ~TextLayoutCache();
 
@@ -261,31 +303,50 @@ public:
         return mInitialized;
     }
 
-    /**
-     * Used as a callback when an entry is removed from the cache
-     * Do not invoke directly
-     */
-    void operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc);
-
-    sp<TextLayoutValue> getValue(const SkPaint* paint, const jchar* text, jint start,
-            jint count, jint contextCount, jint dirFlags);
+    sp<TextLayoutValue> getValue(TextLayoutShaper* shaper, const SkPaint* paint,
+            const jchar* text, jint start, jint count, jint contextCount, jint dirFlags);
 
     /**
      * Clear the cache
      */
     void clear();
 
+    /**
+     * Append the cache statistics to the specified log
+     */
+    void dumpCacheStats(String8& log);
+
 private:
-    TextLayoutShaper* mShaper;
+    /**
+     * Cache entry, chained in its hash bucket and in the LRU list
+     */
+    struct Entry {
+        Entry(const TextLayoutCacheKey& key, const sp<TextLayoutValue>& value);
+
+        TextLayoutCacheKey key;
+        sp<TextLayoutValue> value;
+        Entry* nextInBucket;
+        Entry* newer;
+        Entry* older;
+    };
+
     Mutex mLock;
     bool mInitialized;
 
-    GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
+    /**
+     * Hash buckets, the number of buckets is a power of 2
+     */
+    Vector<Entry*> mBuckets;
+    Entry* mNewest;
+    Entry* mOldest;
+    size_t mEntryCount;
 
     uint32_t mSize;
     uint32_t mMaxSize;
 
     uint32_t mCacheHitCount;
+    uint32_t mCacheMissCount;
+    uint32_t mEvictionCount;
     uint64_t mNanosecondsSaved;
 
     uint64_t mCacheStartTime;
@@ -302,11 +363,24 @@ private:
      * Dump Cache statistics
      */
     void dumpCacheStats();
+    void dumpCacheStatsLocked(String8& log);
+
+    Entry* findEntry(const TextLayoutCacheKey& key) const;
+    void addEntry(Entry* entry);
+    void removeEntry(Entry* entry);
+    void clearEntries();
+    void rehash(size_t bucketCount);
+
+    void linkNewest(Entry* entry);
+    void unlink(Entry* entry);
 
 }; // TextLayoutCache
 
 /**
  * The TextLayoutEngine is reponsible for computing TextLayoutValues
+ *
+ * Each thread computing values uses its own TextLayoutShaper, created on first use and
+ * destroyed when the thread exits.
  */
 class TextLayoutEngine : public Singleton<TextLayoutEngine> {
 public:
@@ -318,9 +392,29 @@ public:
 
     void purgeCaches();
 
+    /**
+     * Append the statistics of the text layout cache to the specified log
+     */
+    void dumpCacheStats(String8& log);
+
 private:
+    struct ThreadShaper;
+
     TextLayoutCache* mTextLayoutCache;
-    TextLayoutShaper* mShaper;
+
+    /**
+     * Thread local ThreadShaper
+     */
+    pthread_key_t mShaperKey;
+
+    /**
+     * Incremented by purgeCaches(), shapers purge their own caches when they notice the change
+     */
+    volatile int32_t mPurgeGeneration;
+
+    TextLayoutShaper* getShaper();
+
+    static void destroyShaper(void* shaper);
 }; // TextLayoutEngine
 
 } // namespace android
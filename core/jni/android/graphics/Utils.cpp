@@ -17,6 +17,11 @@
 #include "Utils.h"
 #include "SkUtils.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace android;
 
 bool AssetStreamAdaptor::rewind() {
@@ -62,6 +67,93 @@ size_t AssetStreamAdaptor::read(void* buffer, size_t size) {
     return amount;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+
+MappedFileStream* MappedFileStream::Create(int fd, off64_t offset, size_t length) {
+    if (fd < 0 || offset < 0 || length == 0) {
+        return NULL;
+    }
+
+    // mmap() requires an offset aligned on a page boundary
+    const off64_t pageSize = sysconf(_SC_PAGESIZE);
+    const off64_t alignedOffset = offset & ~(pageSize - 1);
+    const size_t adjust = offset - alignedOffset;
+    const size_t mappingLength = length + adjust;
+
+    void* mapping = mmap64(NULL, mappingLength, PROT_READ, MAP_PRIVATE, fd, alignedOffset);
+    if (mapping == MAP_FAILED) {
+        SkDebugf("---- mmap(%d, %lld, %d) failed: %s\n", fd, alignedOffset, mappingLength,
+                strerror(errno));
+        return NULL;
+    }
+
+    return new MappedFileStream(mapping, mappingLength, (char*) mapping + adjust, length);
+}
+
+MappedFileStream::MappedFileStream(void* mapping, size_t mappingLength,
+        const void* data, size_t length)
+        : SkMemoryStream(data, length, false), fMapping(mapping), fMappingLength(mappingLength) {
+}
+
+MappedFileStream::~MappedFileStream() {
+    munmap(fMapping, fMappingLength);
+}
+
+SkMemoryStream* android::CreateMappedAssetStream(Asset* asset) {
+    off64_t start, length;
+    int fd = asset->openFileDescriptor(&start, &length);
+    if (fd < 0) {
+        // compressed asset
+        return NULL;
+    }
+
+    SkMemoryStream* stream = MappedFileStream::Create(fd, start, length);
+    ::close(fd);
+    return stream;
+}
+
+SkStream* android::CreateAssetStream(Asset* asset) {
+    if (asset->isAllocated() || asset->isMapped()) {
+        // already in memory, getBuffer() returns the existing buffer or
+        // mapping
+        const void* data = asset->getBuffer(false);
+        if (data != NULL) {
+            return new SkMemoryStream(data, asset->getLength(), false);
+        }
+    }
+
+    // only map the asset ourselves when it is not mapped yet
+    SkStream* stream = CreateMappedAssetStream(asset);
+    if (stream != NULL) {
+        return stream;
+    }
+    return new AssetStreamAdaptor(asset);
+}
+
+SkStream* android::CopyAssetToStream(Asset* asset) {
+    off64_t size = asset->seek(0, SEEK_SET);
+    if ((off64_t)-1 == size) {
+        SkDebugf("---- copyAsset: asset rewind failed\n");
+        return NULL;
+    }
+
+    size = asset->getLength();
+    if (size <= 0) {
+        SkDebugf("---- copyAsset: asset->getLength() returned %d\n", size);
+        return NULL;
+    }
+
+    SkStream* stream = new SkMemoryStream(size);
+    void* data = const_cast<void*>(stream->getMemoryBase());
+    off64_t len = asset->read(data, size);
+    if (len != size) {
+        SkDebugf("---- copyAsset: asset->read(%d) returned %d\n", size, len);
+        delete stream;
+        stream = NULL;
+    }
+    return stream;
+}
+
 jobject android::nullObjectReturn(const char msg[]) {
     if (msg) {
         SkDebugf("--- %s\n", msg);
@@ -37,6 +37,44 @@ private:
 };
 
 
+/** Read-only stream over a private memory mapping of a range of a file.
+ *  The mapping does not depend on the file descriptor, which can be closed
+ *  or repositioned once the stream is created.
+ */
+class MappedFileStream : public SkMemoryStream {
+public:
+    /** Returns NULL if the range could not be mapped. */
+    static MappedFileStream* Create(int fd, off64_t offset, size_t length);
+
+    virtual ~MappedFileStream();
+
+private:
+    MappedFileStream(void* mapping, size_t mappingLength, const void* data, size_t length);
+
+    void*   fMapping;
+    size_t  fMappingLength;
+};
+
+/** Returns a stream over the content of the asset that does not depend on
+ *  the asset, without copying it: the asset's file is mapped in memory.
+ *  The asset's own mapping, if any, is released when the asset is closed
+ *  and can therefore not back the stream. Returns NULL if the asset is
+ *  compressed.
+ */
+SkMemoryStream* CreateMappedAssetStream(Asset* asset);
+
+/** Returns a stream over the content of the asset, valid as long as the
+ *  asset is. The content is accessed in place when the asset is already in
+ *  memory or mapped, mapped when it is uncompressed, and read incrementally
+ *  otherwise (compressed assets are inflated as they are read).
+ */
+SkStream* CreateAssetStream(Asset* asset);
+
+/** Makes a deep copy of the asset and returns it as a stream, or NULL if
+ *  there was an error.
+ */
+SkStream* CopyAssetToStream(Asset* asset);
+
 /** Restore the file descriptor's offset in our destructor
  */
 class AutoFDSeek {
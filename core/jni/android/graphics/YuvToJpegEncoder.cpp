@@ -5,6 +5,86 @@
 #include <hardware/hardware.h>
 
 #include <jni.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+// Maximum number of bands, and threads, of a parallel encode
+#define MAX_JPEG_BANDS 4
+// Minimum height of a band in MCU rows, smaller images are not split
+#define MIN_JPEG_BAND_MCU_ROWS 8
+
+///////////////////////////////////////////////////////////////////////////////
+// Deinterleaving kernels
+
+// Splits count VU pairs into a U and a V row
+static void deinterleaveVU(const uint8_t* vu, uint8_t* u, uint8_t* v, int count) {
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x2_t pairs = vld2q_u8(vu + i * 2);
+        vst1q_u8(v + i, pairs.val[0]);
+        vst1q_u8(u + i, pairs.val[1]);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(vu + i * 2));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(vu + i * 2 + 16));
+        _mm_storeu_si128((__m128i*)(v + i), _mm_packus_epi16(
+                _mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i*)(u + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; i++) {
+        u[i] = vu[i * 2 + 1];
+        v[i] = vu[i * 2];
+    }
+}
+
+// Splits count YUYV macropixels into a Y, a U and a V row
+static void deinterleaveYUYV(const uint8_t* yuyv, uint8_t* y, uint8_t* u, uint8_t* v,
+        int count) {
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x4_t pixels = vld4q_u8(yuyv + i * 4);
+        uint8x16x2_t luma;
+        luma.val[0] = pixels.val[0];
+        luma.val[1] = pixels.val[2];
+        vst2q_u8(y + i * 2, luma);
+        vst1q_u8(u + i, pixels.val[1]);
+        vst1q_u8(v + i, pixels.val[3]);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(yuyv + i * 4));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(yuyv + i * 4 + 16));
+        _mm_storeu_si128((__m128i*)(y + i * 2), _mm_packus_epi16(
+                _mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+
+        const __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64((__m128i*)(u + i), _mm_packus_epi16(_mm_and_si128(uv, mask), zero));
+        _mm_storel_epi64((__m128i*)(v + i), _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+#endif
+    for (; i < count; i++) {
+        y[i * 2] = yuyv[i * 4];
+        y[i * 2 + 1] = yuyv[i * 4 + 2];
+        u[i] = yuyv[i * 4 + 1];
+        v[i] = yuyv[i * 4 + 3];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
 
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
@@ -23,6 +103,11 @@ YuvToJpegEncoder::YuvToJpegEncoder(int* strides) : fStrides(strides) {
 
 bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
         int height, int* offsets, int jpegQuality) {
+    return encodeBand(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality, 0);
+}
+
+bool YuvToJpegEncoder::encodeBand(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, unsigned int restartInterval) {
     jpeg_compress_struct    cinfo;
     skjpeg_error_mgr        sk_err;
     skjpeg_destination_mgr  sk_wstream(stream);
@@ -30,6 +115,7 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.err = jpeg_std_error(&sk_err);
     sk_err.error_exit = skjpeg_error_exit;
     if (setjmp(sk_err.fJmpBuf)) {
+        jpeg_destroy_compress(&cinfo);
         return false;
     }
     jpeg_create_compress(&cinfo);
@@ -37,16 +123,160 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.dest = &sk_wstream;
 
     setJpegCompressStruct(&cinfo, width, height, jpegQuality);
+    cinfo.restart_interval = restartInterval;
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    compress(&cinfo, (uint8_t*) inYuv, offsets);
+    compress(&cinfo, yuv, offsets);
 
     jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
 
     return true;
 }
 
+/*
+ * A horizontal band of the image, encoded as a standalone jpeg. Every band
+ * but the last is exactly one restart interval high, so the entropy coded
+ * data of the bands can be concatenated, separated by restart markers.
+ */
+struct YuvToJpegEncoder::Band {
+    YuvToJpegEncoder* encoder;
+    uint8_t* yuv;
+    int width;
+    int height;
+    int offsets[kMaxPlanes];
+    int quality;
+    unsigned int restartInterval;
+    SkDynamicMemoryWStream stream;
+    bool success;
+};
+
+void* YuvToJpegEncoder::encodeBandThread(void* arg) {
+    Band* band = (Band*) arg;
+    band->success = band->encoder->encodeBand(&band->stream, band->yuv, band->width,
+            band->height, band->offsets, band->quality, band->restartInterval);
+    return NULL;
+}
+
+/*
+ * Finds the frame header (SOF) and the start of the entropy coded data,
+ * right after the scan header (SOS), of a jpeg produced by encodeBand().
+ */
+static bool findScanData(const uint8_t* data, size_t length, size_t* frameHeader,
+        size_t* scanData) {
+    if (length < 4 || data[0] != 0xFF || data[1] != 0xD8 ||
+            data[length - 2] != 0xFF || data[length - 1] != 0xD9) {
+        return false;
+    }
+
+    *frameHeader = 0;
+    size_t i = 2;
+    while (i + 4 <= length) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+        const uint8_t marker = data[i + 1];
+        const size_t segmentLength = (data[i + 2] << 8) | data[i + 3];
+        if (marker == 0xC0 || marker == 0xC1) {
+            *frameHeader = i;
+        }
+        i += 2 + segmentLength;
+        if (marker == 0xDA) {
+            *scanData = i;
+            return *frameHeader != 0 && i <= length - 2;
+        }
+    }
+    return false;
+}
+
+bool YuvToJpegEncoder::encodeParallel(SkWStream* stream, void* inYuv, int width,
+        int height, int* offsets, int jpegQuality, int bandCount) {
+    // Both formats use 16x16 MCUs
+    const int mcuRows = (height + 15) / 16;
+    const int mcusPerRow = (width + 15) / 16;
+
+    if (bandCount > MAX_JPEG_BANDS) bandCount = MAX_JPEG_BANDS;
+    if (bandCount > mcuRows / MIN_JPEG_BAND_MCU_ROWS) {
+        bandCount = mcuRows / MIN_JPEG_BAND_MCU_ROWS;
+    }
+    if (bandCount < 2) {
+        return encode(stream, inYuv, width, height, offsets, jpegQuality);
+    }
+
+    const int bandMcuRows = (mcuRows + bandCount - 1) / bandCount;
+    bandCount = (mcuRows + bandMcuRows - 1) / bandMcuRows;
+    const unsigned int restartInterval = bandMcuRows * mcusPerRow;
+    if (restartInterval > 0xFFFF) {
+        // DRI stores the restart interval on 16 bits
+        return encode(stream, inYuv, width, height, offsets, jpegQuality);
+    }
+
+    Band* bands = new Band[bandCount];
+    pthread_t threads[MAX_JPEG_BANDS];
+    bool started[MAX_JPEG_BANDS];
+
+    for (int i = 0; i < bandCount; i++) {
+        Band& band = bands[i];
+        const int row = i * bandMcuRows * 16;
+        band.encoder = this;
+        band.yuv = (uint8_t*) inYuv;
+        band.width = width;
+        band.height = i == bandCount - 1 ? height - row : bandMcuRows * 16;
+        offsetPlanes(offsets, row, band.offsets);
+        band.quality = jpegQuality;
+        band.restartInterval = restartInterval;
+        band.success = false;
+
+        // The first band is encoded on the calling thread
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, encodeBandThread, &band) == 0;
+    }
+
+    encodeBandThread(&bands[0]);
+    bool success = bands[0].success;
+    for (int i = 1; i < bandCount; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            encodeBandThread(&bands[i]);
+        }
+        success &= bands[i].success;
+    }
+
+    for (int i = 0; success && i < bandCount; i++) {
+        const size_t length = bands[i].stream.getOffset();
+        SkAutoMalloc storage(length);
+        uint8_t* data = (uint8_t*) storage.get();
+        bands[i].stream.copyTo(data);
+
+        size_t frameHeader, scanData;
+        if (!findScanData(data, length, &frameHeader, &scanData)) {
+            SkDebugf("YuvToJpegEncoder: invalid jpeg band %d\n", i);
+            success = false;
+            break;
+        }
+
+        if (i == 0) {
+            // The headers of the first band describe the whole image
+            data[frameHeader + 5] = (height >> 8) & 0xFF;
+            data[frameHeader + 6] = height & 0xFF;
+            success = stream->write(data, scanData);
+        } else {
+            const uint8_t restart[2] = { 0xFF, uint8_t(0xD0 + ((i - 1) & 7)) };
+            success = stream->write(restart, sizeof(restart));
+        }
+        success = success && stream->write(data + scanData, length - scanData - 2);
+    }
+
+    if (success) {
+        const uint8_t eoi[2] = { 0xFF, 0xD9 };
+        success = stream->write(eoi, sizeof(eoi));
+    }
+
+    delete[] bands;
+    return success;
+}
+
 void YuvToJpegEncoder::setJpegCompressStruct(jpeg_compress_struct* cinfo,
         int width, int height, int quality) {
     cinfo->image_width = width;
@@ -83,8 +313,9 @@ void Yuv420SpToJpegEncoder::compress(jpeg_compress_struct* cinfo,
     int height = cinfo->image_height;
     uint8_t* yPlanar = yuv + offsets[0];
     uint8_t* vuPlanar = yuv + offsets[1]; //width * height;
-    uint8_t* uRows = new uint8_t [8 * (width >> 1)];
-    uint8_t* vRows = new uint8_t [8 * (width >> 1)];
+    // libjpeg reads whole MCUs, up to 8 chroma samples past the last row
+    uint8_t* uRows = new uint8_t [8 * (width >> 1) + 8]();
+    uint8_t* vRows = new uint8_t [8 * (width >> 1) + 8]();
 
 
     // process 16 lines of Y and 8 lines of U/V each time.
@@ -115,16 +346,17 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
         uint8_t* vRows, int rowIndex, int width) {
     for (int row = 0; row < 8; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
-        uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
-            int index = row * (width >> 1) + i;
-            uRows[index] = vu[1];
-            vRows[index] = vu[0];
-            vu += 2;
-        }
+        int index = row * (width >> 1);
+        deinterleaveVU(vuPlanar + offset, uRows + index, vRows + index, width >> 1);
     }
 }
 
+void Yuv420SpToJpegEncoder::offsetPlanes(const int* offsets, int row, int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + row * fStrides[0];
+    // chroma is vertically downsampled
+    rowOffsets[1] = offsets[1] + (row >> 1) * fStrides[1];
+}
+
 void Yuv420SpToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -154,9 +386,11 @@ void Yuv422IToJpegEncoder::compress(jpeg_compress_struct* cinfo,
 
     int width = cinfo->image_width;
     int height = cinfo->image_height;
-    uint8_t* yRows = new uint8_t [16 * width];
-    uint8_t* uRows = new uint8_t [16 * (width >> 1)];
-    uint8_t* vRows = new uint8_t [16 * (width >> 1)];
+    // libjpeg reads whole MCUs, up to 16 luma and 8 chroma samples past
+    // the last row
+    uint8_t* yRows = new uint8_t [16 * width + 16]();
+    uint8_t* uRows = new uint8_t [16 * (width >> 1) + 8]();
+    uint8_t* vRows = new uint8_t [16 * (width >> 1) + 8]();
 
     uint8_t* yuvOffset = yuv + offsets[0];
 
@@ -187,18 +421,16 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
         uint8_t* vRows, int rowIndex, int width, int height) {
     for (int row = 0; row < 16; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
-            int indexY = row * width + (i << 1);
-            int indexU = row * (width >> 1) + i;
-            yRows[indexY] = yuvSeg[0];
-            yRows[indexY + 1] = yuvSeg[2];
-            uRows[indexU] = yuvSeg[1];
-            vRows[indexU] = yuvSeg[3];
-            yuvSeg += 4;
-        }
+        int indexU = row * (width >> 1);
+        deinterleaveYUYV(yuvSeg, yRows + row * width, uRows + indexU, vRows + indexU,
+                width >> 1);
     }
 }
 
+void Yuv422IToJpegEncoder::offsetPlanes(const int* offsets, int row, int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + row * fStrides[0];
+}
+
 void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -210,10 +442,10 @@ void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
 }
 ///////////////////////////////////////////////////////////////////////////////
 
-static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
+static jboolean YuvImage_compressToJpegParallel(JNIEnv* env, jobject, jbyteArray inYuv,
         int format, int width, int height, jintArray offsets,
         jintArray strides, int jpegQuality, jobject jstream,
-        jbyteArray jstorage) {
+        jbyteArray jstorage, jboolean parallel) {
     jbyte* yuv = env->GetByteArrayElements(inYuv, NULL);
     SkWStream* strm = CreateJavaOutputStreamAdaptor(env, jstream, jstorage);
 
@@ -223,7 +455,13 @@ static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
     if (encoder == NULL) {
         return false;
     }
-    encoder->encode(strm, yuv, width, height, imgOffsets, jpegQuality);
+    if (parallel) {
+        long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+        encoder->encodeParallel(strm, yuv, width, height, imgOffsets, jpegQuality,
+                cpuCount > 1 ? cpuCount : 1);
+    } else {
+        encoder->encode(strm, yuv, width, height, imgOffsets, jpegQuality);
+    }
 
     delete encoder;
     env->ReleaseByteArrayElements(inYuv, yuv, 0);
@@ -231,13 +469,23 @@ static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
     env->ReleaseIntArrayElements(strides, imgStrides, 0);
     return true;
 }
+
+static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject clazz, jbyteArray inYuv,
+        int format, int width, int height, jintArray offsets,
+        jintArray strides, int jpegQuality, jobject jstream,
+        jbyteArray jstorage) {
+    return YuvImage_compressToJpegParallel(env, clazz, inYuv, format, width, height,
+            offsets, strides, jpegQuality, jstream, jstorage, false);
+}
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <android_runtime/AndroidRuntime.h>
 
 static JNINativeMethod gYuvImageMethods[] = {
     {   "nativeCompressToJpeg",  "([BIII[I[IILjava/io/OutputStream;[B)Z",
-        (void*)YuvImage_compressToJpeg }
+        (void*)YuvImage_compressToJpeg },
+    {   "nativeCompressToJpeg",  "([BIII[I[IILjava/io/OutputStream;[BZ)Z",
+        (void*)YuvImage_compressToJpegParallel }
 };
 
 #define kClassPathName  "android/graphics/YuvImage"
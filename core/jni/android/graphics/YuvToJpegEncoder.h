@@ -33,9 +33,23 @@ public:
     bool encode(SkWStream* stream,  void* inYuv, int width,
            int height, int* offsets, int jpegQuality);
 
+    /** Encode YUV data to jpeg, splitting the image into horizontal bands
+     *  encoded in parallel. The bands are separated by restart markers and
+     *  the output is a single baseline jpeg. Falls back to encode() when
+     *  the image is too small to be split.
+     *
+     *  @param bandCount The maximum number of bands, and of threads.
+     *  @return true if successfully compressed the stream.
+     */
+    bool encodeParallel(SkWStream* stream, void* inYuv, int width,
+           int height, int* offsets, int jpegQuality, int bandCount);
+
     virtual ~YuvToJpegEncoder() {}
 
 protected:
+    // Maximum number of image planes of the supported formats
+    enum { kMaxPlanes = 2 };
+
     int fNumPlanes;
     int* fStrides;
     void setJpegCompressStruct(jpeg_compress_struct* cinfo, int width,
@@ -43,6 +57,17 @@ protected:
     virtual void configSamplingFactors(jpeg_compress_struct* cinfo) = 0;
     virtual void compress(jpeg_compress_struct* cinfo,
             uint8_t* yuv, int* offsets) = 0;
+    /** Computes the offsets of the planes of the image starting at the
+     *  specified row, which is a multiple of 16.
+     */
+    virtual void offsetPlanes(const int* offsets, int row, int* rowOffsets) = 0;
+
+private:
+    struct Band;
+
+    bool encodeBand(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, unsigned int restartInterval);
+    static void* encodeBandThread(void* band);
 };
 
 class Yuv420SpToJpegEncoder : public YuvToJpegEncoder {
@@ -57,6 +82,7 @@ private:
      void deinterleave(uint8_t* vuPlanar, uint8_t* uRows, uint8_t* vRows,
              int rowIndex, int width);
      void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+     void offsetPlanes(const int* offsets, int row, int* rowOffsets);
 };
 
 class Yuv422IToJpegEncoder : public YuvToJpegEncoder {
@@ -69,6 +95,7 @@ private:
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
     void deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* uRows,
             uint8_t* vRows, int rowIndex, int width, int height);
+    void offsetPlanes(const int* offsets, int row, int* rowOffsets);
 };
 
 #endif
@@ -24,6 +24,8 @@
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -89,6 +91,101 @@ void recycleJavaParcelObject(JNIEnv* env, jobject parcelObj)
     env->CallVoidMethod(parcelObj, gParcelOffsets.recycle);
 }
 
+// Strings longer than this are never cached
+#define MAX_CACHED_STRING_LENGTH 64
+
+/**
+ * Small direct-mapped cache of the short compact strings read from parcels.
+ * Compact strings are used for package names, actions and keys that parcels
+ * carry over and over again, and handing out the String created the last
+ * time a given string was read saves an allocation and a copy per read. A
+ * slot simply holds the last string hashed to it.
+ *
+ * The cache is never waited on: when another thread holds the lock the
+ * string is created as if the cache did not exist.
+ */
+class ParcelStringCache {
+public:
+    ParcelStringCache() {
+        memset(mEntries, 0, sizeof(mEntries));
+    }
+
+    /**
+     * Returns a local reference to a String holding the specified chars.
+     */
+    jstring get(JNIEnv* env, const jchar* chars, size_t length)
+    {
+        if (length > MAX_CACHED_STRING_LENGTH) {
+            return env->NewString(chars, length);
+        }
+
+        const uint32_t hash = hashChars(chars, length);
+        Entry& entry = mEntries[hash & (kEntryCount - 1)];
+
+        if (mLock.tryLock() != NO_ERROR) {
+            return env->NewString(chars, length);
+        }
+        if (entry.string != NULL && entry.hash == hash && entry.length == length &&
+                !memcmp(entry.chars, chars, length * sizeof(jchar))) {
+            jstring string = (jstring) env->NewLocalRef(entry.string);
+            mLock.unlock();
+            return string;
+        }
+        mLock.unlock();
+
+        jstring string = env->NewString(chars, length);
+        if (string == NULL) {
+            return NULL;
+        }
+        if (mLock.tryLock() != NO_ERROR) {
+            return string;
+        }
+        jstring globalString = (jstring) env->NewGlobalRef(string);
+        if (globalString != NULL) {
+            if (entry.string != NULL) {
+                env->DeleteGlobalRef(entry.string);
+            }
+            entry.string = globalString;
+            entry.hash = hash;
+            entry.length = length;
+            memcpy(entry.chars, chars, length * sizeof(jchar));
+        }
+        mLock.unlock();
+        return string;
+    }
+
+private:
+    enum {
+        kEntryCount = 128
+    };
+
+    struct Entry {
+        jstring string;
+        uint32_t hash;
+        size_t length;
+        jchar chars[MAX_CACHED_STRING_LENGTH];
+    };
+
+    static uint32_t hashChars(const jchar* chars, size_t length)
+    {
+        uint32_t hash = 0;
+        for (size_t i = 0; i < length; i++) {
+            hash += chars[i];
+            hash += (hash << 10);
+            hash ^= (hash >> 6);
+        }
+        hash += (hash << 3);
+        hash ^= (hash >> 11);
+        hash += (hash << 15);
+        return hash;
+    }
+
+    Mutex mLock;
+    Entry mEntries[kEntryCount];
+};
+
+static ParcelStringCache gParcelStringCache;
+
 static jint android_os_Parcel_dataSize(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -249,6 +346,75 @@ static void android_os_Parcel_writeString(JNIEnv* env, jclass clazz, jint native
     }
 }
 
+// Compact strings start with a header holding the length in chars and the
+// encoding: strings made of Latin-1 chars only take one byte per char, other
+// strings are stored as UTF-16. There is no terminating null. Compact strings
+// must be read back with readCompactString().
+enum {
+    kCompactStringUtf16 = 0,
+    kCompactStringLatin1 = 1
+};
+
+#define MAX_COMPACT_STRING_LENGTH 0x3fffffff
+
+static void android_os_Parcel_writeCompactString(JNIEnv* env, jclass clazz, jint nativePtr,
+                                                 jstring val)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    status_t err;
+    if (val == NULL) {
+        err = parcel->writeInt32(-1);
+    } else {
+        const jsize len = env->GetStringLength(val);
+        if (len > MAX_COMPACT_STRING_LENGTH) {
+            signalExceptionForError(env, clazz, BAD_VALUE);
+            return;
+        }
+
+        err = NO_MEMORY;
+        const jchar* str = env->GetStringCritical(val, 0);
+        if (str) {
+            bool latin1 = true;
+            for (jsize i = 0; i < len; i++) {
+                if (str[i] > 0xff) {
+                    latin1 = false;
+                    break;
+                }
+            }
+
+            err = parcel->writeInt32((len << 1) |
+                    (latin1 ? kCompactStringLatin1 : kCompactStringUtf16));
+            if (err == NO_ERROR) {
+                if (latin1) {
+                    uint8_t* dest = (uint8_t*) parcel->writeInplace(len);
+                    if (dest != NULL) {
+                        for (jsize i = 0; i < len; i++) {
+                            dest[i] = str[i];
+                        }
+                    } else {
+                        err = NO_MEMORY;
+                    }
+                } else {
+                    void* dest = parcel->writeInplace(len * sizeof(jchar));
+                    if (dest != NULL) {
+                        memcpy(dest, str, len * sizeof(jchar));
+                    } else {
+                        err = NO_MEMORY;
+                    }
+                }
+            }
+            env->ReleaseStringCritical(val, str);
+        }
+    }
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+    }
+}
+
 static void android_os_Parcel_writeStrongBinder(JNIEnv* env, jclass clazz, jint nativePtr, jobject object)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -272,6 +438,100 @@ static void android_os_Parcel_writeFileDescriptor(JNIEnv* env, jclass clazz, jin
     }
 }
 
+// Primitive arrays are stored as consecutive values, exactly as if each value
+// had been written with writeInt32(), writeInt64(), writeFloat() or
+// writeDouble(), so that bulk and per-value accessors can be mixed freely.
+
+static bool checkArrayBounds(JNIEnv* env, jarray array, jint offset, jint count)
+{
+    if (array == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return false;
+    }
+    const jint length = env->GetArrayLength(array);
+    if ((offset | count) < 0 || offset > length - count) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+static void writePrimitives(JNIEnv* env, jclass clazz, Parcel* parcel, jarray array,
+                            jint offset, jint count)
+{
+    if (size_t(count) > size_t(-1) / sizeof(T)) {
+        signalExceptionForError(env, clazz, BAD_VALUE);
+        return;
+    }
+
+    void* dest = parcel->writeInplace(count * sizeof(T));
+    if (dest == NULL) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+
+    T* ar = (T*)env->GetPrimitiveArrayCritical(array, 0);
+    if (ar) {
+        memcpy(dest, ar + offset, count * sizeof(T));
+        env->ReleasePrimitiveArrayCritical(array, ar, JNI_ABORT);
+    }
+}
+
+template<typename T>
+static void writePrimitiveArray(JNIEnv* env, jclass clazz, jint nativePtr, jarray array)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    const jint length = array != NULL ? env->GetArrayLength(array) : -1;
+    const status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+        return;
+    }
+    if (length > 0) {
+        writePrimitives<T>(env, clazz, parcel, array, 0, length);
+    }
+}
+
+static void android_os_Parcel_writeIntArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                            jintArray array)
+{
+    writePrimitiveArray<jint>(env, clazz, nativePtr, array);
+}
+
+static void android_os_Parcel_writeLongArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                             jlongArray array)
+{
+    writePrimitiveArray<jlong>(env, clazz, nativePtr, array);
+}
+
+static void android_os_Parcel_writeFloatArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                              jfloatArray array)
+{
+    writePrimitiveArray<jfloat>(env, clazz, nativePtr, array);
+}
+
+static void android_os_Parcel_writeDoubleArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                               jdoubleArray array)
+{
+    writePrimitiveArray<jdouble>(env, clazz, nativePtr, array);
+}
+
+// Writes count ints from the array, without any length, as a batch of
+// writeInt() calls would
+static void android_os_Parcel_writeInts(JNIEnv* env, jclass clazz, jint nativePtr,
+                                        jintArray array, jint offset, jint count)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL && checkArrayBounds(env, array, offset, count)) {
+        writePrimitives<jint>(env, clazz, parcel, array, offset, count);
+    }
+}
+
 static jbyteArray android_os_Parcel_createByteArray(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     jbyteArray ret = NULL;
@@ -298,6 +558,97 @@ static jbyteArray android_os_Parcel_createByteArray(JNIEnv* env, jclass clazz, j
     return ret;
 }
 
+static jarray newPrimitiveArray(JNIEnv* env, jint*, jsize length)
+{
+    return env->NewIntArray(length);
+}
+
+static jarray newPrimitiveArray(JNIEnv* env, jlong*, jsize length)
+{
+    return env->NewLongArray(length);
+}
+
+static jarray newPrimitiveArray(JNIEnv* env, jfloat*, jsize length)
+{
+    return env->NewFloatArray(length);
+}
+
+static jarray newPrimitiveArray(JNIEnv* env, jdouble*, jsize length)
+{
+    return env->NewDoubleArray(length);
+}
+
+template<typename T>
+static jarray createPrimitiveArray(JNIEnv* env, jint nativePtr)
+{
+    jarray ret = NULL;
+
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        int32_t len = parcel->readInt32();
+
+        // sanity check the stored length against the true data size
+        if (len >= 0 && size_t(len) <= parcel->dataAvail() / sizeof(T)) {
+            ret = newPrimitiveArray(env, (T*) NULL, len);
+
+            if (ret != NULL) {
+                T* a2 = (T*)env->GetPrimitiveArrayCritical(ret, 0);
+                if (a2) {
+                    const void* data = parcel->readInplace(len * sizeof(T));
+                    memcpy(a2, data, len * sizeof(T));
+                    env->ReleasePrimitiveArrayCritical(ret, a2, 0);
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+static jintArray android_os_Parcel_createIntArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return (jintArray) createPrimitiveArray<jint>(env, nativePtr);
+}
+
+static jlongArray android_os_Parcel_createLongArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return (jlongArray) createPrimitiveArray<jlong>(env, nativePtr);
+}
+
+static jfloatArray android_os_Parcel_createFloatArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return (jfloatArray) createPrimitiveArray<jfloat>(env, nativePtr);
+}
+
+static jdoubleArray android_os_Parcel_createDoubleArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return (jdoubleArray) createPrimitiveArray<jdouble>(env, nativePtr);
+}
+
+// Reads count ints into the array, as a batch of readInt() calls would: the
+// values past the end of the data read as 0
+static void android_os_Parcel_readInts(JNIEnv* env, jclass clazz, jint nativePtr,
+                                       jintArray array, jint offset, jint count)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL || !checkArrayBounds(env, array, offset, count)) {
+        return;
+    }
+
+    jint* ar = (jint*)env->GetPrimitiveArrayCritical(array, 0);
+    if (ar) {
+        const void* data = parcel->readInplace(count * sizeof(jint));
+        if (data != NULL) {
+            memcpy(ar + offset, data, count * sizeof(jint));
+        } else {
+            for (jint i = 0; i < count; i++) {
+                ar[offset + i] = parcel->readInt32();
+            }
+        }
+        env->ReleasePrimitiveArrayCritical(array, ar, 0);
+    }
+}
+
 static jint android_os_Parcel_readInt(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -348,6 +699,52 @@ static jstring android_os_Parcel_readString(JNIEnv* env, jclass clazz, jint nati
     return NULL;
 }
 
+static jstring android_os_Parcel_readCompactString(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return NULL;
+    }
+
+    const int32_t header = parcel->readInt32();
+    if (header < 0) {
+        return NULL;
+    }
+    const size_t len = header >> 1;
+
+    if ((header & kCompactStringLatin1) == 0) {
+        const jchar* str = (const jchar*) parcel->readInplace(len * sizeof(jchar));
+        if (str) {
+            return gParcelStringCache.get(env, str, len);
+        }
+        return NULL;
+    }
+
+    const uint8_t* str = (const uint8_t*) parcel->readInplace(len);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    jchar stackChars[MAX_CACHED_STRING_LENGTH];
+    jchar* chars = stackChars;
+    if (len > MAX_CACHED_STRING_LENGTH) {
+        chars = (jchar*) malloc(len * sizeof(jchar));
+        if (chars == NULL) {
+            signalExceptionForError(env, clazz, NO_MEMORY);
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < len; i++) {
+        chars[i] = str[i];
+    }
+
+    jstring ret = gParcelStringCache.get(env, chars, len);
+    if (chars != stackChars) {
+        free(chars);
+    }
+    return ret;
+}
+
 static jobject android_os_Parcel_readStrongBinder(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -640,8 +1037,14 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeWriteFloat",          "(IF)V", (void*)android_os_Parcel_writeFloat},
     {"nativeWriteDouble",         "(ID)V", (void*)android_os_Parcel_writeDouble},
     {"nativeWriteString",         "(ILjava/lang/String;)V", (void*)android_os_Parcel_writeString},
+    {"nativeWriteCompactString",  "(ILjava/lang/String;)V", (void*)android_os_Parcel_writeCompactString},
     {"nativeWriteStrongBinder",   "(ILandroid/os/IBinder;)V", (void*)android_os_Parcel_writeStrongBinder},
     {"nativeWriteFileDescriptor", "(ILjava/io/FileDescriptor;)V", (void*)android_os_Parcel_writeFileDescriptor},
+    {"nativeWriteIntArray",       "(I[I)V", (void*)android_os_Parcel_writeIntArray},
+    {"nativeWriteLongArray",      "(I[J)V", (void*)android_os_Parcel_writeLongArray},
+    {"nativeWriteFloatArray",     "(I[F)V", (void*)android_os_Parcel_writeFloatArray},
+    {"nativeWriteDoubleArray",    "(I[D)V", (void*)android_os_Parcel_writeDoubleArray},
+    {"nativeWriteInts",           "(I[III)V", (void*)android_os_Parcel_writeInts},
 
     {"nativeCreateByteArray",     "(I)[B", (void*)android_os_Parcel_createByteArray},
     {"nativeReadInt",             "(I)I", (void*)android_os_Parcel_readInt},
@@ -649,8 +1052,14 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeReadFloat",           "(I)F", (void*)android_os_Parcel_readFloat},
     {"nativeReadDouble",          "(I)D", (void*)android_os_Parcel_readDouble},
     {"nativeReadString",          "(I)Ljava/lang/String;", (void*)android_os_Parcel_readString},
+    {"nativeReadCompactString",   "(I)Ljava/lang/String;", (void*)android_os_Parcel_readCompactString},
     {"nativeReadStrongBinder",    "(I)Landroid/os/IBinder;", (void*)android_os_Parcel_readStrongBinder},
     {"nativeReadFileDescriptor",  "(I)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_readFileDescriptor},
+    {"nativeCreateIntArray",      "(I)[I", (void*)android_os_Parcel_createIntArray},
+    {"nativeCreateLongArray",     "(I)[J", (void*)android_os_Parcel_createLongArray},
+    {"nativeCreateFloatArray",    "(I)[F", (void*)android_os_Parcel_createFloatArray},
+    {"nativeCreateDoubleArray",   "(I)[D", (void*)android_os_Parcel_createDoubleArray},
+    {"nativeReadInts",            "(I[III)V", (void*)android_os_Parcel_readInts},
 
     {"openFileDescriptor",        "(Ljava/lang/String;I)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_openFileDescriptor},
     {"dupFileDescriptor",         "(Ljava/io/FileDescriptor;)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_dupFileDescriptor},
@@ -845,10 +845,17 @@ static jboolean android_view_GLES20Canvas_isAvailable(JNIEnv* env, jobject clazz
 
 static void
 android_app_ActivityThread_dumpGraphics(JNIEnv* env, jobject clazz, jobject javaFileDescriptor) {
-#ifdef USE_OPENGL_RENDERER
     int fd = jniGetFDFromFileDescriptor(env, javaFileDescriptor);
+#ifdef USE_OPENGL_RENDERER
     android::uirenderer::DisplayList::outputLogBuffer(fd);
 #endif // USE_OPENGL_RENDERER
+
+    String8 textLayoutLog;
+    TextLayoutEngine::getInstance().dumpCacheStats(textLayoutLog);
+    if (!textLayoutLog.isEmpty()) {
+        textLayoutLog.append("\n");
+        write(fd, textLayoutLog.string(), textLayoutLog.size());
+    }
 }
 
 // ----------------------------------------------------------------------------
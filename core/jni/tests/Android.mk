@@ -0,0 +1,40 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# Microbenchmark of the string natives of android.os.Parcel. Starts its own
+# VM and must therefore be run on a device, where BOOTCLASSPATH is set.
+LOCAL_SRC_FILES:= \
+	ParcelBenchmark.cpp
+
+LOCAL_C_INCLUDES += \
+	$(JNI_H_INCLUDE)
+
+LOCAL_SHARED_LIBRARIES := libcutils libutils libbinder libdvm libnativehelper libandroid_runtime
+LOCAL_MODULE := parcelbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# Unit test of the vectorized color procs used by android.graphics.Bitmap,
+# which also reports their throughput against the scalar procs. The procs
+# are compiled in the test with the same flags as in libandroid_runtime.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	ColorProcs_test.cpp \
+	../android/graphics/ColorProcs.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/../android/graphics \
+	external/skia/include/core \
+	external/skia/src/ports
+
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
+LOCAL_SHARED_LIBRARIES := libcutils libutils libskia libstlport
+LOCAL_STATIC_LIBRARIES := libgtest libgtest_main
+LOCAL_MODULE := ColorProcs_test
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ColorProcs_test"
+
+#include "ColorProcs.h"
+
+#include <utils/Timers.h>
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace android {
+
+#if USE_SIMD_COLOR_PROCS
+
+// Widths up to this value are tested, to cover every tail length
+#define MAX_TEST_WIDTH 67
+// Row width and number of rows used to measure the throughput
+#define BENCH_WIDTH 1024
+#define BENCH_ROWS 4096
+
+class ColorProcsTest : public testing::Test {
+protected:
+    uint32_t mSeed;
+
+    virtual void SetUp() {
+        mSeed = 0x12345678;
+    }
+
+    uint32_t nextRandom() {
+        const uint32_t low = nextHalf();
+        return low | (nextHalf() << 16);
+    }
+
+    /**
+     * Returns a random color. A third of the colors are opaque and a
+     * third are transparent, to exercise both the fast and slow paths.
+     */
+    SkColor nextColor() {
+        const uint32_t c = nextRandom();
+        switch (c % 3) {
+            case 0: return c | 0xFF000000;
+            case 1: return c & 0x00FFFFFF;
+            default: return c;
+        }
+    }
+
+private:
+    uint32_t nextHalf() {
+        mSeed = mSeed * 1103515245 + 12345;
+        return mSeed >> 16;
+    }
+};
+
+/**
+ * Calls the scalar and the vectorized procs on the same rows, for every
+ * width and for unaligned rows, and expects identical results.
+ */
+template<typename Src, typename Dst, typename Proc>
+static void compareToColorProcs(const Src* src, Proc scalar, Proc simd) {
+    Dst expected[MAX_TEST_WIDTH + 1];
+    Dst actual[MAX_TEST_WIDTH + 1];
+
+    for (int offset = 0; offset < 2; offset++) {
+        for (int width = 1; width <= MAX_TEST_WIDTH; width++) {
+            memset(expected, 0, sizeof(expected));
+            memset(actual, 0, sizeof(actual));
+            scalar(expected + offset, src + offset, width, NULL);
+            simd(actual + offset, src + offset, width, NULL);
+            ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected)))
+                    << "width = " << width << ", offset = " << offset;
+        }
+    }
+}
+
+TEST_F(ColorProcsTest, FromColor_D32) {
+    SkColor src[MAX_TEST_WIDTH + 1];
+    SkPMColor expected[MAX_TEST_WIDTH + 1];
+    SkPMColor actual[MAX_TEST_WIDTH + 1];
+
+    for (int i = 0; i < 100; i++) {
+        for (int j = 0; j <= MAX_TEST_WIDTH; j++) {
+            src[j] = nextColor();
+        }
+        for (int offset = 0; offset < 2; offset++) {
+            for (int width = 1; width <= MAX_TEST_WIDTH - offset; width++) {
+                memset(expected, 0, sizeof(expected));
+                memset(actual, 0, sizeof(actual));
+                FromColor_D32(expected + offset, src + offset, width, 0, 0);
+                FromColor_D32_SIMD(actual + offset, src + offset, width, 0, 0);
+                ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected)))
+                        << "width = " << width << ", offset = " << offset;
+            }
+        }
+    }
+}
+
+TEST_F(ColorProcsTest, FromColor_D32_AllAlphas) {
+    // Every alpha value with every color component value
+    SkColor src[256];
+    SkPMColor expected[256];
+    SkPMColor actual[256];
+
+    for (int c = 0; c < 256; c++) {
+        for (int a = 0; a < 256; a++) {
+            src[a] = SkColorSetARGB(a, c, 255 - c, c ^ 0x5A);
+        }
+        FromColor_D32(expected, src, 256, 0, 0);
+        FromColor_D32_SIMD(actual, src, 256, 0, 0);
+        ASSERT_EQ(0, memcmp(expected, actual, sizeof(expected))) << "component = " << c;
+    }
+}
+
+TEST_F(ColorProcsTest, ToColor_S32_Opaque) {
+    SkPMColor src[MAX_TEST_WIDTH + 2];
+
+    for (int i = 0; i < 100; i++) {
+        for (int j = 0; j < MAX_TEST_WIDTH + 2; j++) {
+            src[j] = SkPreMultiplyColor(nextRandom() | 0xFF000000);
+        }
+        compareToColorProcs<SkPMColor, SkColor>(src, ToColor_S32_Opaque,
+                ToColor_S32_Opaque_SIMD);
+    }
+}
+
+TEST_F(ColorProcsTest, ToColor_S32_Alpha) {
+    SkPMColor src[MAX_TEST_WIDTH + 2];
+
+    for (int i = 0; i < 100; i++) {
+        // Mix runs of opaque pixels with translucent ones
+        const bool opaqueRun = i & 1;
+        for (int j = 0; j < MAX_TEST_WIDTH + 2; j++) {
+            const SkColor c = opaqueRun && j < 40 ? nextRandom() | 0xFF000000 : nextColor();
+            src[j] = SkPreMultiplyColor(c);
+        }
+        compareToColorProcs<SkPMColor, SkColor>(src, ToColor_S32_Alpha,
+                ToColor_S32_Alpha_SIMD);
+    }
+}
+
+TEST_F(ColorProcsTest, ToColor_S565) {
+    // Every 565 value
+    uint16_t src[0x10000 + 1];
+    for (int i = 0; i <= 0x10000; i++) {
+        src[i] = i;
+    }
+
+    SkColor* expected = new SkColor[0x10000];
+    SkColor* actual = new SkColor[0x10000];
+    ToColor_S565(expected, src, 0x10000, NULL);
+    ToColor_S565_SIMD(actual, src, 0x10000, NULL);
+    EXPECT_EQ(0, memcmp(expected, actual, 0x10000 * sizeof(SkColor)));
+    delete[] expected;
+    delete[] actual;
+
+    compareToColorProcs<uint16_t, SkColor>(src + 1000, ToColor_S565, ToColor_S565_SIMD);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Throughput
+///////////////////////////////////////////////////////////////////////////////
+
+typedef void (*FromColorProc)(void* dst, const SkColor src[], int width, int x, int y);
+typedef void (*ToColorProc)(SkColor dst[], const void* src, int width, SkColorTable* ctable);
+
+static double timeFromColor(FromColorProc proc, const SkColor* src, SkPMColor* dst) {
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        proc(dst, src, BENCH_WIDTH, 0, i);
+    }
+    return double(systemTime(SYSTEM_TIME_MONOTONIC) - start) / (BENCH_ROWS * BENCH_WIDTH);
+}
+
+static double timeToColor(ToColorProc proc, const void* src, SkColor* dst) {
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        proc(dst, src, BENCH_WIDTH, NULL);
+    }
+    return double(systemTime(SYSTEM_TIME_MONOTONIC) - start) / (BENCH_ROWS * BENCH_WIDTH);
+}
+
+static void printTimes(const char* name, double scalar, double simd) {
+    printf("%-24s scalar %6.2f ns/pixel, simd %6.2f ns/pixel (%.1fx)\n",
+            name, scalar, simd, scalar / simd);
+}
+
+TEST_F(ColorProcsTest, Throughput) {
+    SkColor* colors = new SkColor[BENCH_WIDTH];
+    SkPMColor* opaque = new SkPMColor[BENCH_WIDTH];
+    SkPMColor* translucent = new SkPMColor[BENCH_WIDTH];
+    uint16_t* pixels565 = new uint16_t[BENCH_WIDTH];
+    SkPMColor* dst32 = new SkPMColor[BENCH_WIDTH];
+    SkColor* dstColors = new SkColor[BENCH_WIDTH];
+
+    for (int i = 0; i < BENCH_WIDTH; i++) {
+        colors[i] = nextColor();
+        opaque[i] = SkPreMultiplyColor(nextRandom() | 0xFF000000);
+        // Mostly opaque, like most translucent bitmaps
+        translucent[i] = SkPreMultiplyColor(i % 16 ? nextRandom() | 0xFF000000 : nextColor());
+        pixels565[i] = nextRandom();
+    }
+
+    printTimes("FromColor_D32",
+            timeFromColor(FromColor_D32, colors, dst32),
+            timeFromColor(FromColor_D32_SIMD, colors, dst32));
+    printTimes("ToColor_S32_Opaque",
+            timeToColor(ToColor_S32_Opaque, opaque, dstColors),
+            timeToColor(ToColor_S32_Opaque_SIMD, opaque, dstColors));
+    printTimes("ToColor_S32_Alpha",
+            timeToColor(ToColor_S32_Alpha, translucent, dstColors),
+            timeToColor(ToColor_S32_Alpha_SIMD, translucent, dstColors));
+    printTimes("ToColor_S565",
+            timeToColor(ToColor_S565, pixels565, dstColors),
+            timeToColor(ToColor_S565_SIMD, pixels565, dstColors));
+
+    delete[] colors;
+    delete[] opaque;
+    delete[] translucent;
+    delete[] pixels565;
+    delete[] dst32;
+    delete[] dstColors;
+}
+
+#endif // USE_SIMD_COLOR_PROCS
+
+}
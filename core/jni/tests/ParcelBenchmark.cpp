@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ParcelBenchmark"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jni.h"
+
+#include <android_runtime/AndroidRuntime.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_DEFAULT_ITERATIONS 200000
+#define BENCH_THREADS 4
+
+// Strings written in every parcel, representative of intents and bundles
+static const char* const sStrings[] = {
+    "android.intent.action.MAIN",
+    "android.intent.category.LAUNCHER",
+    "com.android.settings",
+    "com.android.settings.Settings",
+    "android.intent.extra.TEXT",
+    "key",
+    "\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c", // Not Latin-1
+};
+
+#define STRING_COUNT (sizeof(sStrings) / sizeof(sStrings[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+// Parcel natives
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The natives are private to android.os.Parcel, JNI lets us call them
+ * directly so that only the native side is measured.
+ */
+struct ParcelNatives {
+    jclass clazz;
+    jmethodID create;
+    jmethodID destroy;
+    jmethodID setDataPosition;
+    jmethodID writeString;
+    jmethodID writeCompactString;
+    jmethodID readString;
+    jmethodID readCompactString;
+};
+
+static JavaVM* sVm;
+static ParcelNatives sNatives;
+
+static bool initNatives(JNIEnv* env) {
+    jclass clazz = env->FindClass("android/os/Parcel");
+    if (clazz == NULL) {
+        fprintf(stderr, "Unable to find android.os.Parcel\n");
+        return false;
+    }
+    sNatives.clazz = (jclass) env->NewGlobalRef(clazz);
+    sNatives.create = env->GetStaticMethodID(clazz, "nativeCreate", "()I");
+    sNatives.destroy = env->GetStaticMethodID(clazz, "nativeDestroy", "(I)V");
+    sNatives.setDataPosition = env->GetStaticMethodID(clazz, "nativeSetDataPosition", "(II)V");
+    sNatives.writeString = env->GetStaticMethodID(clazz, "nativeWriteString",
+            "(ILjava/lang/String;)V");
+    sNatives.writeCompactString = env->GetStaticMethodID(clazz, "nativeWriteCompactString",
+            "(ILjava/lang/String;)V");
+    sNatives.readString = env->GetStaticMethodID(clazz, "nativeReadString",
+            "(I)Ljava/lang/String;");
+    sNatives.readCompactString = env->GetStaticMethodID(clazz, "nativeReadCompactString",
+            "(I)Ljava/lang/String;");
+
+    if (env->ExceptionCheck()) {
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+struct Strings {
+    jstring strings[STRING_COUNT];
+};
+
+static void createStrings(JNIEnv* env, Strings& strings) {
+    for (size_t i = 0; i < STRING_COUNT; i++) {
+        strings.strings[i] = (jstring) env->NewGlobalRef(env->NewStringUTF(sStrings[i]));
+    }
+}
+
+static void destroyStrings(JNIEnv* env, Strings& strings) {
+    for (size_t i = 0; i < STRING_COUNT; i++) {
+        env->DeleteGlobalRef(strings.strings[i]);
+    }
+}
+
+static void writeStrings(JNIEnv* env, jint parcel, const Strings& strings, bool compact) {
+    const jmethodID write = compact ? sNatives.writeCompactString : sNatives.writeString;
+    for (size_t i = 0; i < STRING_COUNT; i++) {
+        env->CallStaticVoidMethod(sNatives.clazz, write, parcel, strings.strings[i]);
+    }
+}
+
+/**
+ * Returns the average time, in ns, taken to write all the strings.
+ */
+static double benchWrite(JNIEnv* env, const Strings& strings, bool compact, int iterations) {
+    const jint parcel = env->CallStaticIntMethod(sNatives.clazz, sNatives.create);
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        env->CallStaticVoidMethod(sNatives.clazz, sNatives.setDataPosition, parcel, 0);
+        writeStrings(env, parcel, strings, compact);
+    }
+    const nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    env->CallStaticVoidMethod(sNatives.clazz, sNatives.destroy, parcel);
+    return double(end - start) / iterations;
+}
+
+/**
+ * Returns the average time, in ns, taken to read all the strings back.
+ */
+static double benchRead(JNIEnv* env, const Strings& strings, bool compact, int iterations) {
+    const jint parcel = env->CallStaticIntMethod(sNatives.clazz, sNatives.create);
+    writeStrings(env, parcel, strings, compact);
+
+    const jmethodID read = compact ? sNatives.readCompactString : sNatives.readString;
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        env->CallStaticVoidMethod(sNatives.clazz, sNatives.setDataPosition, parcel, 0);
+        for (size_t j = 0; j < STRING_COUNT; j++) {
+            jobject string = env->CallStaticObjectMethod(sNatives.clazz, read, parcel);
+            env->DeleteLocalRef(string);
+        }
+    }
+    const nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    env->CallStaticVoidMethod(sNatives.clazz, sNatives.destroy, parcel);
+    return double(end - start) / iterations;
+}
+
+/**
+ * Reads strings that are all different, which measures the cost of a
+ * cache miss on the compact path.
+ */
+static double benchReadUnique(JNIEnv* env, bool compact, int iterations) {
+    const jint parcel = env->CallStaticIntMethod(sNatives.clazz, sNatives.create);
+    const jmethodID write = compact ? sNatives.writeCompactString : sNatives.writeString;
+    const jmethodID read = compact ? sNatives.readCompactString : sNatives.readString;
+
+    for (int i = 0; i < iterations; i++) {
+        String8 value = String8::format("com.example.key.%d", i);
+        jstring string = env->NewStringUTF(value.string());
+        env->CallStaticVoidMethod(sNatives.clazz, write, parcel, string);
+        env->DeleteLocalRef(string);
+    }
+    env->CallStaticVoidMethod(sNatives.clazz, sNatives.setDataPosition, parcel, 0);
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        jobject string = env->CallStaticObjectMethod(sNatives.clazz, read, parcel);
+        env->DeleteLocalRef(string);
+    }
+    const nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    env->CallStaticVoidMethod(sNatives.clazz, sNatives.destroy, parcel);
+    return double(end - start) / iterations;
+}
+
+struct ThreadArgs {
+    bool compact;
+    int iterations;
+    double result;
+};
+
+static void* readThread(void* data) {
+    ThreadArgs* args = (ThreadArgs*) data;
+
+    JNIEnv* env;
+    if (sVm->AttachCurrentThread(&env, NULL) != JNI_OK) {
+        args->result = -1.0;
+        return NULL;
+    }
+
+    Strings strings;
+    createStrings(env, strings);
+    args->result = benchRead(env, strings, args->compact, args->iterations);
+    destroyStrings(env, strings);
+
+    sVm->DetachCurrentThread();
+    return NULL;
+}
+
+/**
+ * Reads strings from several threads at once. Returns the average time
+ * taken by one thread to read all the strings.
+ */
+static double benchReadThreaded(bool compact, int iterations) {
+    pthread_t threads[BENCH_THREADS];
+    ThreadArgs args[BENCH_THREADS];
+
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        args[i].compact = compact;
+        args[i].iterations = iterations;
+        args[i].result = 0.0;
+        pthread_create(&threads[i], NULL, readThread, &args[i]);
+    }
+
+    double total = 0.0;
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += args[i].result;
+    }
+    return total / BENCH_THREADS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+static bool startVm(JNIEnv** env) {
+    JavaVMInitArgs initArgs;
+    initArgs.version = JNI_VERSION_1_4;
+    initArgs.options = NULL;
+    initArgs.nOptions = 0;
+    initArgs.ignoreUnrecognized = JNI_TRUE;
+
+    if (JNI_CreateJavaVM(&sVm, env, &initArgs) < 0) {
+        fprintf(stderr, "Unable to create the VM\n");
+        return false;
+    }
+    if (AndroidRuntime::startReg(*env) < 0) {
+        fprintf(stderr, "Unable to register the natives\n");
+        return false;
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: parcelbench [iterations]\n");
+}
+
+int main(int argc, char** argv) {
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+        if (iterations <= 0) {
+            usage();
+            return 1;
+        }
+    }
+
+    JNIEnv* env;
+    if (!startVm(&env) || !initNatives(env)) {
+        return 1;
+    }
+
+    Strings strings;
+    createStrings(env, strings);
+
+    // Warm up the VM and the string cache
+    benchRead(env, strings, true, iterations / 10);
+    benchRead(env, strings, false, iterations / 10);
+
+    printf("%d strings, %d iterations\n", int(STRING_COUNT), iterations);
+    printf("%-28s %12s %12s\n", "", "string", "compact");
+    printf("%-28s %9.0f ns %9.0f ns\n", "write",
+            benchWrite(env, strings, false, iterations),
+            benchWrite(env, strings, true, iterations));
+    printf("%-28s %9.0f ns %9.0f ns\n", "read",
+            benchRead(env, strings, false, iterations),
+            benchRead(env, strings, true, iterations));
+    printf("%-28s %9.0f ns %9.0f ns\n", "read unique (per string)",
+            benchReadUnique(env, false, iterations),
+            benchReadUnique(env, true, iterations));
+    String8 threaded = String8::format("read, %d threads", BENCH_THREADS);
+    printf("%-28s %9.0f ns %9.0f ns\n", threaded.string(),
+            benchReadThreaded(false, iterations),
+            benchReadThreaded(true, iterations));
+
+    destroyStrings(env, strings);
+    return 0;
+}
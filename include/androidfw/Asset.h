@@ -109,6 +109,12 @@ public:
      */
     virtual bool isAllocated(void) const { return false; }
 
+    /*
+     * Return whether this asset's uncompressed data is mmapped, in which
+     * case getBuffer() returns the mapping without reading anything.
+     */
+    virtual bool isMapped(void) const { return false; }
+
     /*
      * Get a string identifying the asset's source.  This might be a full
      * path, it might be a colon-separated list of identifiers.
@@ -243,6 +249,7 @@ public:
     virtual off64_t getRemainingLength(void) const { return mLength-mOffset; }
     virtual int openFileDescriptor(off64_t* outStart, off64_t* outLength) const;
     virtual bool isAllocated(void) const { return mBuf != NULL; }
+    virtual bool isMapped(void) const { return mMap != NULL; }
 
 private:
     off64_t     mStart;         // absolute file offset of start of chunk
@@ -300,6 +307,8 @@ public:
     virtual off64_t getRemainingLength(void) const { return mUncompressedLen-mOffset; }
     virtual int openFileDescriptor(off64_t* outStart, off64_t* outLength) const { return -1; }
     virtual bool isAllocated(void) const { return mBuf != NULL; }
+    // mMap holds the compressed data, getBuffer() would inflate it
+    virtual bool isMapped(void) const { return false; }
 
 private:
     off64_t     mStart;         // offset to start of compressed data
@@ -12,7 +12,9 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		DisplayListLogBuffer.cpp \
 		DisplayListRenderer.cpp \
 		FboCache.cpp \
+		FrameStats.cpp \
 		GradientCache.cpp \
+		InternCache.cpp \
 		LayerCache.cpp \
 		LayerRenderer.cpp \
 		Matrix.cpp \
@@ -22,12 +24,14 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		PathCache.cpp \
 		Program.cpp \
 		ProgramCache.cpp \
+		RenderThread.cpp \
 		ResourceCache.cpp \
 		ShapeCache.cpp \
 		SkiaColorFilter.cpp \
 		SkiaShader.cpp \
 		Snapshot.cpp \
 		TextureCache.cpp \
+		TextureUploader.cpp \
 		TextDropShadowCache.cpp
 	
 	LOCAL_C_INCLUDES += \
@@ -40,9 +44,12 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		external/skia/include/utils
 
 	LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER -DGL_GLEXT_PROTOTYPES
+	ifeq ($(ARCH_ARM_HAVE_NEON),true)
+		LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+	endif
 	LOCAL_CFLAGS += -fvisibility=hidden
 	LOCAL_MODULE_CLASS := SHARED_LIBRARIES
-	LOCAL_SHARED_LIBRARIES := libcutils libutils libGLESv2 libskia libui
+	LOCAL_SHARED_LIBRARIES := libcutils libutils libEGL libGLESv2 libskia libui
 	LOCAL_MODULE := libhwui
 	LOCAL_MODULE_TAGS := optional
 	
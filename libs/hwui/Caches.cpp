@@ -16,9 +16,14 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <utils/Log.h>
 #include <utils/String8.h>
 
+#include <cutils/properties.h>
+
 #include "Caches.h"
 #include "DisplayListRenderer.h"
 #include "Properties.h"
@@ -43,6 +48,44 @@ namespace uirenderer {
     #define FLUSH_LOGD(...)
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// Memory budget
+///////////////////////////////////////////////////////////////////////////////
+
+struct BudgetedCacheInfo {
+    const char* name;
+    // When several caches were last used during the same frame, caches
+    // with a higher weight are allowed to use more of the budget before
+    // being picked for eviction
+    float weight;
+};
+
+// Must be kept in sync with Caches::BudgetedCache
+static const BudgetedCacheInfo gBudgetedCaches[] = {
+        { "TextureCache",        4.0f },
+        { "LayerCache",          2.0f },
+        { "GradientCache",       1.0f },
+        { "PathCache",           1.0f },
+        { "RoundRectShapeCache", 1.0f },
+        { "CircleShapeCache",    1.0f },
+        { "OvalShapeCache",      1.0f },
+        { "RectShapeCache",      1.0f },
+        { "ArcShapeCache",       1.0f },
+        { "TextDropShadowCache", 1.0f },
+        { "PatchCache",          1.0f }
+};
+
+/**
+ * Evicts the oldest entries of the specified cache until its size is
+ * at most targetSize, without changing its maximum size.
+ */
+template<typename T>
+static void trimToSize(T& cache, uint32_t targetSize) {
+    const uint32_t maxSize = cache.getMaxSize();
+    cache.setMaxSize(targetSize);
+    cache.setMaxSize(maxSize);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
@@ -51,6 +94,7 @@ Caches::Caches(): Singleton<Caches>(), mInitialized(false) {
     init();
     initExtensions();
     initConstraints();
+    initMemoryBudget();
 
     mDebugLevel = readDebugLevel();
     ALOGD("Enabling debug mode %d", mDebugLevel);
@@ -63,6 +107,11 @@ Caches::Caches(): Singleton<Caches>(), mInitialized(false) {
 void Caches::init() {
     if (mInitialized) return;
 
+    glGenBuffers(1, &streamBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+    glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+    mStreamOffset = 0;
+
     glGenBuffers(1, &meshBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(gMeshVertices), gMeshVertices, GL_STATIC_DRAW);
@@ -76,6 +125,8 @@ void Caches::init() {
 
     mScissorX = mScissorY = mScissorWidth = mScissorHeight = 0;
 
+    mStencilTestEnabled = false;
+
     glActiveTexture(gTextureUnits[0]);
     mTextureUnit = 0;
 
@@ -86,6 +137,9 @@ void Caches::init() {
     lastDstMode = GL_ZERO;
     currentProgram = NULL;
 
+    frameStats.init(extensions);
+    textureCache.initUploader();
+
     mInitialized = true;
 }
 
@@ -119,18 +173,47 @@ void Caches::initConstraints() {
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
 }
 
+void Caches::initMemoryBudget() {
+    memset(mUsageHistogram, 0, sizeof(mUsageHistogram));
+    memset(mAccessCounts, 0, sizeof(mAccessCounts));
+    memset(mLastUsedFrames, 0, sizeof(mLastUsedFrames));
+    mFrameCount = 0;
+
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_MEMORY_BUDGET, property, NULL) > 0) {
+        INIT_LOGD("  Setting memory budget to %sMB", property);
+        mMemoryBudget = MB(atof(property));
+    } else {
+        uint32_t maxSize = 0;
+        for (int i = 0; i < kBudgetedCache_Count; i++) {
+            maxSize += getCacheMaxSize(BudgetedCache(i));
+        }
+        // The caches rarely peak together, a budget smaller than their
+        // combined maximum sizes forces them to share
+        mMemoryBudget = uint32_t(maxSize * DEFAULT_MEMORY_BUDGET_RATIO);
+        INIT_LOGD("  Using default memory budget of %.2fMB", mMemoryBudget / 1024.0f / 1024.0f);
+    }
+}
+
 void Caches::terminate() {
     if (!mInitialized) return;
 
     glDeleteBuffers(1, &meshBuffer);
+    glDeleteBuffers(1, &streamBuffer);
     mCurrentBuffer = 0;
 
+    frameStats.terminate();
+    textureCache.terminateUploader();
+
     glDeleteBuffers(1, &mRegionMeshIndices);
     delete[] mRegionMesh;
     mRegionMesh = NULL;
 
+    // Cached layers may own FBOs, release them to the FBO cache first
+    layerCache.clear();
     fboCache.clear();
 
+    patchCache.clear();
     programCache.clear();
     currentProgram = NULL;
 
@@ -178,6 +261,7 @@ void Caches::dumpMemoryUsage(String8 &log) {
             fboCache.getSize(), fboCache.getMaxSize());
     log.appendFormat("  PatchCache           %8d / %8d\n",
             patchCache.getSize(), patchCache.getMaxSize());
+    internCache.dump(log);
 
     uint32_t total = 0;
     total += textureCache.getSize();
@@ -190,12 +274,23 @@ void Caches::dumpMemoryUsage(String8 &log) {
     total += ovalShapeCache.getSize();
     total += rectShapeCache.getSize();
     total += arcShapeCache.getSize();
-    for (uint32_t i = 0; i < fontRenderer.getFontRendererCount(); i++) {
-        total += fontRenderer.getFontRendererSize(i);
-    }
+    total += patchCache.getMemorySize();
+    total += getFontRendererSize();
 
     log.appendFormat("Total memory usage:\n");
     log.appendFormat("  %d bytes, %.2f MB\n", total, total / 1024.0f / 1024.0f);
+    log.appendFormat("  Budget: %d bytes, %.2f MB\n", mMemoryBudget,
+            mMemoryBudget / 1024.0f / 1024.0f);
+
+    log.appendFormat("Usage histograms (frames per 10%% of max size):\n");
+    for (int i = 0; i < kBudgetedCache_Count; i++) {
+        if (getCacheMaxSize(BudgetedCache(i)) == 0) continue;
+        log.appendFormat("  %-20s", gBudgetedCaches[i].name);
+        for (int j = 0; j < USAGE_HISTOGRAM_BUCKETS; j++) {
+            log.appendFormat(" %6d", mUsageHistogram[i][j]);
+        }
+        log.appendFormat("\n");
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -205,6 +300,7 @@ void Caches::dumpMemoryUsage(String8 &log) {
 void Caches::clearGarbage() {
     textureCache.clearGarbage();
     pathCache.clearGarbage();
+    internCache.clearGarbage();
 
     Mutex::Autolock _l(mGarbageLock);
 
@@ -262,6 +358,171 @@ void Caches::flush(FlushMode mode) {
     }
 }
 
+void Caches::trimMemory(TrimLevel level) {
+    FLUSH_LOGD("Trimming caches (level %d)", level);
+
+    switch (level) {
+        case kTrimLevel_Complete:
+            flush(kFlushMode_Full);
+            break;
+        case kTrimLevel_Moderate:
+            clearGarbage();
+            fontRenderer.flush();
+            trimCaches(0.5f);
+            break;
+        case kTrimLevel_Light:
+            clearGarbage();
+            trimCaches(0.75f);
+            break;
+    }
+}
+
+void Caches::trimCaches(float ratio) {
+    for (int i = 0; i < kBudgetedCache_Count; i++) {
+        BudgetedCache cache = BudgetedCache(i);
+        trimCache(cache, uint32_t(getCacheSize(cache) * ratio));
+    }
+}
+
+void Caches::enforceMemoryBudget() {
+    mFrameCount++;
+
+    uint32_t total = 0;
+    for (int i = 0; i < kBudgetedCache_Count; i++) {
+        const BudgetedCache cache = BudgetedCache(i);
+        const uint32_t size = getCacheSize(cache);
+        const uint32_t maxSize = getCacheMaxSize(cache);
+
+        if (maxSize > 0) {
+            uint32_t bucket = uint64_t(size) * USAGE_HISTOGRAM_BUCKETS / maxSize;
+            if (bucket >= USAGE_HISTOGRAM_BUCKETS) bucket = USAGE_HISTOGRAM_BUCKETS - 1;
+            mUsageHistogram[i][bucket]++;
+        }
+
+        // The cache was used since the last frame
+        const uint32_t accessCount = getCacheAccessCount(cache);
+        if (accessCount != mAccessCounts[i]) {
+            mAccessCounts[i] = accessCount;
+            mLastUsedFrames[i] = mFrameCount;
+        }
+
+        total += size;
+    }
+
+    if (total <= mMemoryBudget) return;
+
+    bool trimmed[kBudgetedCache_Count];
+    memset(trimmed, 0, sizeof(trimmed));
+
+    while (total > mMemoryBudget) {
+        // Pick the least recently used cache, or the cache using the most
+        // memory relative to its weight among those used at the same time
+        int victim = -1;
+        float victimScore = 0.0f;
+        for (int i = 0; i < kBudgetedCache_Count; i++) {
+            const uint32_t size = getCacheSize(BudgetedCache(i));
+            if (trimmed[i] || size == 0) continue;
+
+            const float score = size / gBudgetedCaches[i].weight;
+            if (victim < 0 || mLastUsedFrames[i] < mLastUsedFrames[victim] ||
+                    (mLastUsedFrames[i] == mLastUsedFrames[victim] && score > victimScore)) {
+                victim = i;
+                victimScore = score;
+            }
+        }
+        if (victim < 0) break;
+
+        const BudgetedCache cache = BudgetedCache(victim);
+        const uint32_t size = getCacheSize(cache);
+        const uint32_t excess = total - mMemoryBudget;
+
+        FLUSH_LOGD("Memory budget exceeded by %d bytes, trimming %s",
+                excess, gBudgetedCaches[victim].name);
+
+        trimCache(cache, size > excess ? size - excess : 0);
+        trimmed[victim] = true;
+
+        const uint32_t newSize = getCacheSize(cache);
+        if (newSize < size) total -= size - newSize;
+    }
+}
+
+uint32_t Caches::getFontRendererSize() {
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < fontRenderer.getFontRendererCount(); i++) {
+        size += fontRenderer.getFontRendererSize(i);
+    }
+    return size;
+}
+
+uint32_t Caches::getCacheSize(BudgetedCache cache) {
+    switch (cache) {
+        case kBudgetedCache_Texture: return textureCache.getSize();
+        case kBudgetedCache_Layer: return layerCache.getSize();
+        case kBudgetedCache_Gradient: return gradientCache.getSize();
+        case kBudgetedCache_Path: return pathCache.getSize();
+        case kBudgetedCache_RoundRect: return roundRectShapeCache.getSize();
+        case kBudgetedCache_Circle: return circleShapeCache.getSize();
+        case kBudgetedCache_Oval: return ovalShapeCache.getSize();
+        case kBudgetedCache_Rect: return rectShapeCache.getSize();
+        case kBudgetedCache_Arc: return arcShapeCache.getSize();
+        case kBudgetedCache_DropShadow: return dropShadowCache.getSize();
+        case kBudgetedCache_Patch: return patchCache.getMemorySize();
+        default: return 0;
+    }
+}
+
+uint32_t Caches::getCacheMaxSize(BudgetedCache cache) {
+    switch (cache) {
+        case kBudgetedCache_Texture: return textureCache.getMaxSize();
+        case kBudgetedCache_Layer: return layerCache.getMaxSize();
+        case kBudgetedCache_Gradient: return gradientCache.getMaxSize();
+        case kBudgetedCache_Path: return pathCache.getMaxSize();
+        case kBudgetedCache_RoundRect: return roundRectShapeCache.getMaxSize();
+        case kBudgetedCache_Circle: return circleShapeCache.getMaxSize();
+        case kBudgetedCache_Oval: return ovalShapeCache.getMaxSize();
+        case kBudgetedCache_Rect: return rectShapeCache.getMaxSize();
+        case kBudgetedCache_Arc: return arcShapeCache.getMaxSize();
+        case kBudgetedCache_DropShadow: return dropShadowCache.getMaxSize();
+        case kBudgetedCache_Patch: return patchCache.getMaxMemorySize();
+        default: return 0;
+    }
+}
+
+uint32_t Caches::getCacheAccessCount(BudgetedCache cache) {
+    switch (cache) {
+        case kBudgetedCache_Texture: return textureCache.getAccessCount();
+        case kBudgetedCache_Layer: return layerCache.getAccessCount();
+        case kBudgetedCache_Gradient: return gradientCache.getAccessCount();
+        case kBudgetedCache_Path: return pathCache.getAccessCount();
+        case kBudgetedCache_RoundRect: return roundRectShapeCache.getAccessCount();
+        case kBudgetedCache_Circle: return circleShapeCache.getAccessCount();
+        case kBudgetedCache_Oval: return ovalShapeCache.getAccessCount();
+        case kBudgetedCache_Rect: return rectShapeCache.getAccessCount();
+        case kBudgetedCache_Arc: return arcShapeCache.getAccessCount();
+        case kBudgetedCache_DropShadow: return dropShadowCache.getAccessCount();
+        case kBudgetedCache_Patch: return patchCache.getAccessCount();
+        default: return 0;
+    }
+}
+
+void Caches::trimCache(BudgetedCache cache, uint32_t targetSize) {
+    switch (cache) {
+        case kBudgetedCache_Texture: trimToSize(textureCache, targetSize); break;
+        case kBudgetedCache_Layer: layerCache.trimToSize(targetSize); break;
+        case kBudgetedCache_Gradient: trimToSize(gradientCache, targetSize); break;
+        case kBudgetedCache_Path: trimToSize(pathCache, targetSize); break;
+        case kBudgetedCache_RoundRect: trimToSize(roundRectShapeCache, targetSize); break;
+        case kBudgetedCache_Circle: trimToSize(circleShapeCache, targetSize); break;
+        case kBudgetedCache_Oval: trimToSize(ovalShapeCache, targetSize); break;
+        case kBudgetedCache_Rect: trimToSize(rectShapeCache, targetSize); break;
+        case kBudgetedCache_Arc: trimToSize(arcShapeCache, targetSize); break;
+        case kBudgetedCache_DropShadow: trimToSize(dropShadowCache, targetSize); break;
+        case kBudgetedCache_Patch: patchCache.trimToMemorySize(targetSize); break;
+        default: break;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // VBO
 ///////////////////////////////////////////////////////////////////////////////
@@ -306,6 +567,25 @@ bool Caches::unbindIndicesBuffer() {
     return false;
 }
 
+GLvoid* Caches::streamVertices(const GLvoid* data, GLsizeiptr size) {
+    bindMeshBuffer(streamBuffer);
+
+    if (mStreamOffset + size > STREAM_BUFFER_SIZE) {
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+        mStreamOffset = 0;
+    }
+
+    const GLsizeiptr offset = mStreamOffset;
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    // Keep every write 4 bytes aligned
+    mStreamOffset += (size + 3) & ~3;
+
+    // The same offset may now refer to different data
+    resetVertexPointers();
+
+    return (GLvoid*) offset;
+}
+
 void Caches::bindPositionVertexPointer(bool force, GLuint slot, GLvoid* vertices, GLsizei stride) {
     if (force || vertices != mCurrentPositionPointer) {
         glVertexAttribPointer(slot, 2, GL_FLOAT, GL_FALSE, stride, vertices);
@@ -366,6 +646,20 @@ void Caches::resetScissor() {
     mScissorX = mScissorY = mScissorWidth = mScissorHeight = 0;
 }
 
+void Caches::enableStencilTest() {
+    if (!mStencilTestEnabled) {
+        glEnable(GL_STENCIL_TEST);
+        mStencilTestEnabled = true;
+    }
+}
+
+void Caches::disableStencilTest() {
+    if (mStencilTestEnabled) {
+        glDisable(GL_STENCIL_TEST);
+        mStencilTestEnabled = false;
+    }
+}
+
 TextureVertex* Caches::getRegionMesh() {
     // Create the mesh, 2 triangles and 4 vertices per rectangle in the region
     if (!mRegionMesh) {
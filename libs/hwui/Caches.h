@@ -37,6 +37,8 @@
 #include "PathCache.h"
 #include "TextDropShadowCache.h"
 #include "FboCache.h"
+#include "FrameStats.h"
+#include "InternCache.h"
 #include "ResourceCache.h"
 
 namespace android {
@@ -50,6 +52,12 @@ namespace uirenderer {
 
 #define REGION_MESH_QUAD_COUNT 512
 
+// Number of buckets in the per-cache usage histograms
+#define USAGE_HISTOGRAM_BUCKETS 10
+
+// Size in bytes of the VBO used to stream dynamic geometry
+#define STREAM_BUFFER_SIZE (256 * 1024)
+
 // Generates simple and textured vertices
 #define FV(x, y, u, v) { { x, y }, { u, v } }
 
@@ -106,6 +114,15 @@ public:
         kFlushMode_Full
     };
 
+    enum TrimLevel {
+        // Trims each cache to 75% of its current usage
+        kTrimLevel_Light = 0,
+        // Trims each cache to 50% of its current usage
+        kTrimLevel_Moderate,
+        // Releases everything
+        kTrimLevel_Complete
+    };
+
     /**
      * Initialize caches.
      */
@@ -118,6 +135,28 @@ public:
      */
     void flush(FlushMode mode);
 
+    /**
+     * Trims the caches in response to memory pressure, typically when the
+     * application receives onTrimMemory(). Unused layers are always released.
+     *
+     * @param level Indicates how much of the caches should be trimmed
+     */
+    void trimMemory(TrimLevel level);
+
+    /**
+     * Evicts the oldest entries of the caches until their combined usage
+     * fits in the memory budget. The least recently used caches are trimmed
+     * first. Invoked once per frame, before rendering to the window.
+     */
+    void enforceMemoryBudget();
+
+    /**
+     * Returns the maximum combined size in bytes of the budgeted caches.
+     */
+    uint32_t getMemoryBudget() const {
+        return mMemoryBudget;
+    }
+
     /**
      * Destroys all resources associated with this cache. This should
      * be called after a flush(kFlushMode_Full).
@@ -166,6 +205,23 @@ public:
     bool bindIndicesBuffer(const GLuint buffer);
     bool unbindIndicesBuffer();
 
+    /**
+     * Indicates whether the specified amount of vertex data can be
+     * written into the streaming VBO.
+     */
+    bool canStreamVertices(GLsizeiptr size) const {
+        return size > 0 && size <= STREAM_BUFFER_SIZE;
+    }
+
+    /**
+     * Copies the specified vertex data into the streaming VBO and binds
+     * that VBO. The returned value is the offset of the data in the VBO
+     * and must be used in place of the client-side pointer. When the VBO
+     * is full its storage is orphaned so the driver never has to wait on
+     * draws still using the previous contents.
+     */
+    GLvoid* streamVertices(const GLvoid* data, GLsizeiptr size);
+
     /**
      * Binds an attrib to the specified float vertex pointer.
      * Assumes a stride of gMeshStride and a size of 2.
@@ -204,6 +260,19 @@ public:
      */
     void resetScissor();
 
+    /**
+     * Enables or disables the stencil test used to enforce complex clips.
+     */
+    void enableStencilTest();
+    void disableStencilTest();
+
+    /**
+     * Indicates whether the stencil test is currently enabled.
+     */
+    bool isStencilTestEnabled() const {
+        return mStencilTestEnabled;
+    }
+
     /**
      * Returns the mesh used to draw regions. Calling this method will
      * bind a VBO of type GL_ELEMENT_ARRAY_BUFFER that contains the
@@ -224,6 +293,8 @@ public:
 
     // VBO to draw with
     GLuint meshBuffer;
+    // VBO used to stream dynamic geometry
+    GLuint streamBuffer;
 
     // GL extensions
     Extensions extensions;
@@ -244,8 +315,10 @@ public:
     PatchCache patchCache;
     TextDropShadowCache dropShadowCache;
     FboCache fboCache;
+    FrameStats frameStats;
     GammaFontRenderer fontRenderer;
     ResourceCache resourceCache;
+    InternCache internCache;
 
     // Debug methods
     PFNGLINSERTEVENTMARKEREXTPROC eventMark;
@@ -256,8 +329,34 @@ public:
     PFNGLGETOBJECTLABELEXTPROC getLabel;
 
 private:
+    /**
+     * Caches accounted for by the memory budget.
+     */
+    enum BudgetedCache {
+        kBudgetedCache_Texture = 0,
+        kBudgetedCache_Layer,
+        kBudgetedCache_Gradient,
+        kBudgetedCache_Path,
+        kBudgetedCache_RoundRect,
+        kBudgetedCache_Circle,
+        kBudgetedCache_Oval,
+        kBudgetedCache_Rect,
+        kBudgetedCache_Arc,
+        kBudgetedCache_DropShadow,
+        kBudgetedCache_Patch,
+        kBudgetedCache_Count
+    };
+
     void initExtensions();
     void initConstraints();
+    void initMemoryBudget();
+
+    uint32_t getCacheSize(BudgetedCache cache);
+    uint32_t getCacheMaxSize(BudgetedCache cache);
+    uint32_t getCacheAccessCount(BudgetedCache cache);
+    uint32_t getFontRendererSize();
+    void trimCache(BudgetedCache cache, uint32_t targetSize);
+    void trimCaches(float ratio);
 
     static void eventMarkNull(GLsizei length, const GLchar* marker) { }
     static void startMarkNull(GLsizei length, const GLchar* marker) { }
@@ -285,6 +384,10 @@ private:
     GLint mScissorWidth;
     GLint mScissorHeight;
 
+    bool mStencilTestEnabled;
+
+    GLsizeiptr mStreamOffset;
+
     // Used to render layers
     TextureVertex* mRegionMesh;
     GLuint mRegionMeshIndices;
@@ -293,6 +396,14 @@ private:
     Vector<Layer*> mLayerGarbage;
     Vector<DisplayList*> mDisplayListGarbage;
 
+    uint32_t mMemoryBudget;
+    uint32_t mUsageHistogram[kBudgetedCache_Count][USAGE_HISTOGRAM_BUCKETS];
+    // Frame during which each cache was last used, used to trim the least
+    // recently used caches first
+    uint32_t mFrameCount;
+    uint32_t mAccessCounts[kBudgetedCache_Count];
+    uint32_t mLastUsedFrames[kBudgetedCache_Count];
+
     DebugLevel mDebugLevel;
     bool mInitialized;
 }; // class Caches
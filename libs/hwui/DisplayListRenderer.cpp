@@ -89,6 +89,10 @@ void DisplayList::outputLogBuffer(int fd) {
     String8 cachesLog;
     Caches::getInstance().dumpMemoryUsage(cachesLog);
     fprintf(file, "\nCaches:\n%s", cachesLog.string());
+
+    String8 statsLog;
+    Caches::getInstance().frameStats.dump(statsLog);
+    fprintf(file, "\n%s", statsLog.string());
     fprintf(file, "\n");
 
     fflush(file);
@@ -181,26 +185,21 @@ void DisplayList::clearResources() {
     mShaders.clear();
 
     for (size_t i = 0; i < mPaints.size(); i++) {
-        delete mPaints.itemAt(i);
+        caches.internCache.release(mPaints.itemAt(i));
     }
     mPaints.clear();
 
     for (size_t i = 0; i < mPaths.size(); i++) {
-        SkPath* path = mPaths.itemAt(i);
-        caches.pathCache.remove(path);
-        delete path;
+        caches.internCache.release(mPaths.itemAt(i));
     }
     mPaths.clear();
 
-    for (size_t i = 0; i < mSourcePaths.size(); i++) {
-        caches.resourceCache.decrementRefcount(mSourcePaths.itemAt(i));
-    }
-    mSourcePaths.clear();
-
     for (size_t i = 0; i < mMatrices.size(); i++) {
-        delete mMatrices.itemAt(i);
+        caches.internCache.release(mMatrices.itemAt(i));
     }
     mMatrices.clear();
+
+    mPatchSlots.clear();
 }
 
 void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing) {
@@ -229,6 +228,7 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
         SkBitmap* resource = bitmapResources.itemAt(i);
         mBitmapResources.add(resource);
         caches.resourceCache.incrementRefcount(resource);
+        caches.textureCache.prefetch(resource);
     }
 
     const Vector<SkBitmap*> &ownedBitmapResources = recorder.getOwnedBitmapResources();
@@ -236,6 +236,7 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
         SkBitmap* resource = ownedBitmapResources.itemAt(i);
         mOwnedBitmapResources.add(resource);
         caches.resourceCache.incrementRefcount(resource);
+        caches.textureCache.prefetch(resource);
     }
 
     const Vector<SkiaColorFilter*>& filterResources = recorder.getFilterResources();
@@ -262,16 +263,46 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
         mPaths.add(paths.itemAt(i));
     }
 
-    const SortedVector<SkPath*>& sourcePaths = recorder.getSourcePaths();
-    for (size_t i = 0; i < sourcePaths.size(); i++) {
-        mSourcePaths.add(sourcePaths.itemAt(i));
-        caches.resourceCache.incrementRefcount(sourcePaths.itemAt(i));
-    }
-
     const Vector<SkMatrix*>& matrices = recorder.getMatrices();
     for (size_t i = 0; i < matrices.size(); i++) {
         mMatrices.add(matrices.itemAt(i));
     }
+
+    mPatchSlots.appendVector(recorder.getPatchSlots());
+}
+
+template<typename T>
+static inline void swapValues(T& a, T& b) {
+    T tmp(a);
+    a = b;
+    b = tmp;
+}
+
+void DisplayList::swapContent(DisplayList* displayList) {
+    // Vectors share their storage, these copies are cheap
+    swapValues(mBitmapResources, displayList->mBitmapResources);
+    swapValues(mOwnedBitmapResources, displayList->mOwnedBitmapResources);
+    swapValues(mFilterResources, displayList->mFilterResources);
+    swapValues(mPaints, displayList->mPaints);
+    swapValues(mPaths, displayList->mPaths);
+    swapValues(mMatrices, displayList->mMatrices);
+    swapValues(mShaders, displayList->mShaders);
+    swapValues(mPatchSlots, displayList->mPatchSlots);
+
+    const void* buffer = mReader.base();
+    mReader.setMemory(displayList->mReader.base(), displayList->mSize);
+    displayList->mReader.setMemory(buffer, mSize);
+    swapValues(mSize, displayList->mSize);
+    swapValues(mIsRenderable, displayList->mIsRenderable);
+
+    // The transforms are released with the previous content, as they
+    // would be by initFromDisplayListRenderer()
+    swapValues(mTransformMatrix, displayList->mTransformMatrix);
+    swapValues(mTransformCamera, displayList->mTransformCamera);
+    swapValues(mTransformMatrix3D, displayList->mTransformMatrix3D);
+    swapValues(mStaticMatrix, displayList->mStaticMatrix);
+    swapValues(mAnimationMatrix, displayList->mAnimationMatrix);
+    initProperties();
 }
 
 void DisplayList::init() {
@@ -283,6 +314,146 @@ size_t DisplayList::getSize() {
     return mSize;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Patching
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t* DisplayList::getPatchLocation(size_t slot, PatchSlotType type) {
+    if (slot >= mPatchSlots.size()) {
+        ALOGW("Invalid patch slot %d in display list %p", slot, this);
+        return NULL;
+    }
+
+    const PatchSlot& patchSlot = mPatchSlots.itemAt(slot);
+    if (patchSlot.type != type) {
+        ALOGW("Patch slot %d of display list %p has type %d, expected %d",
+                slot, this, patchSlot.type, type);
+        return NULL;
+    }
+
+    // The op buffer is owned by this display list
+    return (int32_t*) ((uint8_t*) mReader.base() + patchSlot.offset);
+}
+
+bool DisplayList::patchDisplayList(size_t slot, DisplayList* displayList) {
+    int32_t* location = getPatchLocation(slot, kPatchSlot_DisplayList);
+    if (!location) return false;
+
+    *location = (int32_t) displayList;
+    return true;
+}
+
+bool DisplayList::patchColor(size_t slot, int color) {
+    if (slot < mPatchSlots.size() && mPatchSlots.itemAt(slot).type == kPatchSlot_Color) {
+        int32_t* location = getPatchLocation(slot, kPatchSlot_Color);
+        *location = color;
+        return true;
+    }
+
+    int32_t* location = getPatchLocation(slot, kPatchSlot_Paint);
+    if (!location) return false;
+
+    SkPaint* paint = (SkPaint*) *location;
+    if (paint->getColor() == SkColor(color)) return true;
+
+    SkPaint copy(*paint);
+    copy.setColor(color);
+
+    *location = (int32_t) Caches::getInstance().internCache.get(&copy);
+    replacePaint(paint, (SkPaint*) *location);
+    return true;
+}
+
+/**
+ * Returns true if one of the ops of this display list uses the specified
+ * paint. Every recorded paint has a patch slot.
+ */
+bool DisplayList::isPaintReferenced(const SkPaint* paint) const {
+    const uint8_t* base = (const uint8_t*) mReader.base();
+    for (size_t i = 0; i < mPatchSlots.size(); i++) {
+        const PatchSlot& patchSlot = mPatchSlots.itemAt(i);
+        if (patchSlot.type == kPatchSlot_Paint &&
+                *(const SkPaint**) (base + patchSlot.offset) == paint) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Takes ownership of a reference to the specified paint, which has just been
+ * patched in, and releases the previous paint if no op uses it anymore. A
+ * paint already owned by this display list is not added again, so patching
+ * the same slot repeatedly grows neither mPaints nor the intern cache.
+ */
+void DisplayList::replacePaint(SkPaint* previous, SkPaint* paint) {
+    Caches& caches = Caches::getInstance();
+
+    bool owned = false;
+    for (size_t i = 0; i < mPaints.size(); i++) {
+        if (mPaints.itemAt(i) == paint) {
+            owned = true;
+            break;
+        }
+    }
+    if (owned) {
+        caches.internCache.release(paint);
+    } else {
+        mPaints.add(paint);
+    }
+
+    if (previous == paint || isPaintReferenced(previous)) return;
+
+    // The recorder may hold several references to the same interned paint
+    for (size_t i = 0; i < mPaints.size(); ) {
+        if (mPaints.itemAt(i) == previous) {
+            caches.internCache.release(previous);
+            mPaints.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool DisplayList::canPatchBitmap(size_t slot, SkBitmap* bitmap) const {
+    if (slot >= mPatchSlots.size()) return false;
+
+    const PatchSlot& patchSlot = mPatchSlots.itemAt(slot);
+    if (patchSlot.type != kPatchSlot_Bitmap) return false;
+
+    const SkBitmap* previous = *(SkBitmap**) ((uint8_t*) mReader.base() + patchSlot.offset);
+    return previous->width() == bitmap->width() && previous->height() == bitmap->height();
+}
+
+bool DisplayList::patchBitmap(size_t slot, SkBitmap* bitmap) {
+    int32_t* location = getPatchLocation(slot, kPatchSlot_Bitmap);
+    if (!location) return false;
+
+    SkBitmap* previous = (SkBitmap*) *location;
+    if (previous == bitmap) return true;
+
+    if (previous->width() != bitmap->width() || previous->height() != bitmap->height()) {
+        return false;
+    }
+
+    Caches& caches = Caches::getInstance();
+    caches.resourceCache.incrementRefcount(bitmap);
+    mBitmapResources.add(bitmap);
+    caches.textureCache.prefetch(bitmap);
+
+    // Each recorded bitmap op holds its own reference
+    for (size_t i = 0; i < mBitmapResources.size(); i++) {
+        if (mBitmapResources.itemAt(i) == previous) {
+            mBitmapResources.removeAt(i);
+            caches.resourceCache.decrementRefcount(previous);
+            break;
+        }
+    }
+
+    *location = (int32_t) bitmap;
+    return true;
+}
+
 /**
  * This function is a simplified version of replay(), where we simply retrieve and log the
  * display list. This function should remain in sync with the replay() function.
@@ -998,7 +1169,7 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 float y = getFloat();
                 SkPaint* paint = getPaint(renderer);
                 if (mCaching) {
-                    paint->setAlpha(mMultipliedAlpha);
+                    paint = renderer.alphaPaint(paint, mMultipliedAlpha);
                 }
                 DISPLAY_LIST_LOGD("%s%s %p, %.2f, %.2f, %p", (char*) indent, OP_NAMES[op],
                         layer, x, y, paint);
@@ -1011,7 +1182,7 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 float y = getFloat();
                 SkPaint* paint = getPaint(renderer);
                 if (mCaching) {
-                    paint->setAlpha(mMultipliedAlpha);
+                    paint = renderer.alphaPaint(paint, mMultipliedAlpha);
                 }
                 DISPLAY_LIST_LOGD("%s%s %p, %.2f, %.2f, %p", (char*) indent, OP_NAMES[op],
                         bitmap, x, y, paint);
@@ -1294,7 +1465,8 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
 ///////////////////////////////////////////////////////////////////////////////
 
 DisplayListRenderer::DisplayListRenderer() : mWriter(MIN_WRITER_SIZE),
-        mTranslateX(0.0f), mTranslateY(0.0f), mHasTranslate(false), mHasDrawOps(false) {
+        mTranslateX(0.0f), mTranslateY(0.0f), mHasTranslate(false), mHasDrawOps(false),
+        mRecordStart(0) {
 }
 
 DisplayListRenderer::~DisplayListRenderer() {
@@ -1327,11 +1499,6 @@ void DisplayListRenderer::reset() {
     mShaders.clear();
     mShaderMap.clear();
 
-    for (size_t i = 0; i < mSourcePaths.size(); i++) {
-        caches.resourceCache.decrementRefcount(mSourcePaths.itemAt(i));
-    }
-    mSourcePaths.clear();
-
     mPaints.clear();
     mPaintMap.clear();
 
@@ -1340,6 +1507,8 @@ void DisplayListRenderer::reset() {
 
     mMatrices.clear();
 
+    mPatchSlots.clear();
+
     mHasDrawOps = false;
 }
 
@@ -1375,12 +1544,15 @@ int DisplayListRenderer::prepareDirty(float left, float top,
     mSaveCount = 1;
     mSnapshot->setClip(0.0f, 0.0f, mWidth, mHeight);
     mRestoreSaveCount = -1;
+    mRecordStart = systemTime(SYSTEM_TIME_MONOTONIC);
     return DrawGlInfo::kStatusDone; // No invalidate needed at record-time
 }
 
 void DisplayListRenderer::finish() {
     insertRestoreToCount();
     insertTranlate();
+    Caches::getInstance().frameStats.addRecordTime(
+            systemTime(SYSTEM_TIME_MONOTONIC) - mRecordStart);
 }
 
 void DisplayListRenderer::interrupt() {
@@ -1584,6 +1756,7 @@ status_t DisplayListRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs,
 
 status_t DisplayListRenderer::drawColor(int color, SkXfermode::Mode mode) {
     addOp(DisplayList::DrawColor);
+    addPatchSlot(DisplayList::kPatchSlot_Color);
     addInt(color);
     addInt(mode);
     return DrawGlInfo::kStatusDone;
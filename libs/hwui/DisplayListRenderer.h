@@ -122,6 +122,23 @@ public:
         kReplayFlag_ClipChildren = 0x1
     };
 
+    /**
+     * Types of the op parameters that can be patched without re-recording
+     * the display list.
+     */
+    enum PatchSlotType {
+        kPatchSlot_DisplayList = 0,
+        kPatchSlot_Color,
+        kPatchSlot_Paint,
+        kPatchSlot_Bitmap
+    };
+
+    struct PatchSlot {
+        PatchSlotType type;
+        // Offset of the parameter in the op buffer
+        uint32_t offset;
+    };
+
     static const char* OP_NAMES[];
 
     void setViewProperties(OpenGLRenderer& renderer, uint32_t level);
@@ -133,6 +150,55 @@ public:
 
     void initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing = false);
 
+    /**
+     * Exchanges the ops and resources of this display list with those of
+     * the specified display list, then resets the view properties of this
+     * display list. Used by the render thread to apply a display list
+     * recorded on the UI thread without copying it.
+     */
+    void swapContent(DisplayList* displayList);
+
+    /**
+     * Patch slots identify the op parameters that can be modified in place:
+     * child display lists, colors of drawColor() ops, colors of paints and
+     * bitmaps. The slots are numbered in recording order, the slots of an
+     * op can be found with DisplayListRenderer::getPatchSlotCount().
+     *
+     * Patching never changes the size of the op buffer. In render thread
+     * mode, patches must be posted to the render thread instead (see
+     * RenderThread::patchDisplayList()).
+     */
+    ANDROID_API size_t getPatchSlotCount() const {
+        return mPatchSlots.size();
+    }
+
+    ANDROID_API PatchSlotType getPatchSlotType(size_t slot) const {
+        return mPatchSlots.itemAt(slot).type;
+    }
+
+    /**
+     * Replaces a child display list. Re-recording a child into the same
+     * DisplayList object does not require patching its parents.
+     */
+    ANDROID_API bool patchDisplayList(size_t slot, DisplayList* displayList);
+
+    /**
+     * Replaces the color of a drawColor() op or of a paint.
+     */
+    ANDROID_API bool patchColor(size_t slot, int color);
+
+    /**
+     * Replaces a bitmap. The ops were quick rejected against the bounds of
+     * the recorded bitmap: the new bitmap must have the same dimensions,
+     * otherwise false is returned and the display list must be re-recorded.
+     */
+    ANDROID_API bool patchBitmap(size_t slot, SkBitmap* bitmap);
+
+    /**
+     * Returns true if patchBitmap() would accept the specified bitmap.
+     */
+    bool canPatchBitmap(size_t slot, SkBitmap* bitmap) const;
+
     status_t replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flags, uint32_t level = 0);
 
     void output(OpenGLRenderer& renderer, uint32_t level = 0);
@@ -403,6 +469,10 @@ private:
 
     void clearResources();
 
+    int32_t* getPatchLocation(size_t slot, PatchSlotType type);
+    bool isPaintReferenced(const SkPaint* paint) const;
+    void replacePaint(SkPaint* previous, SkPaint* paint);
+
     void updateMatrix();
 
     class TextContainer {
@@ -493,10 +563,11 @@ private:
 
     Vector<SkPaint*> mPaints;
     Vector<SkPath*> mPaths;
-    SortedVector<SkPath*> mSourcePaths;
     Vector<SkMatrix*> mMatrices;
     Vector<SkiaShader*> mShaders;
 
+    Vector<PatchSlot> mPatchSlots;
+
     mutable SkFlattenableReadBuffer mReader;
 
     size_t mSize;
@@ -648,14 +719,23 @@ public:
         return mPaths;
     }
 
-    const SortedVector<SkPath*>& getSourcePaths() const {
-        return mSourcePaths;
-    }
-
     const Vector<SkMatrix*>& getMatrices() const {
         return mMatrices;
     }
 
+    /**
+     * Returns the number of patch slots recorded so far. The slots of an op
+     * are numbered from the count before the op was recorded to the count
+     * after. See DisplayList::getPatchSlotCount().
+     */
+    ANDROID_API size_t getPatchSlotCount() const {
+        return mPatchSlots.size();
+    }
+
+    const Vector<DisplayList::PatchSlot>& getPatchSlots() const {
+        return mPatchSlots;
+    }
+
 private:
     void insertRestoreToCount() {
         if (mRestoreSaveCount >= 0) {
@@ -736,6 +816,13 @@ private:
         mWriter.writeScalar(y);
     }
 
+    inline void addPatchSlot(DisplayList::PatchSlotType type) {
+        DisplayList::PatchSlot slot;
+        slot.type = type;
+        slot.offset = mWriter.size();
+        mPatchSlots.add(slot);
+    }
+
     inline void addBounds(float left, float top, float right, float bottom) {
         mWriter.writeScalar(left);
         mWriter.writeScalar(top);
@@ -754,20 +841,16 @@ private:
             return;
         }
 
-        SkPath* pathCopy = mPathMap.valueFor(path);
-        if (pathCopy == NULL || pathCopy->getGenerationID() != path->getGenerationID()) {
-            pathCopy = new SkPath(*path);
-            pathCopy->setSourcePath(path);
+        InternedCopy<SkPath> entry = mPathMap.valueFor(path);
+        if (entry.copy == NULL || entry.generation != path->getGenerationID()) {
+            entry.copy = Caches::getInstance().internCache.get(path);
+            entry.generation = path->getGenerationID();
             // replaceValueFor() performs an add if the entry doesn't exist
-            mPathMap.replaceValueFor(path, pathCopy);
-            mPaths.add(pathCopy);
-        }
-        if (mSourcePaths.indexOf(path) < 0) {
-            Caches::getInstance().resourceCache.incrementRefcount(path);
-            mSourcePaths.add(path);
+            mPathMap.replaceValueFor(path, entry);
+            mPaths.add(entry.copy);
         }
 
-        addInt((int) pathCopy);
+        addInt((int) entry.copy);
     }
 
     inline void addPaint(SkPaint* paint) {
@@ -776,28 +859,31 @@ private:
             return;
         }
 
-        SkPaint* paintCopy = mPaintMap.valueFor(paint);
-        if (paintCopy == NULL || paintCopy->getGenerationID() != paint->getGenerationID()) {
-            paintCopy = new SkPaint(*paint);
+        InternedCopy<SkPaint> entry = mPaintMap.valueFor(paint);
+        if (entry.copy == NULL || entry.generation != paint->getGenerationID()) {
+            entry.copy = Caches::getInstance().internCache.get(paint);
+            entry.generation = paint->getGenerationID();
             // replaceValueFor() performs an add if the entry doesn't exist
-            mPaintMap.replaceValueFor(paint, paintCopy);
-            mPaints.add(paintCopy);
+            mPaintMap.replaceValueFor(paint, entry);
+            mPaints.add(entry.copy);
         }
 
-        addInt((int) paintCopy);
+        addPatchSlot(DisplayList::kPatchSlot_Paint);
+        addInt((int) entry.copy);
     }
 
     inline void addDisplayList(DisplayList* displayList) {
         // TODO: To be safe, the display list should be ref-counted in the
         //       resources cache, but we rely on the caller (UI toolkit) to
         //       do the right thing for now
+        addPatchSlot(DisplayList::kPatchSlot_DisplayList);
         addInt((int) displayList);
     }
 
     inline void addMatrix(SkMatrix* matrix) {
-        // Copying the matrix is cheap and prevents against the user changing the original
+        // Copying the matrix prevents against the user changing the original
         // matrix before the operation that uses it
-        SkMatrix* copy = new SkMatrix(*matrix);
+        SkMatrix* copy = Caches::getInstance().internCache.get(matrix);
         addInt((int) copy);
         mMatrices.add(copy);
     }
@@ -807,6 +893,7 @@ private:
         // correctly, such as creating the bitmap from scratch, drawing with it, changing its
         // contents, and drawing again. The only fix would be to always copy it the first time,
         // which doesn't seem worth the extra cycles for this unlikely case.
+        addPatchSlot(DisplayList::kPatchSlot_Bitmap);
         addInt((int) bitmap);
         mBitmapResources.add(bitmap);
         Caches::getInstance().resourceCache.incrementRefcount(bitmap);
@@ -847,19 +934,33 @@ private:
     Vector<SkBitmap*> mOwnedBitmapResources;
     Vector<SkiaColorFilter*> mFilterResources;
 
+    /**
+     * Interned copy of a recorded object, and generation of the original
+     * object when the copy was made.
+     */
+    template<typename T>
+    struct InternedCopy {
+        InternedCopy(): copy(NULL), generation(0) { }
+
+        T* copy;
+        uint32_t generation;
+    }; // struct InternedCopy
+
+    // Paints, paths and matrices are interned in Caches::internCache, the
+    // references are handed over to the display list
     Vector<SkPaint*> mPaints;
-    DefaultKeyedVector<SkPaint*, SkPaint*> mPaintMap;
+    DefaultKeyedVector<SkPaint*, InternedCopy<SkPaint> > mPaintMap;
 
     Vector<SkPath*> mPaths;
-    DefaultKeyedVector<SkPath*, SkPath*> mPathMap;
-
-    SortedVector<SkPath*> mSourcePaths;
+    DefaultKeyedVector<SkPath*, InternedCopy<SkPath> > mPathMap;
 
     Vector<SkiaShader*> mShaders;
     DefaultKeyedVector<SkiaShader*, SkiaShader*> mShaderMap;
 
     Vector<SkMatrix*> mMatrices;
 
+    Vector<DisplayList::PatchSlot> mPatchSlots;
+
     SkWriter32 mWriter;
     uint32_t mBufferSize;
 
@@ -871,6 +972,9 @@ private:
 
     bool mHasDrawOps;
 
+    // Used to report the time spent recording to the frame stats
+    nsecs_t mRecordStart;
+
     friend class DisplayList;
 
 }; // class DisplayListRenderer
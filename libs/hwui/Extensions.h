@@ -20,6 +20,8 @@
 #include <utils/SortedVector.h>
 #include <utils/String8.h>
 
+#include <EGL/egl.h>
+
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
@@ -69,6 +71,12 @@ public:
         mHasDebugMarker = hasExtension("GL_EXT_debug_marker");
         mHasDebugLabel = hasExtension("GL_EXT_debug_label");
 
+        // EGL extensions are queried on the display, not the context
+        EGLDisplay display = eglGetCurrentDisplay();
+        const char* eglExtensions = display != EGL_NO_DISPLAY ?
+                eglQueryString(display, EGL_EXTENSIONS) : NULL;
+        mHasBufferAge = eglExtensions && strstr(eglExtensions, "EGL_EXT_buffer_age");
+
         const char* vendor = (const char*) glGetString(GL_VENDOR);
         EXT_LOGD("Vendor: %s", vendor);
         mNeedsHighpTexCoords = strcmp(vendor, VENDOR_IMG) == 0;
@@ -85,6 +93,7 @@ public:
     inline bool hasDiscardFramebuffer() const { return mHasDiscardFramebuffer; }
     inline bool hasDebugMarker() const { return mHasDebugMarker; }
     inline bool hasDebugLabel() const { return mHasDebugLabel; }
+    inline bool hasBufferAge() const { return mHasBufferAge; }
 
     bool hasExtension(const char* extension) const {
         const String8 s(extension);
@@ -106,6 +115,7 @@ private:
     bool mHasDiscardFramebuffer;
     bool mHasDebugMarker;
     bool mHasDebugLabel;
+    bool mHasBufferAge;
 }; // class Extensions
 
 }; // namespace uirenderer
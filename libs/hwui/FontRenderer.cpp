@@ -822,6 +822,7 @@ void FontRenderer::checkTextureUpdate() {
             }
             glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, width, height,
                     GL_ALPHA, GL_UNSIGNED_BYTE, textureData);
+            caches.frameStats.countTextureUpload();
 
             cl->mDirty = false;
         }
@@ -856,6 +857,7 @@ void FontRenderer::issueDrawCommand() {
     }
 
     glDrawElements(GL_TRIANGLES, mCurrentQuadIndex * 6, GL_UNSIGNED_SHORT, NULL);
+    caches.frameStats.countDrawCall();
 
     mDrawn = true;
 }
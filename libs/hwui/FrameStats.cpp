@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <string.h>
+
+#include <EGL/egl.h>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
+#include "Debug.h"
+#include "FrameStats.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors
+///////////////////////////////////////////////////////////////////////////////
+
+FrameStats::FrameStats(): mGenQueries(NULL), mDeleteQueries(NULL), mBeginQuery(NULL),
+        mEndQuery(NULL), mGetQueryObjectuiv(NULL), mGetQueryObjectui64v(NULL),
+        mGpuTimingEnabled(false), mNextQuery(0), mQueryActive(false),
+        mInFrame(false), mFrameStart(0), mFrameCount(0), mRecordTime(0) {
+    memset(mQueries, 0, sizeof(mQueries));
+    memset(mFrames, 0, sizeof(mFrames));
+    resetCurrent();
+}
+
+void FrameStats::init(const Extensions& extensions) {
+    mGpuTimingEnabled = false;
+
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_GPU_FRAME_TIMING, property, "false") <= 0 ||
+            strcmp(property, "true")) {
+        return;
+    }
+
+    if (!extensions.hasExtension("GL_EXT_disjoint_timer_query")) {
+        ALOGW("GPU frame timing requested but GL_EXT_disjoint_timer_query is not supported");
+        return;
+    }
+
+    mGenQueries = (GenQueries) eglGetProcAddress("glGenQueriesEXT");
+    mDeleteQueries = (DeleteQueries) eglGetProcAddress("glDeleteQueriesEXT");
+    mBeginQuery = (BeginQuery) eglGetProcAddress("glBeginQueryEXT");
+    mEndQuery = (EndQuery) eglGetProcAddress("glEndQueryEXT");
+    mGetQueryObjectuiv = (GetQueryObjectuiv) eglGetProcAddress("glGetQueryObjectuivEXT");
+    mGetQueryObjectui64v = (GetQueryObjectui64v) eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+    if (!mGenQueries || !mDeleteQueries || !mBeginQuery || !mEndQuery ||
+            !mGetQueryObjectuiv || !mGetQueryObjectui64v) {
+        ALOGW("Could not resolve GL_EXT_disjoint_timer_query entry points");
+        return;
+    }
+
+    for (int i = 0; i < FRAME_STATS_QUERY_COUNT; i++) {
+        mGenQueries(1, &mQueries[i].id);
+        mQueries[i].pending = false;
+    }
+    mNextQuery = 0;
+    mQueryActive = false;
+    mGpuTimingEnabled = true;
+
+    INIT_LOGD("  GPU frame timing enabled");
+}
+
+void FrameStats::terminate() {
+    if (!mGpuTimingEnabled) return;
+
+    if (mQueryActive) {
+        mEndQuery(GL_TIME_ELAPSED_EXT);
+        mQueryActive = false;
+    }
+
+    for (int i = 0; i < FRAME_STATS_QUERY_COUNT; i++) {
+        mDeleteQueries(1, &mQueries[i].id);
+        mQueries[i].id = 0;
+        mQueries[i].pending = false;
+    }
+
+    mGpuTimingEnabled = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameStats::resetCurrent() {
+    memset(&mCurrent, 0, sizeof(FrameInfo));
+    mCurrent.gpuTime = -1;
+}
+
+void FrameStats::startFrame() {
+    if (mInFrame) return;
+    mInFrame = true;
+    mFrameStart = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    if (mGpuTimingEnabled) {
+        TimerQuery& query = mQueries[mNextQuery];
+        if (query.pending) {
+            pollTimerQueries();
+        }
+        // If the GPU is more than FRAME_STATS_QUERY_COUNT frames behind,
+        // skip the measurement of this frame rather than stalling
+        if (!query.pending) {
+            mBeginQuery(GL_TIME_ELAPSED_EXT, query.id);
+            mQueryActive = true;
+        }
+    }
+}
+
+void FrameStats::endFrame() {
+    if (!mInFrame) return;
+
+    mCurrent.replayTime = systemTime(SYSTEM_TIME_MONOTONIC) - mFrameStart;
+
+    {
+        Mutex::Autolock _l(mLock);
+        // Display lists recorded after the end of a frame are accounted
+        // for in the next frame
+        mCurrent.recordTime = mRecordTime;
+        mRecordTime = 0;
+        mCurrent.frame = mFrameCount;
+        mFrames[mFrameCount % FRAME_STATS_COUNT] = mCurrent;
+        mFrameCount++;
+    }
+
+    if (mQueryActive) {
+        mEndQuery(GL_TIME_ELAPSED_EXT);
+        mQueryActive = false;
+
+        TimerQuery& query = mQueries[mNextQuery];
+        query.frame = mCurrent.frame;
+        query.pending = true;
+        mNextQuery = (mNextQuery + 1) % FRAME_STATS_QUERY_COUNT;
+    }
+
+    if (mGpuTimingEnabled) {
+        pollTimerQueries();
+    }
+
+    mInFrame = false;
+    resetCurrent();
+}
+
+void FrameStats::pollTimerQueries() {
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (int i = 0; i < FRAME_STATS_QUERY_COUNT; i++) {
+        TimerQuery& query = mQueries[i];
+        if (!query.pending) continue;
+
+        GLuint available = 0;
+        mGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) continue;
+
+        uint64_t elapsed = 0;
+        mGetQueryObjectui64v(query.id, GL_QUERY_RESULT_EXT, &elapsed);
+        query.pending = false;
+
+        // The results of all pending queries are undefined after a disjoint event
+        if (disjoint) continue;
+
+        Mutex::Autolock _l(mLock);
+        FrameInfo& info = mFrames[query.frame % FRAME_STATS_COUNT];
+        if (info.frame == query.frame) {
+            info.gpuTime = nsecs_t(elapsed);
+        }
+    }
+}
+
+bool FrameStats::getLastFrame(FrameInfo& info) {
+    Mutex::Autolock _l(mLock);
+    if (mFrameCount == 0) return false;
+
+    info = mFrames[(mFrameCount - 1) % FRAME_STATS_COUNT];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Dump
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameStats::dump(String8& log) {
+    Mutex::Autolock _l(mLock);
+
+    const uint32_t count = mFrameCount < FRAME_STATS_COUNT ? mFrameCount : FRAME_STATS_COUNT;
+
+    log.appendFormat("Frame stats (last %d frames, times in ms):\n", count);
+    log.appendFormat("  %8s %8s %8s %8s %6s %8s %7s %6s %6s %6s\n", "Frame", "Record",
+            "Replay", "GPU", "Draws", "Programs", "Uploads", "Async", "Hits", "Misses");
+
+    if (count == 0) return;
+
+    double recordTime = 0.0, replayTime = 0.0, gpuTime = 0.0;
+    uint32_t gpuFrames = 0;
+    uint64_t drawCalls = 0, programSwitches = 0, textureUploads = 0;
+    uint64_t cacheHits = 0, cacheMisses = 0;
+    uint64_t asyncTextureUploads = 0;
+
+    for (uint32_t i = mFrameCount - count; i < mFrameCount; i++) {
+        const FrameInfo& info = mFrames[i % FRAME_STATS_COUNT];
+
+        const double record = info.recordTime / 1000000.0;
+        const double replay = info.replayTime / 1000000.0;
+        const double gpu = info.gpuTime / 1000000.0;
+
+        if (info.gpuTime >= 0) {
+            log.appendFormat("  %8d %8.2f %8.2f %8.2f", info.frame, record, replay, gpu);
+            gpuTime += gpu;
+            gpuFrames++;
+        } else {
+            log.appendFormat("  %8d %8.2f %8.2f %8s", info.frame, record, replay, "-");
+        }
+        log.appendFormat(" %6d %8d %7d %6d %6d %6d\n", info.drawCalls, info.programSwitches,
+                info.textureUploads, info.asyncTextureUploads, info.cacheHits,
+                info.cacheMisses);
+
+        recordTime += record;
+        replayTime += replay;
+        drawCalls += info.drawCalls;
+        programSwitches += info.programSwitches;
+        textureUploads += info.textureUploads;
+        asyncTextureUploads += info.asyncTextureUploads;
+        cacheHits += info.cacheHits;
+        cacheMisses += info.cacheMisses;
+    }
+
+    log.appendFormat("  %8s %8.2f %8.2f", "Average", recordTime / count, replayTime / count);
+    if (gpuFrames > 0) {
+        log.appendFormat(" %8.2f", gpuTime / gpuFrames);
+    } else {
+        log.appendFormat(" %8s", "-");
+    }
+    log.appendFormat(" %6.1f %8.1f %7.1f %6.1f %6.1f %6.1f\n", drawCalls / double(count),
+            programSwitches / double(count), textureUploads / double(count),
+            asyncTextureUploads / double(count), cacheHits / double(count),
+            cacheMisses / double(count));
+}
+
+}; // namespace uirenderer
+}; // namespace android
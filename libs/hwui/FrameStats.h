@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_FRAME_STATS_H
+#define ANDROID_HWUI_FRAME_STATS_H
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <cutils/compiler.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+#include "Extensions.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames kept in the history
+#define FRAME_STATS_COUNT 120
+// Number of GPU timer queries that can be in flight at once
+#define FRAME_STATS_QUERY_COUNT 4
+
+// GL_EXT_disjoint_timer_query
+#ifndef GL_TIME_ELAPSED_EXT
+    #define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+    #define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+    #define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Statistics recorded for a single frame. Times are in nanoseconds.
+ */
+struct FrameInfo {
+    uint32_t frame;
+    nsecs_t recordTime;
+    nsecs_t replayTime;
+    // Set to -1 when GPU timing is unavailable for this frame
+    nsecs_t gpuTime;
+    uint32_t drawCalls;
+    uint32_t programSwitches;
+    uint32_t textureUploads;
+    // Textures uploaded ahead of time by the background upload thread
+    uint32_t asyncTextureUploads;
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
+}; // struct FrameInfo
+
+/**
+ * Collects lightweight statistics about the last FRAME_STATS_COUNT frames:
+ * time spent recording and replaying display lists, GPU time (when the
+ * GL_EXT_disjoint_timer_query extension is available and enabled with
+ * hwui.gpu_frame_timing), draw calls, program switches, texture
+ * uploads and cache hits and misses. The history is written to bug reports with
+ * the display list log buffer.
+ */
+class FrameStats {
+public:
+    FrameStats();
+
+    /**
+     * Creates the GPU timer queries, if supported. Must be called with
+     * a current GL context.
+     */
+    void init(const Extensions& extensions);
+    /**
+     * Destroys the GPU timer queries.
+     */
+    void terminate();
+
+    /**
+     * Marks the beginning and the end of a frame rendered to the window.
+     */
+    void startFrame();
+    void endFrame();
+
+    /**
+     * Accounts for the time spent recording a display list. Display lists
+     * may be recorded on a different thread than the one rendering frames.
+     */
+    inline void addRecordTime(nsecs_t time) {
+        Mutex::Autolock _l(mLock);
+        mRecordTime += time;
+    }
+
+    inline void countDrawCall() {
+        mCurrent.drawCalls++;
+    }
+
+    inline void countProgramSwitch() {
+        mCurrent.programSwitches++;
+    }
+
+    inline void countTextureUpload() {
+        mCurrent.textureUploads++;
+    }
+
+    inline void countAsyncTextureUpload() {
+        mCurrent.asyncTextureUploads++;
+    }
+
+    inline void countCacheHit() {
+        mCurrent.cacheHits++;
+    }
+
+    inline void countCacheMiss() {
+        mCurrent.cacheMisses++;
+    }
+
+    /**
+     * Copies the statistics of the last completed frame. Returns false if
+     * no frame was completed yet. The GPU time of the frame may not be
+     * available yet.
+     */
+    ANDROID_API bool getLastFrame(FrameInfo& info);
+
+    /**
+     * Appends the recorded history and its averages to the specified log.
+     */
+    void dump(String8& log);
+
+private:
+    struct TimerQuery {
+        GLuint id;
+        uint32_t frame;
+        bool pending;
+    };
+
+    void resetCurrent();
+    void pollTimerQueries();
+
+    typedef void (GL_APIENTRYP GenQueries)(GLsizei n, GLuint* ids);
+    typedef void (GL_APIENTRYP DeleteQueries)(GLsizei n, const GLuint* ids);
+    typedef void (GL_APIENTRYP BeginQuery)(GLenum target, GLuint id);
+    typedef void (GL_APIENTRYP EndQuery)(GLenum target);
+    typedef void (GL_APIENTRYP GetQueryObjectuiv)(GLuint id, GLenum pname, GLuint* params);
+    typedef void (GL_APIENTRYP GetQueryObjectui64v)(GLuint id, GLenum pname, uint64_t* params);
+
+    GenQueries mGenQueries;
+    DeleteQueries mDeleteQueries;
+    BeginQuery mBeginQuery;
+    EndQuery mEndQuery;
+    GetQueryObjectuiv mGetQueryObjectuiv;
+    GetQueryObjectui64v mGetQueryObjectui64v;
+
+    bool mGpuTimingEnabled;
+    TimerQuery mQueries[FRAME_STATS_QUERY_COUNT];
+    int mNextQuery;
+    bool mQueryActive;
+
+    bool mInFrame;
+    nsecs_t mFrameStart;
+    uint32_t mFrameCount;
+    FrameInfo mCurrent;
+    FrameInfo mFrames[FRAME_STATS_COUNT];
+    nsecs_t mRecordTime;
+
+    // Protects mFrames, mFrameCount and mRecordTime, dump() is invoked from
+    // a binder thread and display lists may be recorded on another thread
+    Mutex mLock;
+}; // class FrameStats
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_FRAME_STATS_H
@@ -23,6 +23,7 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "Debug.h"
 #include "GradientCache.h"
 #include "Properties.h"
@@ -36,7 +37,7 @@ namespace uirenderer {
 
 GradientCache::GradientCache():
         mCache(GenerationCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(DEFAULT_GRADIENT_CACHE_SIZE)) {
+        mSize(0), mMaxSize(MB(DEFAULT_GRADIENT_CACHE_SIZE)), mAccessCount(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_GRADIENT_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting gradient cache size to %sMB", property);
@@ -50,7 +51,7 @@ GradientCache::GradientCache():
 
 GradientCache::GradientCache(uint32_t maxByteSize):
         mCache(GenerationCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(maxByteSize) {
+        mSize(0), mMaxSize(maxByteSize), mAccessCount(0) {
     mCache.setOnEntryRemovedListener(this);
 }
 
@@ -102,9 +103,13 @@ Texture* GradientCache::get(uint32_t* colors, float* positions,
 
     GradientCacheEntry gradient(colors, positions, count, tileMode);
     Texture* texture = mCache.get(gradient);
+    mAccessCount++;
 
     if (!texture) {
+        Caches::getInstance().frameStats.countCacheMiss();
         texture = addLinearGradient(gradient, colors, positions, count, tileMode);
+    } else {
+        Caches::getInstance().frameStats.countCacheHit();
     }
 
     return texture;
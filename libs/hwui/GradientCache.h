@@ -135,6 +135,13 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
 
 private:
     /**
@@ -151,6 +158,7 @@ private:
 
     uint32_t mSize;
     uint32_t mMaxSize;
+    uint32_t mAccessCount;
 
     Vector<SkShader*> mGarbage;
     mutable Mutex mLock;
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <string.h>
+
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "InternCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Hashing
+///////////////////////////////////////////////////////////////////////////////
+
+static inline uint32_t hashMix(uint32_t hash, uint32_t data) {
+    hash += data;
+    hash += (hash << 10);
+    hash ^= (hash >> 6);
+    return hash;
+}
+
+static inline uint32_t hashMix(uint32_t hash, float data) {
+    uint32_t bits;
+    memcpy(&bits, &data, sizeof(bits));
+    return hashMix(hash, bits);
+}
+
+static inline uint32_t hashMix(uint32_t hash, const void* data) {
+    return hashMix(hash, uint32_t(uintptr_t(data)));
+}
+
+static inline uint32_t hashFinish(uint32_t hash) {
+    hash += (hash << 3);
+    hash ^= (hash >> 11);
+    hash += (hash << 15);
+    return hash;
+}
+
+/**
+ * The hash is computed from the same state the equality operators compare.
+ * Effects are refcounted by the paint and compared by pointer.
+ */
+uint32_t InternCache::hash(const SkPaint& paint) {
+    uint32_t hash = 0;
+    hash = hashMix(hash, uint32_t(paint.getColor()));
+    hash = hashMix(hash, paint.getFlags());
+    hash = hashMix(hash, uint32_t(paint.getStyle()));
+    hash = hashMix(hash, uint32_t(paint.getStrokeCap()));
+    hash = hashMix(hash, uint32_t(paint.getStrokeJoin()));
+    hash = hashMix(hash, uint32_t(paint.getTextAlign()));
+    hash = hashMix(hash, uint32_t(paint.getTextEncoding()));
+    hash = hashMix(hash, uint32_t(paint.getHinting()));
+    hash = hashMix(hash, paint.getStrokeWidth());
+    hash = hashMix(hash, paint.getStrokeMiter());
+    hash = hashMix(hash, paint.getTextSize());
+    hash = hashMix(hash, paint.getTextScaleX());
+    hash = hashMix(hash, paint.getTextSkewX());
+    hash = hashMix(hash, paint.getTypeface());
+    hash = hashMix(hash, paint.getShader());
+    hash = hashMix(hash, paint.getColorFilter());
+    hash = hashMix(hash, paint.getXfermode());
+    hash = hashMix(hash, paint.getPathEffect());
+    hash = hashMix(hash, paint.getMaskFilter());
+    hash = hashMix(hash, paint.getLooper());
+    hash = hashMix(hash, paint.getRasterizer());
+    return hashFinish(hash);
+}
+
+uint32_t InternCache::hash(const SkPath& path) {
+    uint32_t hash = 0;
+    hash = hashMix(hash, uint32_t(path.getFillType()));
+
+    const int count = path.countPoints();
+    hash = hashMix(hash, uint32_t(count));
+    for (int i = 0; i < count; i++) {
+        const SkPoint point = path.getPoint(i);
+        hash = hashMix(hash, point.fX);
+        hash = hashMix(hash, point.fY);
+    }
+    return hashFinish(hash);
+}
+
+uint32_t InternCache::hash(const SkMatrix& matrix) {
+    uint32_t hash = 0;
+    for (int i = 0; i < 9; i++) {
+        hash = hashMix(hash, matrix.get(i));
+    }
+    return hashFinish(hash);
+}
+
+static inline bool equals(const SkPaint& lhs, const SkPaint& rhs) {
+    return lhs == rhs;
+}
+
+static inline bool equals(const SkPath& lhs, const SkPath& rhs) {
+    return lhs == rhs;
+}
+
+static inline bool equals(const SkMatrix& lhs, const SkMatrix& rhs) {
+    // Compare the bits to stay consistent with hash()
+    for (int i = 0; i < 9; i++) {
+        const float l = lhs.get(i);
+        const float r = rhs.get(i);
+        if (memcmp(&l, &r, sizeof(float))) return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Store
+///////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+T* InternCache::Store<T>::acquire(const T& object, uint32_t hash) {
+    mRefCount++;
+
+    Entry<T>* head = NULL;
+    ssize_t index = mEntries.indexOfKey(hash);
+    if (index >= 0) {
+        head = mEntries.valueAt(index);
+        for (Entry<T>* entry = head; entry; entry = entry->next) {
+            if (equals(*entry->object, object)) {
+                entry->refCount++;
+                return entry->object;
+            }
+        }
+    }
+
+    Entry<T>* entry = new Entry<T>;
+    entry->object = new T(object);
+    entry->hash = hash;
+    entry->refCount = 1;
+    entry->next = head;
+    mObjects.add(entry->object, entry);
+
+    if (index >= 0) {
+        mEntries.replaceValueAt(index, entry);
+    } else {
+        mEntries.add(hash, entry);
+    }
+    mCount++;
+
+    return entry->object;
+}
+
+template<typename T>
+bool InternCache::Store<T>::release(T* object) {
+    ssize_t objectIndex = mObjects.indexOfKey(object);
+    if (objectIndex < 0) {
+        ALOGW("Releasing an object that was not interned: %p", object);
+        return false;
+    }
+
+    Entry<T>* entry = mObjects.valueAt(objectIndex);
+    mRefCount--;
+    if (--entry->refCount > 0) return false;
+
+    mObjects.removeItemsAt(objectIndex);
+
+    ssize_t index = mEntries.indexOfKey(entry->hash);
+    Entry<T>* previous = NULL;
+    for (Entry<T>* e = mEntries.valueAt(index); e != entry; e = e->next) {
+        previous = e;
+    }
+    if (previous) {
+        previous->next = entry->next;
+    } else if (entry->next) {
+        mEntries.replaceValueAt(index, entry->next);
+    } else {
+        mEntries.removeItemsAt(index);
+    }
+    mCount--;
+
+    delete entry;
+    return true;
+}
+
+template<typename T>
+void InternCache::Store<T>::clear() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry<T>* entry = mEntries.valueAt(i);
+        while (entry) {
+            Entry<T>* next = entry->next;
+            delete entry->object;
+            delete entry;
+            entry = next;
+        }
+    }
+    mEntries.clear();
+    mObjects.clear();
+    mCount = 0;
+    mRefCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+InternCache::InternCache() {
+}
+
+InternCache::~InternCache() {
+    mPaints.clear();
+    mPaths.clear();
+    mMatrices.clear();
+
+    for (size_t i = 0; i < mGarbage.size(); i++) {
+        delete mGarbage.itemAt(i);
+    }
+    mGarbage.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Interning
+///////////////////////////////////////////////////////////////////////////////
+
+SkPaint* InternCache::get(const SkPaint* paint) {
+    const uint32_t h = hash(*paint);
+    Mutex::Autolock _l(mLock);
+    return mPaints.acquire(*paint, h);
+}
+
+SkPath* InternCache::get(const SkPath* path) {
+    const uint32_t h = hash(*path);
+    Mutex::Autolock _l(mLock);
+    return mPaths.acquire(*path, h);
+}
+
+SkMatrix* InternCache::get(const SkMatrix* matrix) {
+    const uint32_t h = hash(*matrix);
+    Mutex::Autolock _l(mLock);
+    return mMatrices.acquire(*matrix, h);
+}
+
+void InternCache::release(SkPaint* paint) {
+    bool destroy;
+    {
+        Mutex::Autolock _l(mLock);
+        destroy = mPaints.release(paint);
+    }
+    if (destroy) delete paint;
+}
+
+void InternCache::release(SkPath* path) {
+    Mutex::Autolock _l(mLock);
+    if (mPaths.release(path)) {
+        mGarbage.push(path);
+    }
+}
+
+void InternCache::release(SkMatrix* matrix) {
+    bool destroy;
+    {
+        Mutex::Autolock _l(mLock);
+        destroy = mMatrices.release(matrix);
+    }
+    if (destroy) delete matrix;
+}
+
+void InternCache::clearGarbage() {
+    Vector<SkPath*> garbage;
+    {
+        Mutex::Autolock _l(mLock);
+        garbage = mGarbage;
+        mGarbage.clear();
+    }
+
+    PathCache& pathCache = Caches::getInstance().pathCache;
+    for (size_t i = 0; i < garbage.size(); i++) {
+        SkPath* path = garbage.itemAt(i);
+        pathCache.remove(path);
+        delete path;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Dump
+///////////////////////////////////////////////////////////////////////////////
+
+void InternCache::dump(String8& log) {
+    Mutex::Autolock _l(mLock);
+    log.appendFormat("  InternCache paints   %8d / %8d\n",
+            mPaints.getCount(), mPaints.getRefCount());
+    log.appendFormat("  InternCache paths    %8d / %8d\n",
+            mPaths.getCount(), mPaths.getRefCount());
+    log.appendFormat("  InternCache matrices %8d / %8d\n",
+            mMatrices.getCount(), mMatrices.getRefCount());
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_INTERN_CACHE_H
+#define ANDROID_HWUI_INTERN_CACHE_H
+
+#include <SkMatrix.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Process-wide store of the paints, paths and matrices recorded in display
+ * lists. Objects are interned by content: recording a paint equal to a paint
+ * already held by any display list returns the existing copy instead of
+ * allocating a new one.
+ *
+ * Interned objects are refcounted and must never be modified. Every call to
+ * one of the get() methods must be balanced by a call to release().
+ *
+ * The store can be accessed from any thread. Paths are destroyed on the
+ * thread owning the EGL context, by clearGarbage(), because the path cache
+ * may hold textures generated for them.
+ */
+class InternCache {
+public:
+    InternCache();
+    ~InternCache();
+
+    /**
+     * Returns a shared, immutable copy of the specified object.
+     */
+    SkPaint* get(const SkPaint* paint);
+    SkPath* get(const SkPath* path);
+    SkMatrix* get(const SkMatrix* matrix);
+
+    /**
+     * Releases a reference acquired with get().
+     */
+    void release(SkPaint* paint);
+    void release(SkPath* path);
+    void release(SkMatrix* matrix);
+
+    /**
+     * Destroys the paths that are not referenced anymore. Must be invoked
+     * from the thread owning the EGL context.
+     */
+    void clearGarbage();
+
+    /**
+     * Appends the number of interned objects and of references to them
+     * to the specified log.
+     */
+    void dump(String8& log);
+
+private:
+    /**
+     * An interned object. Entries with the same hash are chained. The hash
+     * is computed when the object is interned so that releasing an object
+     * never depends on its current content.
+     */
+    template<typename T>
+    struct Entry {
+        T* object;
+        uint32_t hash;
+        uint32_t refCount;
+        Entry<T>* next;
+    };
+
+    /**
+     * Content hashed store of objects of a single type.
+     */
+    template<typename T>
+    class Store {
+    public:
+        Store(): mCount(0), mRefCount(0) { }
+
+        T* acquire(const T& object, uint32_t hash);
+        // Returns true if the last reference to the object was released,
+        // in which case the caller must destroy the object
+        bool release(T* object);
+
+        uint32_t getCount() const { return mCount; }
+        uint32_t getRefCount() const { return mRefCount; }
+
+        void clear();
+
+    private:
+        KeyedVector<uint32_t, Entry<T>*> mEntries;
+        // Interned objects, to find their entry on release
+        KeyedVector<T*, Entry<T>*> mObjects;
+        uint32_t mCount;
+        uint32_t mRefCount;
+    }; // class Store
+
+    static uint32_t hash(const SkPaint& paint);
+    static uint32_t hash(const SkPath& path);
+    static uint32_t hash(const SkMatrix& matrix);
+
+    Store<SkPaint> mPaints;
+    Store<SkPath> mPaths;
+    Store<SkMatrix> mMatrices;
+
+    // Paths released while their textures may still be in the path cache
+    Vector<SkPath*> mGarbage;
+
+    Mutex mLock;
+}; // class InternCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_INTERN_CACHE_H
@@ -32,7 +32,8 @@ namespace uirenderer {
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
 
-LayerCache::LayerCache(): mSize(0), mMaxSize(MB(DEFAULT_LAYER_CACHE_SIZE)) {
+LayerCache::LayerCache(): mSize(0), mMaxSize(MB(DEFAULT_LAYER_CACHE_SIZE)), mGeneration(0),
+        mAccessCount(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_LAYER_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting layer cache size to %sMB", property);
@@ -89,11 +90,61 @@ void LayerCache::clear() {
     mCache.clear();
 }
 
+ssize_t LayerCache::findBestFit(uint32_t width, uint32_t height) const {
+    const float maxArea = width * height * LAYER_REUSE_MAX_AREA_RATIO;
+
+    ssize_t bestIndex = -1;
+    uint32_t bestArea = 0;
+
+    // Entries are sorted by width, then height
+    const size_t count = mCache.size();
+    for (size_t i = mCache.orderOf(LayerEntry(width, height)); i < count; i++) {
+        const LayerEntry& entry = mCache.itemAt(i);
+        // Every remaining entry is at least this wide and needs to be
+        // at least as tall as requested
+        if (entry.mWidth * height > maxArea) break;
+        if (entry.mHeight < height) continue;
+
+        const uint32_t area = entry.mWidth * entry.mHeight;
+        if (area <= maxArea && (bestIndex < 0 || area < bestArea)) {
+            bestIndex = i;
+            bestArea = area;
+            if (area == width * height) break;
+        }
+    }
+
+    return bestIndex;
+}
+
+ssize_t LayerCache::findLeastRecentlyUsed() const {
+    ssize_t index = -1;
+    const size_t count = mCache.size();
+    for (size_t i = 0; i < count; i++) {
+        if (index < 0 || mCache.itemAt(i).mGeneration < mCache.itemAt(index).mGeneration) {
+            index = i;
+        }
+    }
+    return index;
+}
+
+void LayerCache::trimToSize(uint32_t size) {
+    while (mSize > size && mCache.size() > 0) {
+        ssize_t position = findLeastRecentlyUsed();
+        Layer* victim = mCache.itemAt(position).mLayer;
+
+        LAYER_LOGD("  Deleting layer %dx%d", victim->getWidth(), victim->getHeight());
+
+        deleteLayer(victim);
+        mCache.removeAt(position);
+    }
+}
+
 Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
     Layer* layer = NULL;
 
     LayerEntry entry(width, height);
-    ssize_t index = mCache.indexOf(entry);
+    ssize_t index = findBestFit(entry.mWidth, entry.mHeight);
+    mAccessCount++;
 
     if (index >= 0) {
         entry = mCache.itemAt(index);
@@ -102,7 +153,8 @@ Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
         layer = entry.mLayer;
         mSize -= layer->getWidth() * layer->getHeight() * 4;
 
-        LAYER_LOGD("Reusing layer %dx%d", layer->getWidth(), layer->getHeight());
+        LAYER_LOGD("Reusing layer %dx%d for %dx%d", layer->getWidth(), layer->getHeight(),
+                width, height);
     } else {
         LAYER_LOGD("Creating new layer %dx%d", entry.mWidth, entry.mHeight);
 
@@ -129,7 +181,8 @@ void LayerCache::dump() {
     size_t size = mCache.size();
     for (size_t i = 0; i < size; i++) {
         const LayerEntry& entry = mCache.itemAt(i);
-        LAYER_LOGD("  Layer size %dx%d", entry.mWidth, entry.mHeight);
+        LAYER_LOGD("  Layer size %dx%d, fbo %d", entry.mWidth, entry.mHeight,
+                entry.mLayer->getFbo());
     }
 }
 
@@ -164,25 +217,13 @@ bool LayerCache::put(Layer* layer) {
     const uint32_t size = layer->getWidth() * layer->getHeight() * 4;
     // Don't even try to cache a layer that's bigger than the cache
     if (size < mMaxSize) {
-        // TODO: Use an LRU
-        while (mSize + size > mMaxSize) {
-            size_t position = 0;
-#if LAYER_REMOVE_BIGGEST_FIRST
-            position = mCache.size() - 1;
-#endif
-            Layer* victim = mCache.itemAt(position).mLayer;
-            deleteLayer(victim);
-            mCache.removeAt(position);
-
-            LAYER_LOGD("  Deleting layer %.2fx%.2f", victim->layer.getWidth(),
-                    victim->layer.getHeight());
-        }
+        trimToSize(mMaxSize - size);
 
         layer->deferredUpdateScheduled = false;
         layer->renderer = NULL;
         layer->displayList = NULL;
 
-        LayerEntry entry(layer);
+        LayerEntry entry(layer, mGeneration++);
 
         mCache.add(entry);
         mSize += size;
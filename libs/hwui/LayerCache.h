@@ -36,6 +36,10 @@ namespace uirenderer {
     #define LAYER_LOGD(...)
 #endif
 
+// A cached layer larger than the requested dimensions is reused only if its
+// area is at most this many times the (rounded) requested area
+#define LAYER_REUSE_MAX_AREA_RATIO 1.5f
+
 ///////////////////////////////////////////////////////////////////////////////
 // Cache
 ///////////////////////////////////////////////////////////////////////////////
@@ -46,12 +50,15 @@ public:
     ~LayerCache();
 
     /**
-     * Returns a layer large enough for the specified dimensions. If no suitable
-     * layer can be found, a new one is created and returned. If creating a new
-     * layer fails, NULL is returned.
+     * Returns a layer large enough for the specified dimensions. The smallest
+     * cached layer that fits is reused, as long as it does not waste more than
+     * LAYER_REUSE_MAX_AREA_RATIO; callers only use the top-left sub-rectangle
+     * of larger layers. If no suitable layer can be found, a new one is created
+     * and returned. If creating a new layer fails, NULL is returned.
      *
      * When a layer is obtained from the cache, it is removed and the total
-     * size of the cache goes down.
+     * size of the cache goes down. A cached layer may still own the FBO it was
+     * rendered with, in which case the FBO is already attached to its texture.
      *
      * @param width The desired width of the layer
      * @param width The desired height of the layer
@@ -60,8 +67,9 @@ public:
 
     /**
      * Adds the layer to the cache. The layer will not be added if there is
-     * not enough space available. Adding a layer can cause other layers to
-     * be removed from the cache.
+     * not enough space available. Adding a layer can cause the least recently
+     * added layers to be removed from the cache. The layer keeps its FBO, if
+     * any, which is returned to the FBO cache when the layer is deleted.
      *
      * @param layer The layer to add to the cache
      *
@@ -72,6 +80,11 @@ public:
      * Clears the cache. This causes all layers to be deleted.
      */
     void clear();
+    /**
+     * Deletes the least recently added layers until the size of the cache
+     * is at most the specified number of bytes.
+     */
+    void trimToSize(uint32_t size);
     /**
      * Resize the specified layer if needed.
      *
@@ -96,6 +109,13 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
 
     /**
      * Prints out the content of the cache.
@@ -104,19 +124,23 @@ public:
 
 private:
     void deleteLayer(Layer* layer);
+    ssize_t findBestFit(uint32_t width, uint32_t height) const;
+    ssize_t findLeastRecentlyUsed() const;
 
     struct LayerEntry {
         LayerEntry():
-            mLayer(NULL), mWidth(0), mHeight(0) {
+            mLayer(NULL), mWidth(0), mHeight(0), mGeneration(0) {
         }
 
-        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight): mLayer(NULL) {
+        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight):
+                mLayer(NULL), mGeneration(0) {
             mWidth = uint32_t(ceilf(layerWidth / float(LAYER_SIZE)) * LAYER_SIZE);
             mHeight = uint32_t(ceilf(layerHeight / float(LAYER_SIZE)) * LAYER_SIZE);
         }
 
-        LayerEntry(Layer* layer):
-            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()) {
+        LayerEntry(Layer* layer, uint32_t generation):
+            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()),
+            mGeneration(generation) {
         }
 
         bool operator<(const LayerEntry& rhs) const {
@@ -133,12 +157,16 @@ private:
         Layer* mLayer;
         uint32_t mWidth;
         uint32_t mHeight;
+        // Order in which the layer was added to the cache
+        uint32_t mGeneration;
     }; // struct LayerEntry
 
     SortedList<LayerEntry> mCache;
 
     uint32_t mSize;
     uint32_t mMaxSize;
+    uint32_t mGeneration;
+    uint32_t mAccessCount;
 }; // class LayerCache
 
 }; // namespace uirenderer
@@ -183,12 +183,6 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
     LAYER_RENDERER_LOGD("Requesting new render layer %dx%d", width, height);
 
     Caches& caches = Caches::getInstance();
-    GLuint fbo = caches.fboCache.get();
-    if (!fbo) {
-        ALOGW("Could not obtain an FBO");
-        return NULL;
-    }
-
     caches.activeTexture(0);
     Layer* layer = caches.layerCache.get(width, height);
     if (!layer) {
@@ -196,7 +190,21 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
         return NULL;
     }
 
-    layer->setFbo(fbo);
+    // Layers recycled by destroyLayer() keep their FBO, already
+    // attached to their texture
+    GLuint fbo = layer->getFbo();
+    const bool attached = fbo != 0;
+    if (!fbo) {
+        fbo = caches.fboCache.get();
+        if (!fbo) {
+            ALOGW("Could not obtain an FBO");
+            layer->deleteTexture();
+            delete layer;
+            return NULL;
+        }
+        layer->setFbo(fbo);
+    }
+
     layer->layer.set(0.0f, 0.0f, width, height);
     layer->texCoords.set(0.0f, height / float(layer->getHeight()),
             width / float(layer->getWidth()), 0.0f);
@@ -230,8 +238,10 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
         }
     }
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-            layer->getTexture(), 0);
+    if (!attached) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                layer->getTexture(), 0);
+    }
 
     glDisable(GL_SCISSOR_TEST);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -305,15 +315,19 @@ void LayerRenderer::destroyLayer(Layer* layer) {
         LAYER_RENDERER_LOGD("Recycling layer, %dx%d fbo = %d",
                 layer->getWidth(), layer->getHeight(), layer->getFbo());
 
+        // The layer keeps its FBO while in the cache, so that the pair can
+        // be reused without attaching the texture again
         GLuint fbo = layer->getFbo();
         if (fbo) {
             flushLayer(layer);
-            Caches::getInstance().fboCache.put(fbo);
-            layer->setFbo(0);
         }
 
         if (!Caches::getInstance().layerCache.put(layer)) {
             LAYER_RENDERER_LOGD("  Destroyed!");
+            if (fbo) {
+                Caches::getInstance().fboCache.put(fbo);
+                layer->setFbo(0);
+            }
             layer->deleteTexture();
             delete layer;
         } else {
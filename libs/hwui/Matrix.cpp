@@ -22,6 +22,12 @@
 
 #include <utils/Log.h>
 
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE__)
+    #include <xmmintrin.h>
+#endif
+
 #include <SkMatrix.h>
 
 #include "utils/Compare.h"
@@ -61,15 +67,15 @@ bool Matrix4::changesBounds() {
              data[10] == 1.0f);
 }
 
-bool Matrix4::isPureTranslate() {
+bool Matrix4::isPureTranslate() const {
     return mSimpleMatrix && data[kScaleX] == 1.0f && data[kScaleY] == 1.0f;
 }
 
-bool Matrix4::isSimple() {
+bool Matrix4::isSimple() const {
     return mSimpleMatrix;
 }
 
-bool Matrix4::isIdentity() {
+bool Matrix4::isIdentity() const {
     return mIsIdentity;
 }
 
@@ -124,6 +130,34 @@ void Matrix4::copyTo(SkMatrix& v) const {
 }
 
 void Matrix4::loadInverse(const Matrix4& v) {
+    if (v.mIsIdentity) {
+        loadIdentity();
+        return;
+    }
+
+    if (v.mSimpleMatrix) {
+        // Scale + translate only, the inverse can be computed directly
+        const float w = 1.0f / v.data[kPerspective2];
+        const float sx = 1.0f / v.data[kScaleX];
+        const float sy = 1.0f / v.data[kScaleY];
+
+        data[kScaleX] = sx;
+        data[kSkewX] = 0.0f;
+        data[kTranslateX] = -v.data[kTranslateX] * sx * w;
+
+        data[kSkewY] = 0.0f;
+        data[kScaleY] = sy;
+        data[kTranslateY] = -v.data[kTranslateY] * sy * w;
+
+        data[kPerspective0] = 0.0f;
+        data[kPerspective1] = 0.0f;
+        data[kPerspective2] = w;
+
+        mSimpleMatrix = true;
+        mIsIdentity = false;
+        return;
+    }
+
     double scale = 1.0 /
             (v.data[kScaleX] * ((double) v.data[kScaleY]  * v.data[kPerspective2] -
                     (double) v.data[kTranslateY] * v.data[kPerspective1]) +
@@ -257,6 +291,97 @@ void Matrix4::loadRotate(float angle, float x, float y, float z) {
 }
 
 void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
+    if (u.mIsIdentity) {
+        load(v);
+        return;
+    }
+
+    if (v.mIsIdentity) {
+        load(u);
+        return;
+    }
+
+    if (u.mSimpleMatrix && v.mSimpleMatrix) {
+        loadMultiplySimple(u, v);
+        return;
+    }
+
+    loadMultiplyGeneric(u, v);
+
+    mSimpleMatrix = false;
+    mIsIdentity = false;
+}
+
+void Matrix4::loadMultiplySimple(const Matrix4& u, const Matrix4& v) {
+    // Both matrices only contain scale and translate entries, every
+    // other entry is 0 and can be skipped
+    const float w = v.data[kPerspective2];
+
+    const float sx = u.data[kScaleX] * v.data[kScaleX];
+    const float sy = u.data[kScaleY] * v.data[kScaleY];
+    const float sz = u.data[kScaleZ] * v.data[kScaleZ];
+    const float tx = u.data[kScaleX] * v.data[kTranslateX] + u.data[kTranslateX] * w;
+    const float ty = u.data[kScaleY] * v.data[kTranslateY] + u.data[kTranslateY] * w;
+    const float tz = u.data[kScaleZ] * v.data[kTranslateZ] + u.data[kTranslateZ] * w;
+    const float pw = u.data[kPerspective2] * w;
+
+    memset(data, 0, sizeof(data));
+
+    data[kScaleX] = sx;
+    data[kScaleY] = sy;
+    data[kScaleZ] = sz;
+    data[kTranslateX] = tx;
+    data[kTranslateY] = ty;
+    data[kTranslateZ] = tz;
+    data[kPerspective2] = pw;
+
+    mSimpleMatrix = true;
+    mIsIdentity = false;
+}
+
+#if defined(__ARM_HAVE_NEON)
+
+void Matrix4::loadMultiplyGeneric(const Matrix4& u, const Matrix4& v) {
+    const float32x4_t u0 = vld1q_f32(&u.data[0]);
+    const float32x4_t u1 = vld1q_f32(&u.data[4]);
+    const float32x4_t u2 = vld1q_f32(&u.data[8]);
+    const float32x4_t u3 = vld1q_f32(&u.data[12]);
+
+    for (int i = 0; i < 4; i++) {
+        const float32x4_t e = vld1q_f32(&v.data[i * 4]);
+
+        float32x4_t r = vmulq_lane_f32(u0, vget_low_f32(e), 0);
+        r = vmlaq_lane_f32(r, u1, vget_low_f32(e), 1);
+        r = vmlaq_lane_f32(r, u2, vget_high_f32(e), 0);
+        r = vmlaq_lane_f32(r, u3, vget_high_f32(e), 1);
+
+        vst1q_f32(&data[i * 4], r);
+    }
+}
+
+#elif defined(__SSE__)
+
+void Matrix4::loadMultiplyGeneric(const Matrix4& u, const Matrix4& v) {
+    const __m128 u0 = _mm_loadu_ps(&u.data[0]);
+    const __m128 u1 = _mm_loadu_ps(&u.data[4]);
+    const __m128 u2 = _mm_loadu_ps(&u.data[8]);
+    const __m128 u3 = _mm_loadu_ps(&u.data[12]);
+
+    for (int i = 0; i < 4; i++) {
+        const float* e = &v.data[i * 4];
+
+        __m128 r = _mm_mul_ps(u0, _mm_set1_ps(e[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(u1, _mm_set1_ps(e[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(u2, _mm_set1_ps(e[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(u3, _mm_set1_ps(e[3])));
+
+        _mm_storeu_ps(&data[i * 4], r);
+    }
+}
+
+#else
+
+void Matrix4::loadMultiplyGeneric(const Matrix4& u, const Matrix4& v) {
     for (int i = 0 ; i < 4 ; i++) {
         float x = 0;
         float y = 0;
@@ -276,11 +401,10 @@ void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
         set(i, 2, z);
         set(i, 3, w);
     }
-
-    mSimpleMatrix = u.mSimpleMatrix && v.mSimpleMatrix;
-    mIsIdentity = false;
 }
 
+#endif
+
 void Matrix4::loadOrtho(float left, float right, float bottom, float top, float near, float far) {
     loadIdentity();
 
@@ -297,6 +421,12 @@ void Matrix4::loadOrtho(float left, float right, float bottom, float top, float
 #define MUL_ADD_STORE(a, b, c) a = (a) * (b) + (c)
 
 void Matrix4::mapPoint(float& x, float& y) const {
+    if (isPureTranslate()) {
+        x += data[kTranslateX];
+        y += data[kTranslateY];
+        return;
+    }
+
     if (mSimpleMatrix) {
         MUL_ADD_STORE(x, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(y, data[kScaleY], data[kTranslateY]);
@@ -313,6 +443,11 @@ void Matrix4::mapPoint(float& x, float& y) const {
 }
 
 void Matrix4::mapRect(Rect& r) const {
+    if (isPureTranslate()) {
+        r.translate(data[kTranslateX], data[kTranslateY]);
+        return;
+    }
+
     if (mSimpleMatrix) {
         MUL_ADD_STORE(r.left, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(r.right, data[kScaleX], data[kTranslateX]);
@@ -112,9 +112,9 @@ public:
         multiply(u);
     }
 
-    bool isPureTranslate();
-    bool isSimple();
-    bool isIdentity();
+    bool isPureTranslate() const;
+    bool isSimple() const;
+    bool isIdentity() const;
 
     bool changesBounds();
 
@@ -133,6 +133,9 @@ private:
     bool mSimpleMatrix;
     bool mIsIdentity;
 
+    void loadMultiplySimple(const Matrix4& u, const Matrix4& v);
+    void loadMultiplyGeneric(const Matrix4& u, const Matrix4& v);
+
     inline float get(int i, int j) const {
         return data[i * 4 + j];
     }
@@ -20,6 +20,9 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
 #include <SkCanvas.h>
 #include <SkPathMeasure.h>
 #include <SkTypeface.h>
@@ -50,6 +53,11 @@ namespace uirenderer {
 
 #define FILTER(paint) (paint && paint->isFilterBitmap() ? GL_LINEAR : GL_NEAREST)
 
+// EGL_EXT_buffer_age
+#ifndef EGL_BUFFER_AGE_EXT
+    #define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // Globals
 ///////////////////////////////////////////////////////////////////////////////
@@ -113,6 +121,7 @@ OpenGLRenderer::OpenGLRenderer(): mCaches(Caches::getInstance()) {
     mColorFilter = NULL;
     mHasShadow = false;
     mHasDrawFilter = false;
+    mDamageCount = 0;
 
     memcpy(mMeshVertices, gMeshVertices, sizeof(gMeshVertices));
 
@@ -154,6 +163,9 @@ void OpenGLRenderer::setViewport(int width, int height) {
     mWidth = width;
     mHeight = height;
 
+    // The damage history is meaningless for buffers of a different size
+    mDamageCount = 0;
+
     mFirstSnapshot->height = height;
     mFirstSnapshot->viewport.set(0, 0, width, height);
 
@@ -171,6 +183,17 @@ int OpenGLRenderer::prepare(bool opaque) {
 int OpenGLRenderer::prepareDirty(float left, float top, float right, float bottom, bool opaque) {
     mCaches.clearGarbage();
 
+    Rect dirty(left, top, right, bottom);
+    if (!getTargetFbo()) {
+        mCaches.enforceMemoryBudget();
+        mCaches.frameStats.startFrame();
+        accumulateDamage(dirty);
+        left = dirty.left;
+        top = dirty.top;
+        right = dirty.right;
+        bottom = dirty.bottom;
+    }
+
     mSnapshot = new Snapshot(mFirstSnapshot,
             SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
     mSnapshot->fbo = getTargetFbo();
@@ -179,6 +202,11 @@ int OpenGLRenderer::prepareDirty(float left, float top, float right, float botto
     mSnapshot->setClip(left, top, right, bottom);
     mDirtyClip = opaque;
 
+    // The content of the stencil buffer is undefined after a swap, the
+    // first draws of the frame must not be tested against it
+    mStencilClip.setEmpty();
+    mCaches.disableStencilTest();
+
     syncState();
 
     if (!opaque) {
@@ -192,6 +220,36 @@ int OpenGLRenderer::prepareDirty(float left, float top, float right, float botto
     return DrawGlInfo::kStatusDone;
 }
 
+void OpenGLRenderer::accumulateDamage(Rect& dirty) {
+    if (!mCaches.extensions.hasBufferAge()) return;
+
+    const Rect damage(dirty);
+
+    EGLint age = 0;
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLSurface surface = eglGetCurrentSurface(EGL_DRAW);
+    if (!eglQuerySurface(display, surface, EGL_BUFFER_AGE_EXT, &age)) {
+        age = 0;
+    }
+
+    // An age of 0 means the content of the back buffer is undefined, an
+    // age of N means the buffer holds the frame rendered N frames ago and
+    // misses the damage of the N - 1 frames rendered since
+    if (age <= 0 || uint32_t(age - 1) > mDamageCount) {
+        dirty.set(0.0f, 0.0f, mWidth, mHeight);
+    } else {
+        for (int i = 0; i < age - 1; i++) {
+            dirty.unionWith(mDamageHistory[i]);
+        }
+    }
+
+    for (int i = DAMAGE_HISTORY_SIZE - 1; i > 0; i--) {
+        mDamageHistory[i].set(mDamageHistory[i - 1]);
+    }
+    mDamageHistory[0].set(damage);
+    if (mDamageCount < DAMAGE_HISTORY_SIZE) mDamageCount++;
+}
+
 void OpenGLRenderer::syncState() {
     glViewport(0, 0, mWidth, mHeight);
 
@@ -203,6 +261,10 @@ void OpenGLRenderer::syncState() {
 }
 
 void OpenGLRenderer::finish() {
+    if (!getTargetFbo()) {
+        mCaches.frameStats.endFrame();
+    }
+
 #if DEBUG_OPENGL
     GLenum status = GL_NO_ERROR;
     while ((status = glGetError()) != GL_NO_ERROR) {
@@ -243,6 +305,7 @@ void OpenGLRenderer::interrupt() {
     mCaches.unbindIndicesBuffer();
     mCaches.resetVertexPointers();
     mCaches.disbaleTexCoordsVertexArray();
+    mCaches.disableStencilTest();
 }
 
 void OpenGLRenderer::resume() {
@@ -255,6 +318,9 @@ void OpenGLRenderer::resume() {
     mCaches.resetScissor();
     dirtyClip();
 
+    // Functors may have modified the stencil buffer
+    mStencilClip.setEmpty();
+
     mCaches.activeTexture(0);
     glBindFramebuffer(GL_FRAMEBUFFER, snapshot->fbo);
 
@@ -317,6 +383,7 @@ status_t OpenGLRenderer::callDrawGLFunction(Functor* functor, Rect& dirty) {
     if (mDirtyClip) {
         setScissorFromClip();
     }
+    mCaches.disableStencilTest();
 
     Rect clip(*mSnapshot->clipRect);
     clip.snapToPixelBoundaries();
@@ -593,7 +660,10 @@ bool OpenGLRenderer::createLayer(sp<Snapshot> snapshot, float left, float top,
 
 bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> snapshot,
         GLuint previousFbo) {
-    layer->setFbo(mCaches.fboCache.get());
+    // Layers recycled from hardware layers may still own an FBO
+    if (!layer->getFbo()) {
+        layer->setFbo(mCaches.fboCache.get());
+    }
 
 #if RENDER_LAYERS_AS_REGIONS
     snapshot->region = &snapshot->layer->region;
@@ -778,6 +848,7 @@ void OpenGLRenderer::drawTextureLayer(Layer* layer, const Rect& rect) {
     setupDrawMesh(&mMeshVertices[0].position[0], &mMeshVertices[0].texture[0]);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.frameStats.countDrawCall();
 
     finishDrawTexture();
 
@@ -889,6 +960,7 @@ void OpenGLRenderer::composeLayerRegion(Layer* layer, const Rect& rect) {
 
             if (numQuads >= REGION_MESH_QUAD_COUNT) {
                 glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+                mCaches.frameStats.countDrawCall();
                 numQuads = 0;
                 mesh = mCaches.getRegionMesh();
             }
@@ -896,6 +968,7 @@ void OpenGLRenderer::composeLayerRegion(Layer* layer, const Rect& rect) {
 
         if (numQuads > 0) {
             glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+            mCaches.frameStats.countDrawCall();
         }
 
         finishDrawTexture();
@@ -983,6 +1056,8 @@ void OpenGLRenderer::clearLayerRegions() {
         // against their initial clip rect, and the current clip
         // is likely different so we need to disable clipping here
         glDisable(GL_SCISSOR_TEST);
+        const bool stencilTest = mCaches.isStencilTestEnabled();
+        mCaches.disableStencilTest();
 
         Vertex mesh[count * 6];
         Vertex* vertex = mesh;
@@ -1006,11 +1081,15 @@ void OpenGLRenderer::clearLayerRegions() {
         setupDrawProgram();
         setupDrawPureColorUniforms();
         setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
-        setupDrawVertices(&mesh[0].position[0]);
+        setupDrawVertices(&mesh[0].position[0], sizeof(mesh));
 
         glDrawArrays(GL_TRIANGLES, 0, count * 6);
+        mCaches.frameStats.countDrawCall();
 
         glEnable(GL_SCISSOR_TEST);
+        if (stencilTest) {
+            mCaches.enableStencilTest();
+        }
     } else {
         for (uint32_t i = 0; i < count; i++) {
             delete mLayers.itemAt(i);
@@ -1073,6 +1152,76 @@ void OpenGLRenderer::setScissorFromClip() {
     mDirtyClip = false;
 }
 
+void OpenGLRenderer::setStencilFromClip() {
+#if STENCIL_BUFFER_SIZE
+    // FBO targets do not have a stencil attachment, layers fall back
+    // to clipping against the bounds of the region
+    if (CC_LIKELY(!mSnapshot->clipRegion || mSnapshot->fbo)) {
+        mCaches.disableStencilTest();
+        return;
+    }
+
+    const SkRegion& clip = *mSnapshot->clipRegion;
+    if (clip != mStencilClip) {
+        // The scissor is set to the bounds of the region, only that part
+        // of the stencil buffer needs to be updated
+        mCaches.disableStencilTest();
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+
+        int count = 0;
+        SkRegion::Iterator counter(clip);
+        while (!counter.done()) {
+            count++;
+            counter.next();
+        }
+
+        Vertex mesh[count * 6];
+        Vertex* vertex = mesh;
+
+        SkRegion::Iterator it(clip);
+        while (!it.done()) {
+            const SkIRect& r = it.rect();
+
+            Vertex::set(vertex++, r.fLeft, r.fBottom);
+            Vertex::set(vertex++, r.fLeft, r.fTop);
+            Vertex::set(vertex++, r.fRight, r.fTop);
+            Vertex::set(vertex++, r.fLeft, r.fBottom);
+            Vertex::set(vertex++, r.fRight, r.fTop);
+            Vertex::set(vertex++, r.fRight, r.fBottom);
+
+            it.next();
+        }
+
+        mCaches.enableStencilTest();
+        glStencilFunc(GL_ALWAYS, 0x1, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        setupDraw(false);
+        setupDrawNoTexture();
+        setupDrawColor(0.0f, 0.0f, 0.0f, 1.0f);
+        setupDrawBlending(false, SkXfermode::kSrcOver_Mode);
+        setupDrawProgram();
+        setupDrawDirtyRegionsDisabled();
+        setupDrawPureColorUniforms();
+        setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
+        setupDrawVertices(&mesh[0].position[0], sizeof(mesh));
+
+        glDrawArrays(GL_TRIANGLES, 0, count * 6);
+        mCaches.frameStats.countDrawCall();
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glStencilFunc(GL_EQUAL, 0x1, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+        mStencilClip = clip;
+    }
+
+    mCaches.enableStencilTest();
+#endif
+}
+
 const Rect& OpenGLRenderer::getClipBounds() {
     return mSnapshot->getLocalClip();
 }
@@ -1112,6 +1261,7 @@ void OpenGLRenderer::setupDraw(bool clear) {
     if (clear) clearLayerRegions();
     if (mDirtyClip) {
         setScissorFromClip();
+        setStencilFromClip();
     }
     mDescription.reset();
     mSetShaderColor = false;
@@ -1337,7 +1487,7 @@ void OpenGLRenderer::setupDrawTextureTransformUniforms(mat4& transform) {
 
 void OpenGLRenderer::setupDrawMesh(GLvoid* vertices, GLvoid* texCoords, GLuint vbo) {
     bool force = false;
-    if (!vertices) {
+    if (!vertices || vbo) {
         force = mCaches.bindMeshBuffer(vbo == 0 ? mCaches.meshBuffer : vbo);
     } else {
         force = mCaches.unbindMeshBuffer();
@@ -1359,8 +1509,19 @@ void OpenGLRenderer::setupDrawMeshIndices(GLvoid* vertices, GLvoid* texCoords) {
     }
 }
 
-void OpenGLRenderer::setupDrawVertices(GLvoid* vertices) {
-    bool force = mCaches.unbindMeshBuffer();
+GLvoid* OpenGLRenderer::setupDrawStreamVertices(GLvoid* vertices, GLsizeiptr size,
+        bool& force) {
+    if (CC_LIKELY(mCaches.canStreamVertices(size))) {
+        force = false;
+        return mCaches.streamVertices(vertices, size);
+    }
+    force = mCaches.unbindMeshBuffer();
+    return vertices;
+}
+
+void OpenGLRenderer::setupDrawVertices(GLvoid* vertices, GLsizeiptr size) {
+    bool force;
+    vertices = setupDrawStreamVertices(vertices, size, force);
     mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
             vertices, gVertexStride);
     mCaches.unbindIndicesBuffer();
@@ -1377,28 +1538,38 @@ void OpenGLRenderer::setupDrawVertices(GLvoid* vertices) {
  * Note that we only pass down the width values in this setup function. The length coordinates
  * are set up for each individual segment.
  */
-void OpenGLRenderer::setupDrawAALine(GLvoid* vertices, GLvoid* widthCoords,
-        GLvoid* lengthCoords, float boundaryWidthProportion, int& widthSlot, int& lengthSlot) {
-    bool force = mCaches.unbindMeshBuffer();
+void OpenGLRenderer::setupDrawAALineUniforms(float boundaryWidthProportion) {
+    int boundaryWidthSlot = mCaches.currentProgram->getUniform("boundaryWidth");
+    glUniform1f(boundaryWidthSlot, boundaryWidthProportion);
+
+    // Setting the inverse value saves computations per-fragment in the shader
+    int inverseBoundaryWidthSlot = mCaches.currentProgram->getUniform("inverseBoundaryWidth");
+    glUniform1f(inverseBoundaryWidthSlot, 1.0f / boundaryWidthProportion);
+}
+
+/**
+ * Binds the vertices of AA lines, see setupDrawAALineUniforms(). This must be
+ * invoked once the vertices have been generated as they might be copied into
+ * the streaming VBO.
+ */
+void OpenGLRenderer::setupDrawAALineVertices(GLvoid* vertices, GLsizeiptr size,
+        int& widthSlot, int& lengthSlot) {
+    bool force;
+    GLbyte* base = (GLbyte*) setupDrawStreamVertices(vertices, size, force);
     mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
-            vertices, gAAVertexStride);
+            base, gAAVertexStride);
     mCaches.resetTexCoordsVertexPointer();
     mCaches.unbindIndicesBuffer();
 
     widthSlot = mCaches.currentProgram->getAttrib("vtxWidth");
     glEnableVertexAttribArray(widthSlot);
-    glVertexAttribPointer(widthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride, widthCoords);
+    glVertexAttribPointer(widthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride,
+            base + gVertexAAWidthOffset);
 
     lengthSlot = mCaches.currentProgram->getAttrib("vtxLength");
     glEnableVertexAttribArray(lengthSlot);
-    glVertexAttribPointer(lengthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride, lengthCoords);
-
-    int boundaryWidthSlot = mCaches.currentProgram->getUniform("boundaryWidth");
-    glUniform1f(boundaryWidthSlot, boundaryWidthProportion);
-
-    // Setting the inverse value saves computations per-fragment in the shader
-    int inverseBoundaryWidthSlot = mCaches.currentProgram->getUniform("inverseBoundaryWidth");
-    glUniform1f(inverseBoundaryWidthSlot, 1.0f / boundaryWidthProportion);
+    glVertexAttribPointer(lengthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride,
+            base + gVertexAALengthOffset);
 }
 
 void OpenGLRenderer::finishDrawAALine(const int widthSlot, const int lengthSlot) {
@@ -1471,6 +1642,7 @@ void OpenGLRenderer::drawAlphaBitmap(Texture* texture, float left, float top, Sk
     setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.frameStats.countDrawCall();
 
     finishDrawTexture();
 }
@@ -1617,9 +1789,8 @@ status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int mes
     }
 #endif
 
-    drawTextureMesh(0.0f, 0.0f, 1.0f, 1.0f, texture->id, alpha / 255.0f,
-            mode, texture->blend, &mesh[0].position[0], &mesh[0].texture[0],
-            GL_TRIANGLES, count, false, false, 0, false, false);
+    drawStreamedTextureMesh(0.0f, 0.0f, 1.0f, 1.0f, texture->id, alpha / 255.0f,
+            mode, texture->blend, &mesh[0], GL_TRIANGLES, count, false, false, false);
 
     return DrawGlInfo::kStatusDrew;
 }
@@ -1724,19 +1895,24 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
         }
 #endif
 
+        float x = left;
+        float y = top;
         if (CC_LIKELY(pureTranslate)) {
-            const float x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
-            const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
+            x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
+            y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
+        }
 
-            drawTextureMesh(x, y, x + right - left, y + bottom - top, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
-                    GL_TRIANGLES, mesh->verticesCount, false, true, mesh->meshBuffer,
+        if (CC_LIKELY(mesh->meshBuffer)) {
+            // The mesh is stored in the VBO shared by all the patches
+            GLbyte* offset = (GLbyte*) 0 + mesh->meshOffset;
+            drawTextureMesh(x, y, x + right - left, y + bottom - top, texture->id,
+                    alpha / 255.0f, mode, texture->blend, offset, offset + gMeshTextureOffset,
+                    GL_TRIANGLES, mesh->verticesCount, false, pureTranslate, mesh->meshBuffer,
                     true, !mesh->hasEmptyQuads);
         } else {
-            drawTextureMesh(left, top, right, bottom, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
-                    GL_TRIANGLES, mesh->verticesCount, false, false, mesh->meshBuffer,
-                    true, !mesh->hasEmptyQuads);
+            drawStreamedTextureMesh(x, y, x + right - left, y + bottom - top, texture->id,
+                    alpha / 255.0f, mode, texture->blend, mesh->getVertices(), GL_TRIANGLES,
+                    mesh->verticesCount, pureTranslate, true, !mesh->hasEmptyQuads);
         }
     }
 
@@ -1768,6 +1944,19 @@ void OpenGLRenderer::drawAARect(float left, float top, float right, float bottom
         inverseScaleY = (scaleY != 0) ? (inverseScaleY / scaleY) : 0;
     }
 
+    float boundarySizeX = .5 * inverseScaleX;
+    float boundarySizeY = .5 * inverseScaleY;
+
+    // Adjust the rect by the AA boundary padding
+    left -= boundarySizeX;
+    right += boundarySizeX;
+    top -= boundarySizeY;
+    bottom += boundarySizeY;
+
+    if (quickReject(left, top, right, bottom)) {
+        return;
+    }
+
     setupDraw();
     setupDrawNoTexture();
     setupDrawAALine();
@@ -1781,20 +1970,6 @@ void OpenGLRenderer::drawAARect(float left, float top, float right, float bottom
     setupDrawColorFilterUniforms();
     setupDrawShaderIdentityUniforms();
 
-    AAVertex rects[4];
-    AAVertex* aaVertices = &rects[0];
-    void* widthCoords = ((GLbyte*) aaVertices) + gVertexAAWidthOffset;
-    void* lengthCoords = ((GLbyte*) aaVertices) + gVertexAALengthOffset;
-
-    float boundarySizeX = .5 * inverseScaleX;
-    float boundarySizeY = .5 * inverseScaleY;
-
-    // Adjust the rect by the AA boundary padding
-    left -= boundarySizeX;
-    right += boundarySizeX;
-    top -= boundarySizeY;
-    bottom += boundarySizeY;
-
     float width = right - left;
     float height = bottom - top;
 
@@ -1803,22 +1978,25 @@ void OpenGLRenderer::drawAARect(float left, float top, float right, float bottom
 
     float boundaryWidthProportion = (width != 0) ? (2 * boundarySizeX) / width : 0;
     float boundaryHeightProportion = (height != 0) ? (2 * boundarySizeY) / height : 0;
-    setupDrawAALine((void*) aaVertices, widthCoords, lengthCoords,
-            boundaryWidthProportion, widthSlot, lengthSlot);
+    setupDrawAALineUniforms(boundaryWidthProportion);
 
     int boundaryLengthSlot = mCaches.currentProgram->getUniform("boundaryLength");
     int inverseBoundaryLengthSlot = mCaches.currentProgram->getUniform("inverseBoundaryLength");
     glUniform1f(boundaryLengthSlot, boundaryHeightProportion);
     glUniform1f(inverseBoundaryLengthSlot, (1.0f / boundaryHeightProportion));
 
-    if (!quickReject(left, top, right, bottom)) {
-        AAVertex::set(aaVertices++, left, bottom, 1, 1);
-        AAVertex::set(aaVertices++, left, top, 1, 0);
-        AAVertex::set(aaVertices++, right, bottom, 0, 1);
-        AAVertex::set(aaVertices++, right, top, 0, 0);
-        dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    }
+    AAVertex rects[4];
+    AAVertex* aaVertices = &rects[0];
+    AAVertex::set(aaVertices++, left, bottom, 1, 1);
+    AAVertex::set(aaVertices++, left, top, 1, 0);
+    AAVertex::set(aaVertices++, right, bottom, 0, 1);
+    AAVertex::set(aaVertices++, right, top, 0, 0);
+
+    setupDrawAALineVertices(&rects[0], sizeof(rects), widthSlot, lengthSlot);
+
+    dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    mCaches.frameStats.countDrawCall();
 
     finishDrawAALine(widthSlot, lengthSlot);
 }
@@ -1924,19 +2102,14 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
     AAVertex wLines[verticesCount];
     AAVertex* aaVertices = &wLines[0];
 
-    if (CC_UNLIKELY(!isAA)) {
-        setupDrawVertices(vertices);
-    } else {
-        void* widthCoords = ((GLbyte*) aaVertices) + gVertexAAWidthOffset;
-        void* lengthCoords = ((GLbyte*) aaVertices) + gVertexAALengthOffset;
+    if (isAA) {
         // innerProportion is the ratio of the inner (non-AA) part of the line to the total
         // AA stroke width (the base stroke width expanded by a half pixel on either side).
         // This value is used in the fragment shader to determine how to fill fragments.
         // We will need to calculate the actual width proportion on each segment for
         // scaled non-hairlines, since the boundary proportion may differ per-axis when scaled.
         float boundaryWidthProportion = 1 / (2 * halfStrokeWidth);
-        setupDrawAALine((void*) aaVertices, widthCoords, lengthCoords,
-                boundaryWidthProportion, widthSlot, lengthSlot);
+        setupDrawAALineUniforms(boundaryWidthProportion);
     }
 
     AAVertex* prevAAVertex = NULL;
@@ -2092,11 +2265,20 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
     }
 
     if (generatedVerticesCount > 0) {
-       glDrawArrays(GL_TRIANGLE_STRIP, 0, generatedVerticesCount);
-    }
+        // The vertices are bound only once generated so they can be streamed
+        if (CC_UNLIKELY(!isAA)) {
+            setupDrawVertices(&lines[0], generatedVerticesCount * sizeof(Vertex));
+        } else {
+            setupDrawAALineVertices(&wLines[0], generatedVerticesCount * sizeof(AAVertex),
+                    widthSlot, lengthSlot);
+        }
 
-    if (isAA) {
-        finishDrawAALine(widthSlot, lengthSlot);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, generatedVerticesCount);
+        mCaches.frameStats.countDrawCall();
+
+        if (isAA) {
+            finishDrawAALine(widthSlot, lengthSlot);
+        }
     }
 
     return DrawGlInfo::kStatusDrew;
@@ -2124,8 +2306,8 @@ status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
     int verticesCount = count >> 1;
     int generatedVerticesCount = 0;
 
-    TextureVertex pointsData[verticesCount];
-    TextureVertex* vertex = &pointsData[0];
+    Vertex pointsData[verticesCount];
+    Vertex* vertex = &pointsData[0];
 
     setupDraw();
     setupDrawNoTexture();
@@ -2140,10 +2322,9 @@ status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
     setupDrawColorFilterUniforms();
     setupDrawPointUniforms();
     setupDrawShaderIdentityUniforms();
-    setupDrawMesh(vertex);
 
     for (int i = 0; i < count; i += 2) {
-        TextureVertex::set(vertex++, points[i], points[i + 1], 0.0f, 0.0f);
+        Vertex::set(vertex++, points[i], points[i + 1]);
         generatedVerticesCount++;
 
         float left = points[i] - halfWidth;
@@ -2154,7 +2335,11 @@ status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
         dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
     }
 
-    glDrawArrays(GL_POINTS, 0, generatedVerticesCount);
+    if (generatedVerticesCount > 0) {
+        setupDrawVertices(&pointsData[0], generatedVerticesCount * sizeof(Vertex));
+        glDrawArrays(GL_POINTS, 0, generatedVerticesCount);
+        mCaches.frameStats.countDrawCall();
+    }
 
     return DrawGlInfo::kStatusDrew;
 }
@@ -2414,6 +2599,7 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count,
         setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
         glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+        mCaches.frameStats.countDrawCall();
     }
 
     // Pick the appropriate texture filtering
@@ -2599,6 +2785,7 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* pain
 
             glDrawElements(GL_TRIANGLES, layer->meshElementCount,
                     GL_UNSIGNED_SHORT, layer->meshIndices);
+            mCaches.frameStats.countDrawCall();
 
             finishDrawTexture();
 
@@ -2683,6 +2870,19 @@ SkPaint* OpenGLRenderer::filterPaint(SkPaint* paint) {
     return &mFilteredPaint;
 }
 
+SkPaint* OpenGLRenderer::alphaPaint(SkPaint* paint, int alpha) {
+    if (paint != &mFilteredPaint) {
+        if (paint) {
+            mFilteredPaint = *paint;
+        } else {
+            mFilteredPaint.reset();
+        }
+    }
+    mFilteredPaint.setAlpha(alpha);
+
+    return &mFilteredPaint;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Drawing implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -2712,6 +2912,7 @@ void OpenGLRenderer::drawPathTexture(const PathTexture* texture,
     setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.frameStats.countDrawCall();
 
     finishDrawTexture();
 }
@@ -2804,6 +3005,7 @@ void OpenGLRenderer::drawColorRect(float left, float top, float right, float bot
     setupDrawSimpleMesh();
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.frameStats.countDrawCall();
 }
 
 void OpenGLRenderer::drawTextureRect(float left, float top, float right, float bottom,
@@ -2841,6 +3043,43 @@ void OpenGLRenderer::drawTextureMesh(float left, float top, float right, float b
         GLvoid* vertices, GLvoid* texCoords, GLenum drawMode, GLsizei elementsCount,
         bool swapSrcDst, bool ignoreTransform, GLuint vbo, bool ignoreScale, bool dirty) {
 
+    setupDrawTextureMesh(left, top, right, bottom, texture, alpha, mode, blend,
+            swapSrcDst, ignoreTransform, ignoreScale, dirty);
+    setupDrawMesh(vertices, texCoords, vbo);
+
+    glDrawArrays(drawMode, 0, elementsCount);
+    mCaches.frameStats.countDrawCall();
+
+    finishDrawTexture();
+}
+
+void OpenGLRenderer::drawStreamedTextureMesh(float left, float top, float right, float bottom,
+        GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+        const TextureVertex* mesh, GLenum drawMode, GLsizei elementsCount,
+        bool ignoreTransform, bool ignoreScale, bool dirty) {
+
+    // Setting up the draw may itself stream geometry (to update the stencil
+    // clip for instance) so the mesh must be streamed afterwards
+    setupDrawTextureMesh(left, top, right, bottom, texture, alpha, mode, blend,
+            false, ignoreTransform, ignoreScale, dirty);
+
+    const GLsizeiptr size = elementsCount * sizeof(TextureVertex);
+    if (CC_LIKELY(mCaches.canStreamVertices(size))) {
+        GLbyte* offset = (GLbyte*) mCaches.streamVertices(mesh, size);
+        setupDrawMesh(offset, offset + gMeshTextureOffset, mCaches.streamBuffer);
+    } else {
+        setupDrawMesh((GLvoid*) &mesh[0].position[0], (GLvoid*) &mesh[0].texture[0]);
+    }
+
+    glDrawArrays(drawMode, 0, elementsCount);
+    mCaches.frameStats.countDrawCall();
+
+    finishDrawTexture();
+}
+
+void OpenGLRenderer::setupDrawTextureMesh(float left, float top, float right, float bottom,
+        GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+        bool swapSrcDst, bool ignoreTransform, bool ignoreScale, bool dirty) {
     setupDraw();
     setupDrawWithTexture();
     setupDrawColor(alpha, alpha, alpha, alpha);
@@ -2858,11 +3097,6 @@ void OpenGLRenderer::drawTextureMesh(float left, float top, float right, float b
     setupDrawPureColorUniforms();
     setupDrawColorFilterUniforms();
     setupDrawTexture(texture);
-    setupDrawMesh(vertices, texCoords, vbo);
-
-    glDrawArrays(drawMode, 0, elementsCount);
-
-    finishDrawTexture();
 }
 
 void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
@@ -2914,6 +3148,7 @@ bool OpenGLRenderer::useProgram(Program* program) {
         if (mCaches.currentProgram != NULL) mCaches.currentProgram->remove();
         program->use();
         mCaches.currentProgram = program;
+        mCaches.frameStats.countProgramSwitch();
         return false;
     }
     return true;
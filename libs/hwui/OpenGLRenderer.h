@@ -48,6 +48,14 @@
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of previous frames whose damage is remembered, buffers older
+// than this are entirely redrawn
+#define DAMAGE_HISTORY_SIZE 4
+
 ///////////////////////////////////////////////////////////////////////////////
 // Renderer
 ///////////////////////////////////////////////////////////////////////////////
@@ -155,6 +163,14 @@ public:
 
     SkPaint* filterPaint(SkPaint* paint);
 
+    /**
+     * Returns a copy of the specified paint, which may be NULL, with its
+     * alpha replaced. The copy is owned by the renderer and only valid
+     * until the next call to this method or to filterPaint(). The paints
+     * recorded in display lists are shared and must never be modified.
+     */
+    SkPaint* alphaPaint(SkPaint* paint, int alpha);
+
     ANDROID_API static uint32_t getStencilSize();
 
     void startMark(const char* name) const;
@@ -220,6 +236,18 @@ private:
      */
     void syncState();
 
+    /**
+     * Expands the specified dirty rectangle, the damage of the frame about
+     * to be rendered to the window, so that it also covers the content the
+     * current back buffer is missing. The age of the back buffer is queried
+     * with EGL_EXT_buffer_age; the dirty rectangle is left untouched when
+     * the extension is not supported.
+     *
+     * This only saves work when the caller passes the actual damage to
+     * prepareDirty(). A caller using prepare() redraws the whole surface.
+     */
+    void accumulateDamage(Rect& dirty);
+
     /**
      * Saves the current state of the renderer as a new snapshot.
      * The new snapshot is saved in mSnapshot and the previous snapshot
@@ -244,6 +272,13 @@ private:
      */
     void setScissorFromClip();
 
+    /**
+     * Writes the current snapshot's clip region, if any, into the stencil
+     * buffer and enables the stencil test. When the clip is a simple
+     * rectangle the stencil test is disabled and the scissor alone is used.
+     */
+    void setStencilFromClip();
+
     /**
      * Creates a new layer stored in the specified snapshot.
      *
@@ -433,6 +468,24 @@ private:
             bool swapSrcDst = false, bool ignoreTransform = false, GLuint vbo = 0,
             bool ignoreScale = false, bool dirty = true);
 
+    /**
+     * Identical to drawTextureMesh() except the client-side vertices are
+     * streamed to the GPU through the shared streaming VBO.
+     *
+     * @param mesh The vertices and texture coordinates of the mesh
+     */
+    void drawStreamedTextureMesh(float left, float top, float right, float bottom,
+            GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+            const TextureVertex* mesh, GLenum drawMode, GLsizei elementsCount,
+            bool ignoreTransform, bool ignoreScale, bool dirty);
+
+    /**
+     * Sets up all the state required by drawTextureMesh(), except the mesh itself.
+     */
+    void setupDrawTextureMesh(float left, float top, float right, float bottom,
+            GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+            bool swapSrcDst, bool ignoreTransform, bool ignoreScale, bool dirty);
+
     /**
      * Draws text underline and strike-through if needed.
      *
@@ -564,9 +617,11 @@ private:
     void setupDrawTextureTransformUniforms(mat4& transform);
     void setupDrawMesh(GLvoid* vertices, GLvoid* texCoords = NULL, GLuint vbo = 0);
     void setupDrawMeshIndices(GLvoid* vertices, GLvoid* texCoords);
-    void setupDrawVertices(GLvoid* vertices);
-    void setupDrawAALine(GLvoid* vertices, GLvoid* distanceCoords, GLvoid* lengthCoords,
-            float strokeWidth, int& widthSlot, int& lengthSlot);
+    GLvoid* setupDrawStreamVertices(GLvoid* vertices, GLsizeiptr size, bool& force);
+    void setupDrawVertices(GLvoid* vertices, GLsizeiptr size);
+    void setupDrawAALineUniforms(float boundaryWidthProportion);
+    void setupDrawAALineVertices(GLvoid* vertices, GLsizeiptr size,
+            int& widthSlot, int& lengthSlot);
     void finishDrawAALine(const int widthSlot, const int lengthSlot);
     void finishDrawTexture();
     void accountForClear(SkXfermode::Mode mode);
@@ -583,6 +638,10 @@ private:
     // Dimensions of the drawing surface
     int mWidth, mHeight;
 
+    // Damage of the last frames rendered to the window, most recent first
+    Rect mDamageHistory[DAMAGE_HISTORY_SIZE];
+    uint32_t mDamageCount;
+
     // Matrix used for ortho projection in shaders
     mat4 mOrthoMatrix;
 
@@ -631,6 +690,8 @@ private:
 
     // Indicates whether the clip must be restored
     bool mDirtyClip;
+    // Clip region currently written in the stencil buffer
+    SkRegion mStencilClip;
 
     // The following fields are used to setup drawing
     // Used to describe the shaders to generate
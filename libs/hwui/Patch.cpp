@@ -20,8 +20,9 @@
 
 #include <utils/Log.h>
 
-#include "Patch.h"
 #include "Caches.h"
+#include "Patch.h"
+#include "PatchCache.h"
 #include "Properties.h"
 
 namespace android {
@@ -37,8 +38,12 @@ Patch::Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQua
     // 2 triangles per patch, 3 vertices per triangle
     uint32_t maxVertices = ((xCount + 1) * (yCount + 1) - emptyQuads) * 2 * 3;
     mVertices = new TextureVertex[maxVertices];
-    mUploaded = false;
+    mMaxVertices = maxVertices;
+    mColumns = new Segment[xCount + 1];
+    mRows = new Segment[yCount + 1];
 
+    meshBuffer = 0;
+    meshOffset = 0;
     verticesCount = 0;
     hasEmptyQuads = emptyQuads > 0;
 
@@ -46,17 +51,18 @@ Patch::Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQua
     mXDivs = new int32_t[mXCount];
     mYDivs = new int32_t[mYCount];
 
+    invalidate();
+
     PATCH_LOGD("    patch: xCount = %d, yCount = %d, emptyQuads = %d, max vertices = %d",
             xCount, yCount, emptyQuads, maxVertices);
-
-    glGenBuffers(1, &meshBuffer);
 }
 
 Patch::~Patch() {
     delete[] mVertices;
+    delete[] mColumns;
+    delete[] mRows;
     delete[] mXDivs;
     delete[] mYDivs;
-    glDeleteBuffers(1, &meshBuffer);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -66,14 +72,22 @@ Patch::~Patch() {
 void Patch::copy(const int32_t* xDivs, const int32_t* yDivs) {
     memcpy(mXDivs, xDivs, mXCount * sizeof(int32_t));
     memcpy(mYDivs, yDivs, mYCount * sizeof(int32_t));
+    invalidate();
 }
 
 void Patch::copy(const int32_t* yDivs) {
     memcpy(mYDivs, yDivs, mYCount * sizeof(int32_t));
+    invalidate();
 }
 
 void Patch::updateColorKey(const uint32_t colorKey) {
     mColorKey = colorKey;
+    invalidate();
+}
+
+void Patch::invalidate() {
+    mWidth = -1.0f;
+    mHeight = -1.0f;
 }
 
 bool Patch::matches(const int32_t* xDivs, const int32_t* yDivs, const uint32_t colorKey) {
@@ -108,6 +122,16 @@ bool Patch::matches(const int32_t* xDivs, const int32_t* yDivs, const uint32_t c
 
 void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight,
         float left, float top, float right, float bottom) {
+    const float width = right - left;
+    const float height = bottom - top;
+
+    // The mesh only depends on the size of the patch, not on its position
+    if (width == mWidth && height == mHeight) {
+        return;
+    }
+    mWidth = width;
+    mHeight = height;
+
 #if RENDER_LAYERS_AS_REGIONS
     if (hasEmptyQuads) quads.clear();
 #endif
@@ -116,151 +140,106 @@ void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight,
     // vertices we actually need when generating the quads
     verticesCount = 0;
 
-    const uint32_t xStretchCount = (mXCount + 1) >> 1;
-    const uint32_t yStretchCount = (mYCount + 1) >> 1;
-
-    float stretchX = 0.0f;
-    float stretchY = 0.0;
-
-    const float meshWidth = right - left;
-
-    if (xStretchCount > 0) {
-        uint32_t stretchSize = 0;
-        for (uint32_t i = 1; i < mXCount; i += 2) {
-            stretchSize += mXDivs[i] - mXDivs[i - 1];
-        }
-        const float xStretchTex = stretchSize;
-        const float fixed = bitmapWidth - stretchSize;
-        const float xStretch = right - left - fixed;
-        stretchX = xStretch / xStretchTex;
-    }
-
-    if (yStretchCount > 0) {
-        uint32_t stretchSize = 0;
-        for (uint32_t i = 1; i < mYCount; i += 2) {
-            stretchSize += mYDivs[i] - mYDivs[i - 1];
-        }
-        const float yStretchTex = stretchSize;
-        const float fixed = bitmapHeight - stretchSize;
-        const float yStretch = bottom - top - fixed;
-        stretchY = yStretch / yStretchTex;
-    }
+    const uint32_t columnCount = layoutSegments(mColumns, mXDivs, mXCount, bitmapWidth, width);
+    const uint32_t rowCount = layoutSegments(mRows, mYDivs, mYCount, bitmapHeight, height);
 
     TextureVertex* vertex = mVertices;
     uint32_t quadCount = 0;
 
-    float previousStepY = 0.0f;
-
-    float y1 = 0.0f;
-    float y2 = 0.0f;
-    float v1 = 0.0f;
-
-    for (uint32_t i = 0; i < mYCount; i++) {
-        float stepY = mYDivs[i];
-        const float segment = stepY - previousStepY;
-
-        if (i & 1) {
-            y2 = y1 + floorf(segment * stretchY + 0.5f);
-        } else {
-            y2 = y1 + segment;
-        }
-
-        float vOffset = y1 == y2 ? 0.0f : 0.5 - (0.5 * segment / (y2 - y1));
-        float v2 = fmax(0.0f, stepY - vOffset) / bitmapHeight;
-        v1 += vOffset / bitmapHeight;
-
-        if (stepY > 0.0f) {
-#if DEBUG_EXPLODE_PATCHES
-            y1 += i * EXPLODE_GAP;
-            y2 += i * EXPLODE_GAP;
-#endif
-            generateRow(vertex, y1, y2, v1, v2, stretchX, right - left,
-                    bitmapWidth, quadCount);
-#if DEBUG_EXPLODE_PATCHES
-            y2 -= i * EXPLODE_GAP;
-#endif
+    for (uint32_t i = 0; i < rowCount; i++) {
+        const Segment& row = mRows[i];
+        for (uint32_t j = 0; j < columnCount; j++) {
+            const Segment& column = mColumns[j];
+            generateQuad(vertex, column.p1, row.p1, column.p2, row.p2,
+                    column.t1, row.t1, column.t2, row.t2, quadCount);
         }
-
-        y1 = y2;
-        v1 = stepY / bitmapHeight;
-
-        previousStepY = stepY;
-    }
-
-    if (previousStepY != bitmapHeight) {
-        y2 = bottom - top;
-#if DEBUG_EXPLODE_PATCHES
-        y1 += mYCount * EXPLODE_GAP;
-        y2 += mYCount * EXPLODE_GAP;
-#endif
-        generateRow(vertex, y1, y2, v1, 1.0f, stretchX, right - left, bitmapWidth, quadCount);
     }
 
-    if (verticesCount > 0) {
+    if (meshBuffer && verticesCount > 0) {
         Caches& caches = Caches::getInstance();
         caches.bindMeshBuffer(meshBuffer);
-        if (!mUploaded) {
-            glBufferData(GL_ARRAY_BUFFER, sizeof(TextureVertex) * verticesCount,
-                    mVertices, GL_DYNAMIC_DRAW);
-            mUploaded = true;
-        } else {
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    sizeof(TextureVertex) * verticesCount, mVertices);
-        }
+        glBufferSubData(GL_ARRAY_BUFFER, meshOffset,
+                sizeof(TextureVertex) * verticesCount, mVertices);
         caches.resetVertexPointers();
     }
 
     PATCH_LOGD("    patch: new vertices count = %d", verticesCount);
 }
 
-void Patch::generateRow(TextureVertex*& vertex, float y1, float y2, float v1, float v2,
-        float stretchX, float width, float bitmapWidth, uint32_t& quadCount) {
-    float previousStepX = 0.0f;
+/**
+ * Computes the position and texture coordinates of every column (or row)
+ * of quads along one axis of the patch. Stretchable segments are scaled
+ * to fill the space left by the fixed segments.
+ *
+ * @return The number of segments written in the specified array
+ */
+uint32_t Patch::layoutSegments(Segment* segments, const int32_t* divs, uint32_t count,
+        float bitmapSize, float size) {
+    const uint32_t stretchCount = (count + 1) >> 1;
 
-    float x1 = 0.0f;
-    float x2 = 0.0f;
-    float u1 = 0.0f;
+    float stretch = 0.0f;
+    if (stretchCount > 0) {
+        uint32_t stretchSize = 0;
+        for (uint32_t i = 1; i < count; i += 2) {
+            stretchSize += divs[i] - divs[i - 1];
+        }
+        const float stretchTex = stretchSize;
+        const float fixed = bitmapSize - stretchSize;
+        stretch = (size - fixed) / stretchTex;
+    }
 
-    // Generate the row quad by quad
-    for (uint32_t i = 0; i < mXCount; i++) {
-        float stepX = mXDivs[i];
-        const float segment = stepX - previousStepX;
+    uint32_t segmentCount = 0;
+    float previousStep = 0.0f;
+
+    float p1 = 0.0f;
+    float p2 = 0.0f;
+    float t1 = 0.0f;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const float step = divs[i];
+        const float segment = step - previousStep;
 
         if (i & 1) {
-            x2 = x1 + floorf(segment * stretchX + 0.5f);
+            p2 = p1 + floorf(segment * stretch + 0.5f);
         } else {
-            x2 = x1 + segment;
+            p2 = p1 + segment;
         }
 
-        float uOffset = x1 == x2 ? 0.0f : 0.5 - (0.5 * segment / (x2 - x1));
-        float u2 = fmax(0.0f, stepX - uOffset) / bitmapWidth;
-        u1 += uOffset / bitmapWidth;
+        float offset = p1 == p2 ? 0.0f : 0.5 - (0.5 * segment / (p2 - p1));
+        float t2 = fmax(0.0f, step - offset) / bitmapSize;
+        t1 += offset / bitmapSize;
 
-        if (stepX > 0.0f) {
+        if (step > 0.0f) {
+            Segment& s = segments[segmentCount++];
+            s.p1 = p1;
+            s.p2 = p2;
 #if DEBUG_EXPLODE_PATCHES
-            x1 += i * EXPLODE_GAP;
-            x2 += i * EXPLODE_GAP;
-#endif
-            generateQuad(vertex, x1, y1, x2, y2, u1, v1, u2, v2, quadCount);
-#if DEBUG_EXPLODE_PATCHES
-            x2 -= i * EXPLODE_GAP;
+            s.p1 += i * EXPLODE_GAP;
+            s.p2 += i * EXPLODE_GAP;
 #endif
+            s.t1 = t1;
+            s.t2 = t2;
         }
 
-        x1 = x2;
-        u1 = stepX / bitmapWidth;
+        p1 = p2;
+        t1 = step / bitmapSize;
 
-        previousStepX = stepX;
+        previousStep = step;
     }
 
-    if (previousStepX != bitmapWidth) {
-        x2 = width;
+    if (previousStep != bitmapSize) {
+        Segment& s = segments[segmentCount++];
+        s.p1 = p1;
+        s.p2 = size;
 #if DEBUG_EXPLODE_PATCHES
-        x1 += mXCount * EXPLODE_GAP;
-        x2 += mXCount * EXPLODE_GAP;
+        s.p1 += count * EXPLODE_GAP;
+        s.p2 += count * EXPLODE_GAP;
 #endif
-        generateQuad(vertex, x1, y1, x2, y2, u1, v1, 1.0f, v2, quadCount);
+        s.t1 = t1;
+        s.t2 = 1.0f;
     }
+
+    return segmentCount;
 }
 
 void Patch::generateQuad(TextureVertex*& vertex, float x1, float y1, float x2, float y2,
@@ -43,11 +43,20 @@ namespace uirenderer {
 /**
  * An OpenGL patch. This contains an array of vertices and an array of
  * indices to render the vertices.
+ *
+ * The vertices are generated for the size the patch was last drawn at and
+ * are stored in a range of the VBO shared by the patch cache. They are
+ * only generated and uploaded again when that size or the divs change.
  */
 struct Patch {
     Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQuads = 0);
     ~Patch();
 
+    /**
+     * Generates the vertices of the patch for the specified size and
+     * uploads them to the patch's range of meshBuffer, if any. This is a
+     * no-op if the size and the divs have not changed since the last call.
+     */
     void updateVertices(const float bitmapWidth, const float bitmapHeight,
             float left, float top, float right, float bottom);
 
@@ -55,14 +64,55 @@ struct Patch {
     void copy(const int32_t* xDivs, const int32_t* yDivs);
     bool matches(const int32_t* xDivs, const int32_t* yDivs, const uint32_t colorKey);
 
+    /**
+     * Returns the memory used by the vertices of the patch, in bytes,
+     * counting both the client side copy and the VBO.
+     */
+    uint32_t getSize() const {
+        return getBufferSize() * 2;
+    }
+
+    /**
+     * Returns the size of the range of meshBuffer needed to hold the
+     * vertices of the patch, in bytes.
+     */
+    uint32_t getBufferSize() const {
+        return mMaxVertices * sizeof(TextureVertex);
+    }
+
+    const TextureVertex* getVertices() const {
+        return mVertices;
+    }
+
+    // VBO shared with other patches and offset in bytes of the vertices
+    // in that VBO. meshBuffer is 0 when the vertices are only kept on
+    // the client side
     GLuint meshBuffer;
+    uint32_t meshOffset;
     uint32_t verticesCount;
     bool hasEmptyQuads;
     Vector<Rect> quads;
 
 private:
+    /**
+     * Position and texture coordinates of a column or a row of quads.
+     */
+    struct Segment {
+        float p1;
+        float p2;
+        float t1;
+        float t2;
+    };
+
     TextureVertex* mVertices;
-    bool mUploaded;
+    uint32_t mMaxVertices;
+    // Scratch space used to lay out the columns and rows of quads
+    Segment* mColumns;
+    Segment* mRows;
+
+    // Size of the last generated mesh, negative when the mesh is invalid
+    float mWidth;
+    float mHeight;
 
     int32_t* mXDivs;
     int32_t* mYDivs;
@@ -73,10 +123,11 @@ private:
     int8_t mEmptyQuads;
 
     void copy(const int32_t* yDivs);
+    void invalidate();
+
+    static uint32_t layoutSegments(Segment* segments, const int32_t* divs, uint32_t count,
+            float bitmapSize, float size);
 
-    void generateRow(TextureVertex*& vertex, float y1, float y2,
-            float v1, float v2, float stretchX, float width, float bitmapWidth,
-            uint32_t& quadCount);
     void generateQuad(TextureVertex*& vertex,
             float x1, float y1, float x2, float y2,
             float u1, float v1, float u2, float v2,
@@ -18,6 +18,7 @@
 
 #include <utils/Log.h>
 
+#include "Caches.h"
 #include "PatchCache.h"
 #include "Properties.h"
 
@@ -28,28 +29,156 @@ namespace uirenderer {
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
 
-PatchCache::PatchCache(): mMaxEntries(DEFAULT_PATCH_CACHE_SIZE) {
+PatchCache::PatchCache(): mMaxEntries(DEFAULT_PATCH_CACHE_SIZE), mMemorySize(0), mAccessCount(0),
+        mCache(DEFAULT_PATCH_CACHE_SIZE), mMeshBuffer(0),
+        mMeshBufferSize(DEFAULT_PATCH_MESH_BUFFER_SIZE) {
+    mCache.setOnEntryRemovedListener(this);
 }
 
-PatchCache::PatchCache(uint32_t maxEntries): mMaxEntries(maxEntries) {
+PatchCache::PatchCache(uint32_t maxEntries): mMaxEntries(maxEntries), mMemorySize(0),
+        mAccessCount(0), mCache(maxEntries), mMeshBuffer(0),
+        mMeshBufferSize(DEFAULT_PATCH_MESH_BUFFER_SIZE) {
+    mCache.setOnEntryRemovedListener(this);
 }
 
 PatchCache::~PatchCache() {
-    clear();
+    mCache.clear();
+    if (mMeshBuffer) {
+        glDeleteBuffers(1, &mMeshBuffer);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Caching
 ///////////////////////////////////////////////////////////////////////////////
 
+void PatchCache::operator()(PatchDescription& description, Patch*& mesh) {
+    if (mesh->meshBuffer) {
+        freeBlock(mesh->meshOffset, mesh->getBufferSize());
+    }
+    mMemorySize -= mesh->getSize();
+    delete mesh;
+}
+
 void PatchCache::clear() {
-    size_t count = mCache.size();
+    mCache.clear();
+
+    if (mMeshBuffer) {
+        Caches::getInstance().unbindMeshBuffer();
+        glDeleteBuffers(1, &mMeshBuffer);
+        mMeshBuffer = 0;
+        mFreeBlocks.clear();
+    }
+}
+
+void PatchCache::trimToMemorySize(uint32_t memorySize) {
+    while (mMemorySize > memorySize && mCache.size() > 0) {
+        mCache.removeOldest();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mesh buffer
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Assigns the specified mesh a range of the shared VBO, evicting the least
+ * recently used meshes if needed. A mesh larger than the whole VBO keeps
+ * its vertices on the client side only.
+ */
+void PatchCache::setupMesh(Patch* mesh) {
+    const uint32_t size = mesh->getBufferSize();
+    if (size > mMeshBufferSize) {
+        PATCH_LOGD("Patch mesh too large for the mesh buffer (%d bytes)", size);
+        return;
+    }
+
+    if (!mMeshBuffer) {
+        Caches& caches = Caches::getInstance();
+        glGenBuffers(1, &mMeshBuffer);
+        caches.bindMeshBuffer(mMeshBuffer);
+        glBufferData(GL_ARRAY_BUFFER, mMeshBufferSize, NULL, GL_DYNAMIC_DRAW);
+        caches.resetVertexPointers();
+
+        BufferBlock block;
+        block.offset = 0;
+        block.size = mMeshBufferSize;
+        mFreeBlocks.add(block);
+    }
+
+    uint32_t offset;
+    while (!allocateBlock(size, &offset)) {
+        // The buffer is entirely free once the cache is empty
+        mCache.removeOldest();
+    }
+
+    mesh->meshBuffer = mMeshBuffer;
+    mesh->meshOffset = offset;
+}
+
+bool PatchCache::allocateBlock(uint32_t size, uint32_t* offset) {
+    const size_t count = mFreeBlocks.size();
     for (size_t i = 0; i < count; i++) {
-        delete mCache.valueAt(i);
+        BufferBlock& block = mFreeBlocks.editItemAt(i);
+        if (block.size >= size) {
+            *offset = block.offset;
+            block.offset += size;
+            block.size -= size;
+            if (block.size == 0) {
+                mFreeBlocks.removeAt(i);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void PatchCache::freeBlock(uint32_t offset, uint32_t size) {
+    size_t index = 0;
+    const size_t count = mFreeBlocks.size();
+    while (index < count && mFreeBlocks.itemAt(index).offset < offset) {
+        index++;
+    }
+
+    // Merge with the following block
+    if (index < count && mFreeBlocks.itemAt(index).offset == offset + size) {
+        BufferBlock& next = mFreeBlocks.editItemAt(index);
+        next.offset = offset;
+        next.size += size;
+    } else {
+        BufferBlock block;
+        block.offset = offset;
+        block.size = size;
+        mFreeBlocks.insertAt(block, index);
+    }
+
+    // Merge with the previous block
+    if (index > 0) {
+        BufferBlock& previous = mFreeBlocks.editItemAt(index - 1);
+        const BufferBlock& block = mFreeBlocks.itemAt(index);
+        if (previous.offset + previous.size == block.offset) {
+            previous.size += block.size;
+            mFreeBlocks.removeAt(index);
+        }
     }
-    mCache.clear();
 }
 
+uint32_t PatchCache::hashDivs(const int32_t* xDivs, uint32_t xCount,
+        const int32_t* yDivs, uint32_t yCount) {
+    uint32_t hash = 0;
+    for (uint32_t i = 0; i < xCount; i++) {
+        hash = hash * 31 + xDivs[i];
+    }
+    for (uint32_t i = 0; i < yCount; i++) {
+        hash = hash * 31 + yDivs[i];
+    }
+    return hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Meshes
+///////////////////////////////////////////////////////////////////////////////
+
 Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
         const float pixelWidth, const float pixelHeight,
         const int32_t* xDivs, const int32_t* yDivs, const uint32_t* colors,
@@ -72,36 +201,36 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
         return NULL;
     }
 
-    const PatchDescription description(bitmapWidth, bitmapHeight,
-            pixelWidth, pixelHeight, width, height, transparentQuads, colorKey);
+    const PatchDescription description(bitmapWidth, bitmapHeight, width, height,
+            hashDivs(xDivs, width, yDivs, height), transparentQuads, colorKey);
 
-    ssize_t index = mCache.indexOfKey(description);
-    Patch* mesh = NULL;
-    if (index >= 0) {
-        mesh = mCache.valueAt(index);
-    }
+    Patch* mesh = mCache.get(description);
+    mAccessCount++;
 
     if (!mesh) {
         PATCH_LOGD("New patch mesh "
-                "xCount=%d yCount=%d, w=%.2f h=%.2f, bw=%.2f bh=%.2f",
-                width, height, pixelWidth, pixelHeight, bitmapWidth, bitmapHeight);
+                "xCount=%d yCount=%d, bw=%.2f bh=%.2f",
+                width, height, bitmapWidth, bitmapHeight);
 
         mesh = new Patch(width, height, transparentQuads);
         mesh->updateColorKey(colorKey);
         mesh->copy(xDivs, yDivs);
-        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
-
-        if (mCache.size() >= mMaxEntries) {
-            delete mCache.valueAt(mCache.size() - 1);
-            mCache.removeItemsAt(mCache.size() - 1, 1);
+        setupMesh(mesh);
+
+        // The least recently used patch is evicted if the cache is full
+        mCache.put(description, mesh);
+        mMemorySize += mesh->getSize();
+        Caches::getInstance().frameStats.countCacheMiss();
+    } else {
+        Caches::getInstance().frameStats.countCacheHit();
+        if (!mesh->matches(xDivs, yDivs, colorKey)) {
+            PATCH_LOGD("Patch mesh does not match, refreshing vertices");
         }
-
-        mCache.add(description, mesh);
-    } else if (!mesh->matches(xDivs, yDivs, colorKey)) {
-        PATCH_LOGD("Patch mesh does not match, refreshing vertices");
-        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
     }
 
+    // No-op unless the size or the divs changed since the mesh was generated
+    mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
+
     return mesh;
 }
 
@@ -17,9 +17,8 @@
 #ifndef ANDROID_HWUI_PATCH_CACHE_H
 #define ANDROID_HWUI_PATCH_CACHE_H
 
-#include <utils/KeyedVector.h>
-
 #include "utils/Compare.h"
+#include "utils/GenerationCache.h"
 #include "Debug.h"
 #include "Patch.h"
 
@@ -41,16 +40,84 @@ namespace uirenderer {
 // Cache
 ///////////////////////////////////////////////////////////////////////////////
 
-class PatchCache {
+/**
+ * Description of a patch. The description does not depend on the size the
+ * patch is drawn at: a patch drawn at several sizes shares a single mesh.
+ */
+struct PatchDescription {
+    PatchDescription(): bitmapWidth(0), bitmapHeight(0), xCount(0), yCount(0),
+            divsHash(0), emptyCount(0), colorKey(0) {
+    }
+
+    PatchDescription(const float bitmapWidth, const float bitmapHeight,
+            const uint32_t xCount, const uint32_t yCount, const uint32_t divsHash,
+            const int8_t emptyCount, const uint32_t colorKey):
+            bitmapWidth(bitmapWidth), bitmapHeight(bitmapHeight),
+            xCount(xCount), yCount(yCount), divsHash(divsHash),
+            emptyCount(emptyCount), colorKey(colorKey) {
+    }
+
+    bool operator<(const PatchDescription& rhs) const {
+        LTE_FLOAT(bitmapWidth) {
+            LTE_FLOAT(bitmapHeight) {
+                LTE_INT(xCount) {
+                    LTE_INT(yCount) {
+                        LTE_INT(divsHash) {
+                            LTE_INT(emptyCount) {
+                                LTE_INT(colorKey) return false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    float bitmapWidth;
+    float bitmapHeight;
+    uint32_t xCount;
+    uint32_t yCount;
+    // Two sets of divs may share a hash, Patch::matches() tells them apart
+    uint32_t divsHash;
+    int8_t emptyCount;
+    uint32_t colorKey;
+
+}; // struct PatchDescription
+
+/**
+ * A simple LRU cache of patches. The vertices of all the cached meshes are
+ * stored in a single VBO, each mesh owning a range of that VBO. A mesh is
+ * generated again in its range whenever the patch is drawn at a new size.
+ * The least recently used mesh is discarded when the cache is full or when
+ * no range of the VBO is large enough for a new mesh.
+ */
+class PatchCache: public OnEntryRemoved<PatchDescription, Patch*> {
 public:
     PatchCache();
     PatchCache(uint32_t maxCapacity);
     ~PatchCache();
 
+    /**
+     * Used as a callback when an entry is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(PatchDescription& description, Patch*& mesh);
+
+    /**
+     * Returns the mesh for the specified patch, laid out for the specified
+     * size. The returned mesh remains valid until it is evicted. Its
+     * vertices are only valid until the next call to get().
+     */
     Patch* get(const float bitmapWidth, const float bitmapHeight,
             const float pixelWidth, const float pixelHeight,
             const int32_t* xDivs, const int32_t* yDivs, const uint32_t* colors,
             const uint32_t width, const uint32_t height, const int8_t numColors);
+
+    /**
+     * Discards all the meshes and the VBO that holds them.
+     */
     void clear();
 
     uint32_t getSize() const {
@@ -61,58 +128,61 @@ public:
         return mMaxEntries;
     }
 
-private:
     /**
-     * Description of a patch.
+     * Returns the memory used by the cached meshes, in bytes.
      */
-    struct PatchDescription {
-        PatchDescription(): bitmapWidth(0), bitmapHeight(0), pixelWidth(0), pixelHeight(0),
-                xCount(0), yCount(0), emptyCount(0), colorKey(0) {
-        }
+    uint32_t getMemorySize() const {
+        return mMemorySize;
+    }
 
-        PatchDescription(const float bitmapWidth, const float bitmapHeight,
-                const float pixelWidth, const float pixelHeight,
-                const uint32_t xCount, const uint32_t yCount,
-                const int8_t emptyCount, const uint32_t colorKey):
-                bitmapWidth(bitmapWidth), bitmapHeight(bitmapHeight),
-                pixelWidth(pixelWidth), pixelHeight(pixelHeight),
-                xCount(xCount), yCount(yCount),
-                emptyCount(emptyCount), colorKey(colorKey) {
-        }
+    /**
+     * Returns the memory the cached meshes can use, in bytes. Like
+     * getMemorySize(), this counts both the vertex arrays and the VBO.
+     * A mesh too large for the VBO may exceed this limit.
+     */
+    uint32_t getMaxMemorySize() const {
+        return mMeshBufferSize * 2;
+    }
 
-        bool operator<(const PatchDescription& rhs) const {
-            LTE_FLOAT(bitmapWidth) {
-                LTE_FLOAT(bitmapHeight) {
-                    LTE_FLOAT(pixelWidth) {
-                        LTE_FLOAT(pixelHeight) {
-                            LTE_INT(xCount) {
-                                LTE_INT(yCount) {
-                                    LTE_INT(emptyCount) {
-                                        LTE_INT(colorKey) return false;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            return false;
-        }
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
+
+    /**
+     * Evicts the least recently used meshes until the cache uses at most
+     * the specified number of bytes.
+     */
+    void trimToMemorySize(uint32_t memorySize);
+
+private:
+    /**
+     * A free range of the mesh VBO.
+     */
+    struct BufferBlock {
+        uint32_t offset;
+        uint32_t size;
+    };
 
-    private:
-        float bitmapWidth;
-        float bitmapHeight;
-        float pixelWidth;
-        float pixelHeight;
-        uint32_t xCount;
-        uint32_t yCount;
-        int8_t emptyCount;
-        uint32_t colorKey;
+    void setupMesh(Patch* mesh);
+    bool allocateBlock(uint32_t size, uint32_t* offset);
+    void freeBlock(uint32_t offset, uint32_t size);
 
-    }; // struct PatchDescription
+    static uint32_t hashDivs(const int32_t* xDivs, uint32_t xCount,
+            const int32_t* yDivs, uint32_t yCount);
 
     uint32_t mMaxEntries;
-    KeyedVector<PatchDescription, Patch*> mCache;
+    uint32_t mMemorySize;
+    uint32_t mAccessCount;
+    GenerationCache<PatchDescription, Patch*> mCache;
+
+    GLuint mMeshBuffer;
+    uint32_t mMeshBufferSize;
+    // Free ranges of mMeshBuffer, sorted by offset
+    Vector<BufferBlock> mFreeBlocks;
 
 }; // class PatchCache
 
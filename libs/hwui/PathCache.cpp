@@ -18,6 +18,7 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "PathCache.h"
 #include "Properties.h"
 
@@ -88,22 +89,22 @@ void PathCache::clearGarbage() {
 }
 
 PathTexture* PathCache::get(SkPath* path, SkPaint* paint) {
-    const SkPath* sourcePath = path->getSourcePath();
-    if (sourcePath && sourcePath->getGenerationID() == path->getGenerationID()) {
-        path = const_cast<SkPath*>(sourcePath);
-    }
-
     PathCacheEntry entry(path, paint);
     PathTexture* texture = mCache.get(entry);
+    mAccessCount++;
 
     float left, top, offset;
     uint32_t width, height;
 
     if (!texture) {
+        Caches::getInstance().frameStats.countCacheMiss();
         texture = addTexture(entry, path, paint);
     } else if (path->getGenerationID() != texture->generation) {
+        Caches::getInstance().frameStats.countCacheMiss();
         mCache.remove(entry);
         texture = addTexture(entry, path, paint);
+    } else {
+        Caches::getInstance().frameStats.countCacheHit();
     }
 
     return texture;
@@ -372,9 +372,11 @@ Program* ProgramCache::get(const ProgramDescription& description) {
     Program* program = NULL;
     if (index < 0) {
         description.log("Could not find program");
+        Caches::getInstance().frameStats.countCacheMiss();
         program = generateProgram(description, key);
         mCache.add(key, program);
     } else {
+        Caches::getInstance().frameStats.countCacheHit();
         program = mCache.valueAt(index);
     }
     return program;
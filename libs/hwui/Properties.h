@@ -31,16 +31,13 @@
 // If turned on, text is interpreted as glyphs instead of UTF-16
 #define RENDER_TEXT_AS_GLYPHS 1
 
-// Indicates whether to remove the biggest layers first, or the smaller ones
-#define LAYER_REMOVE_BIGGEST_FIRST 0
-
 // Textures used by layers must have dimensions multiples of this number
 #define LAYER_SIZE 64
 
 // Defines the size in bits of the stencil buffer
 // Note: Only 1 bit is required for clipping but more bits are required
 // to properly implement the winding fill rule when rasterizing paths
-#define STENCIL_BUFFER_SIZE 0
+#define STENCIL_BUFFER_SIZE 8
 
 /**
  * Debug level for app developers.
@@ -57,6 +54,18 @@ enum DebugLevel {
     kDebugMoreCaches = kDebugMemory | kDebugCaches
 };
 
+/**
+ * Used to enable GPU timing of frames with GL_EXT_disjoint_timer_query.
+ * Timer queries are not free on every driver, they are disabled by default.
+ */
+#define PROPERTY_GPU_FRAME_TIMING "hwui.gpu_frame_timing"
+
+/**
+ * Used to disable the background upload of the textures of bitmaps
+ * referenced by newly recorded display lists. Enabled by default.
+ */
+#define PROPERTY_ASYNC_TEXTURE_UPLOAD "hwui.async_texture_upload"
+
 // These properties are defined in mega-bytes
 #define PROPERTY_TEXTURE_CACHE_SIZE "ro.hwui.texture_cache_size"
 #define PROPERTY_LAYER_CACHE_SIZE "ro.hwui.layer_cache_size"
@@ -65,6 +74,10 @@ enum DebugLevel {
 #define PROPERTY_SHAPE_CACHE_SIZE "ro.hwui.shape_cache_size"
 #define PROPERTY_DROP_SHADOW_CACHE_SIZE "ro.hwui.drop_shadow_cache_size"
 #define PROPERTY_FBO_CACHE_SIZE "ro.hwui.fbo_cache_size"
+// Maximum combined size of the texture, layer, path, shape, gradient, drop
+// shadow and patch caches. The font renderers are not included. Defaults to
+// a fraction of the sum of the individual cache sizes
+#define PROPERTY_MEMORY_BUDGET "ro.hwui.memory_budget"
 
 // These properties are defined in percentage (range 0..1)
 #define PROPERTY_TEXTURE_CACHE_FLUSH_RATE "ro.hwui.texture_cache_flush_rate"
@@ -89,12 +102,17 @@ enum DebugLevel {
 #define DEFAULT_PATH_CACHE_SIZE 4.0f
 #define DEFAULT_SHAPE_CACHE_SIZE 1.0f
 #define DEFAULT_PATCH_CACHE_SIZE 512
+// Size in bytes of the VBO holding the meshes of the patch cache
+#define DEFAULT_PATCH_MESH_BUFFER_SIZE 256 * 1024
 #define DEFAULT_GRADIENT_CACHE_SIZE 0.5f
 #define DEFAULT_DROP_SHADOW_CACHE_SIZE 2.0f
 #define DEFAULT_FBO_CACHE_SIZE 16
 
 #define DEFAULT_TEXTURE_CACHE_FLUSH_RATE 0.6f
 
+// Fraction of the sum of the cache sizes used as the default memory budget
+#define DEFAULT_MEMORY_BUDGET_RATIO 0.75f
+
 #define DEFAULT_TEXT_GAMMA 1.4f
 #define DEFAULT_TEXT_BLACK_GAMMA_THRESHOLD 64
 #define DEFAULT_TEXT_WHITE_GAMMA_THRESHOLD 192
@@ -0,0 +1,457 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+#include <private/hwui/DrawGlInfo.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "OpenGLRenderer.h"
+#include "RenderThread.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Delay before invoking the functors that requested it, as HardwareRenderer does
+#define FUNCTOR_PROCESS_DELAY milliseconds(4)
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+sp<RenderThread> RenderThread::create(EGLDisplay display, EGLSurface surface,
+        EGLContext context) {
+    sp<RenderThread> thread = new RenderThread(display, surface, context);
+    if (thread->run("hwuiRenderThread", ANDROID_PRIORITY_DISPLAY) != NO_ERROR) {
+        ALOGW("Could not start the render thread");
+        return NULL;
+    }
+
+    Mutex::Autolock _l(thread->mLock);
+    while (thread->mState == kState_Starting) {
+        thread->mCondition.wait(thread->mLock);
+    }
+
+    if (thread->mState != kState_Running) {
+        return NULL;
+    }
+    return thread;
+}
+
+RenderThread::RenderThread(EGLDisplay display, EGLSurface surface, EGLContext context):
+        Thread(false), mDisplay(display), mSurface(surface), mContext(context),
+        mRenderer(NULL), mLastDisplayList(NULL), mLastOpaque(false), mFunctorsPending(false),
+        mDisplayList(NULL), mOpaque(false), mWidth(0), mHeight(0),
+        mViewportDirty(false), mFramePending(false), mFramesQueued(0), mFramesDrawn(0),
+        mState(kState_Starting) {
+}
+
+RenderThread::~RenderThread() {
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// UI thread
+///////////////////////////////////////////////////////////////////////////////
+
+void RenderThread::setViewport(int width, int height) {
+    Mutex::Autolock _l(mLock);
+    mWidth = width;
+    mHeight = height;
+    mViewportDirty = true;
+}
+
+void RenderThread::postUpdate(UpdateType type, DisplayList* displayList) {
+    Update update;
+    update.type = type;
+    update.displayList = displayList;
+    update.property = kProperty_Alpha;
+    update.value = 0.0f;
+    update.other = NULL;
+    update.slot = 0;
+    update.color = 0;
+    update.bitmap = NULL;
+    mUpdates.push(update);
+}
+
+void RenderThread::setViewProperty(DisplayList* displayList, Property property, float value) {
+    Mutex::Autolock _l(mLock);
+    postUpdate(kUpdate_Property, displayList);
+    Update& update = mUpdates.editTop();
+    update.property = property;
+    update.value = value;
+}
+
+DisplayList* RenderThread::getDisplayList(DisplayListRenderer* recorder,
+        DisplayList* displayList) {
+    // The new content is recorded in a display list the render thread
+    // does not know about yet
+    DisplayList* content = recorder->getDisplayList(NULL);
+    if (!displayList) return content;
+
+    Mutex::Autolock _l(mLock);
+    postUpdate(kUpdate_Content, displayList);
+    mUpdates.editTop().other = content;
+    return displayList;
+}
+
+const DisplayList* RenderThread::getPendingContent(DisplayList* displayList) const {
+    // Patches refer to the slots of the last content posted for the display list
+    for (size_t i = mUpdates.size(); i > 0; i--) {
+        const Update& update = mUpdates.itemAt(i - 1);
+        if (update.type == kUpdate_Content && update.displayList == displayList) {
+            return update.other;
+        }
+    }
+    return displayList;
+}
+
+bool RenderThread::patchDisplayList(DisplayList* displayList, size_t slot, DisplayList* child) {
+    Mutex::Autolock _l(mLock);
+    const DisplayList* content = getPendingContent(displayList);
+    if (slot >= content->getPatchSlotCount() ||
+            content->getPatchSlotType(slot) != DisplayList::kPatchSlot_DisplayList) {
+        return false;
+    }
+
+    postUpdate(kUpdate_PatchDisplayList, displayList);
+    Update& update = mUpdates.editTop();
+    update.slot = slot;
+    update.other = child;
+    return true;
+}
+
+bool RenderThread::patchColor(DisplayList* displayList, size_t slot, int color) {
+    Mutex::Autolock _l(mLock);
+    const DisplayList* content = getPendingContent(displayList);
+    if (slot >= content->getPatchSlotCount()) return false;
+
+    const DisplayList::PatchSlotType type = content->getPatchSlotType(slot);
+    if (type != DisplayList::kPatchSlot_Color && type != DisplayList::kPatchSlot_Paint) {
+        return false;
+    }
+
+    postUpdate(kUpdate_PatchColor, displayList);
+    Update& update = mUpdates.editTop();
+    update.slot = slot;
+    update.color = color;
+    return true;
+}
+
+bool RenderThread::patchBitmap(DisplayList* displayList, size_t slot, SkBitmap* bitmap) {
+    Mutex::Autolock _l(mLock);
+    // The render thread only modifies display lists while holding mLock,
+    // and a bitmap patch never changes the dimensions of a slot
+    if (!getPendingContent(displayList)->canPatchBitmap(slot, bitmap)) return false;
+
+    // Keeps the bitmap alive until the patch is applied
+    Caches::getInstance().resourceCache.incrementRefcount(bitmap);
+
+    postUpdate(kUpdate_PatchBitmap, displayList);
+    Update& update = mUpdates.editTop();
+    update.slot = slot;
+    update.bitmap = bitmap;
+    return true;
+}
+
+void RenderThread::destroyDisplayList(DisplayList* displayList) {
+    Mutex::Autolock _l(mLock);
+    postUpdate(kUpdate_Destroy, displayList);
+}
+
+void RenderThread::syncAndDrawFrame(DisplayList* displayList, const Rect& dirty, bool opaque) {
+    Mutex::Autolock _l(mLock);
+    if (mState != kState_Running) return;
+
+    mDisplayList = displayList;
+    mDirty.set(dirty);
+    mOpaque = opaque;
+    mFramePending = true;
+    mFramesQueued++;
+    mCondition.broadcast();
+
+    // Once the render thread has applied the updates, the UI thread is
+    // free to record the next frame
+    while (mFramePending && mState == kState_Running) {
+        mCondition.wait(mLock);
+    }
+}
+
+void RenderThread::finishFrames() {
+    Mutex::Autolock _l(mLock);
+    while (mFramesDrawn != mFramesQueued && mState == kState_Running) {
+        mCondition.wait(mLock);
+    }
+}
+
+void RenderThread::terminate() {
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    }
+    join();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render thread
+///////////////////////////////////////////////////////////////////////////////
+
+status_t RenderThread::readyToRun() {
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGW("Could not make the EGL context current on the render thread: 0x%x",
+                eglGetError());
+
+        Mutex::Autolock _l(mLock);
+        mState = kState_Stopped;
+        mCondition.broadcast();
+        return UNKNOWN_ERROR;
+    }
+
+    // The Caches issue GL calls and must be created on this thread
+    Caches::getInstance().init();
+    mRenderer = new OpenGLRenderer();
+
+    Mutex::Autolock _l(mLock);
+    mState = kState_Running;
+    mCondition.broadcast();
+    return NO_ERROR;
+}
+
+bool RenderThread::threadLoop() {
+    bool exit;
+    bool frame;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mFramePending && !exitPending()) {
+            if (!mFunctorsPending) {
+                mCondition.wait(mLock);
+            } else if (mCondition.waitRelative(mLock, FUNCTOR_PROCESS_DELAY) == TIMED_OUT) {
+                break;
+            }
+        }
+
+        exit = exitPending();
+        if (exit) {
+            mState = kState_Stopped;
+            mCondition.broadcast();
+        }
+        frame = mFramePending;
+    }
+
+    if (exit) {
+        release();
+        return false;
+    }
+
+    if (frame) {
+        drawFrame();
+    } else {
+        invokeFunctors();
+    }
+    return true;
+}
+
+void RenderThread::drawFrame() {
+    DisplayList* displayList;
+    Rect dirty;
+    bool opaque;
+    bool viewportDirty;
+    int width, height;
+    {
+        // The updates are cheap to apply and the UI thread waits for them,
+        // this is the only time the render thread holds the lock
+        Mutex::Autolock _l(mLock);
+        for (size_t i = 0; i < mUpdates.size(); i++) {
+            applyUpdate(mUpdates.itemAt(i));
+        }
+        mUpdates.clear();
+
+        displayList = mDisplayList;
+        dirty.set(mDirty);
+        opaque = mOpaque;
+        viewportDirty = mViewportDirty;
+        width = mWidth;
+        height = mHeight;
+
+        mDisplayList = NULL;
+        mViewportDirty = false;
+        mFramePending = false;
+        mCondition.broadcast();
+    }
+
+    if (viewportDirty) {
+        mRenderer->setViewport(width, height);
+    }
+
+    mLastDisplayList = displayList;
+    mLastOpaque = opaque;
+    renderFrame(displayList, dirty, opaque);
+
+    Mutex::Autolock _l(mLock);
+    mFramesDrawn++;
+    mCondition.broadcast();
+}
+
+void RenderThread::renderFrame(DisplayList* displayList, const Rect& dirty, bool opaque) {
+    mRenderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom, opaque);
+    if (displayList) {
+        Rect redraw;
+        status_t status = mRenderer->drawDisplayList(displayList, redraw,
+                DisplayList::kReplayFlag_ClipChildren);
+        if (status & DrawGlInfo::kStatusInvoke) {
+            mFunctorsPending = true;
+        }
+    }
+    mRenderer->finish();
+
+    if (!eglSwapBuffers(mDisplay, mSurface)) {
+        ALOGW("Could not swap buffers on the render thread: 0x%x", eglGetError());
+    }
+}
+
+void RenderThread::invokeFunctors() {
+    Rect dirty;
+    status_t status = mRenderer->invokeFunctors(dirty);
+    mFunctorsPending = status & DrawGlInfo::kStatusInvoke;
+
+    // The functors changed what they draw, the UI thread has no new frame
+    // to post so the last one is drawn again
+    if ((status & DrawGlInfo::kStatusDraw) && mLastDisplayList) {
+        renderFrame(mLastDisplayList, dirty, mLastOpaque);
+    }
+}
+
+void RenderThread::release() {
+    delete mRenderer;
+    mRenderer = NULL;
+
+    Caches::getInstance().terminate();
+
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
+
+void RenderThread::applyUpdate(const Update& update) {
+    DisplayList* displayList = update.displayList;
+
+    switch (update.type) {
+        case kUpdate_Property:
+            applyProperty(update);
+            break;
+        case kUpdate_Content:
+            displayList->swapContent(update.other);
+            // Now holds the previous content
+            DisplayList::destroyDisplayListDeferred(update.other);
+            break;
+        case kUpdate_PatchDisplayList:
+            displayList->patchDisplayList(update.slot, update.other);
+            break;
+        case kUpdate_PatchColor:
+            displayList->patchColor(update.slot, update.color);
+            break;
+        case kUpdate_PatchBitmap:
+            displayList->patchBitmap(update.slot, update.bitmap);
+            Caches::getInstance().resourceCache.decrementRefcount(update.bitmap);
+            break;
+        case kUpdate_Destroy:
+            if (displayList == mLastDisplayList) {
+                mLastDisplayList = NULL;
+            }
+            // Destroyed with the other garbage when the frame starts
+            DisplayList::destroyDisplayListDeferred(displayList);
+            break;
+    }
+}
+
+void RenderThread::applyProperty(const Update& update) {
+    DisplayList* displayList = update.displayList;
+    const float value = update.value;
+
+    switch (update.property) {
+        case kProperty_Alpha:
+            displayList->setAlpha(value);
+            break;
+        case kProperty_TranslationX:
+            displayList->setTranslationX(value);
+            break;
+        case kProperty_TranslationY:
+            displayList->setTranslationY(value);
+            break;
+        case kProperty_Rotation:
+            displayList->setRotation(value);
+            break;
+        case kProperty_RotationX:
+            displayList->setRotationX(value);
+            break;
+        case kProperty_RotationY:
+            displayList->setRotationY(value);
+            break;
+        case kProperty_ScaleX:
+            displayList->setScaleX(value);
+            break;
+        case kProperty_ScaleY:
+            displayList->setScaleY(value);
+            break;
+        case kProperty_PivotX:
+            displayList->setPivotX(value);
+            break;
+        case kProperty_PivotY:
+            displayList->setPivotY(value);
+            break;
+        case kProperty_CameraDistance:
+            displayList->setCameraDistance(value);
+            break;
+        case kProperty_Left:
+            displayList->setLeft(int(value));
+            break;
+        case kProperty_Top:
+            displayList->setTop(int(value));
+            break;
+        case kProperty_Right:
+            displayList->setRight(int(value));
+            break;
+        case kProperty_Bottom:
+            displayList->setBottom(int(value));
+            break;
+        case kProperty_OffsetLeftRight:
+            displayList->offsetLeftRight(int(value));
+            break;
+        case kProperty_OffsetTopBottom:
+            displayList->offsetTopBottom(int(value));
+            break;
+        case kProperty_ClipChildren:
+            displayList->setClipChildren(value != 0.0f);
+            break;
+        case kProperty_HasOverlappingRendering:
+            displayList->setHasOverlappingRendering(value != 0.0f);
+            break;
+        case kProperty_Caching:
+            displayList->setCaching(value != 0.0f);
+            break;
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_RENDER_THREAD_H
+#define ANDROID_HWUI_RENDER_THREAD_H
+
+#include <EGL/egl.h>
+
+#include <cutils/compiler.h>
+
+#include <SkBitmap.h>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
+#include <utils/Thread.h>
+#include <utils/Vector.h>
+
+#include "Rect.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+class DisplayListRenderer;
+class OpenGLRenderer;
+
+/**
+ * Replays display lists on a dedicated thread. The render thread owns the
+ * EGL context and, as a consequence, the Caches: once a render thread is
+ * created, no other thread may issue GL calls.
+ *
+ * The UI thread records display lists as usual and hands each frame over
+ * with syncAndDrawFrame(), which returns as soon as the render thread has
+ * started drawing the frame. The UI thread can then record the next frame
+ * while the current one is being submitted to the GPU.
+ *
+ * The UI thread never modifies a display list the render thread may be
+ * drawing. Property changes, new content and patches are posted instead
+ * and applied by the render thread when it picks up the frame they belong
+ * to. The render thread only holds its lock during this handoff, never
+ * while it replays the display lists. Display lists must be destroyed
+ * with destroyDisplayList().
+ *
+ * Functors asking to be invoked again (DrawGlInfo::kStatusInvoke) are
+ * processed by the render thread between frames. When they request a
+ * redraw, the last frame is drawn again.
+ */
+class RenderThread: public Thread {
+public:
+    enum Property {
+        kProperty_Alpha = 0,
+        kProperty_TranslationX,
+        kProperty_TranslationY,
+        kProperty_Rotation,
+        kProperty_RotationX,
+        kProperty_RotationY,
+        kProperty_ScaleX,
+        kProperty_ScaleY,
+        kProperty_PivotX,
+        kProperty_PivotY,
+        kProperty_CameraDistance,
+        kProperty_Left,
+        kProperty_Top,
+        kProperty_Right,
+        kProperty_Bottom,
+        kProperty_OffsetLeftRight,
+        kProperty_OffsetTopBottom,
+        kProperty_ClipChildren,
+        kProperty_HasOverlappingRendering,
+        kProperty_Caching
+    };
+
+    /**
+     * Creates and starts a render thread drawing into the specified surface.
+     * The context must not be current on any thread and the Caches must not
+     * have been initialized by another thread. Returns NULL if the context
+     * could not be made current on the render thread.
+     */
+    ANDROID_API static sp<RenderThread> create(EGLDisplay display, EGLSurface surface,
+            EGLContext context);
+
+    ANDROID_API virtual ~RenderThread();
+
+    /**
+     * Sets the size of the surface, applied with the next frame.
+     */
+    ANDROID_API void setViewport(int width, int height);
+
+    /**
+     * Posts the new value of a property of the specified display list. The
+     * value is applied with the next frame. Integer and boolean properties
+     * are truncated, any non-zero value is true.
+     */
+    ANDROID_API void setViewProperty(DisplayList* displayList, Property property, float value);
+
+    /**
+     * Returns a display list holding the commands recorded by the specified
+     * recorder. If displayList is not NULL, its content is replaced with
+     * the next frame and its view properties are reset. Replaces
+     * DisplayListRenderer::getDisplayList() in render thread mode.
+     */
+    ANDROID_API DisplayList* getDisplayList(DisplayListRenderer* recorder,
+            DisplayList* displayList);
+
+    /**
+     * Posts a patch of the specified display list, applied with the next
+     * frame. The slots are those of the content last posted with
+     * getDisplayList(). Returns false, without posting anything, if the
+     * corresponding DisplayList patch would fail.
+     */
+    ANDROID_API bool patchDisplayList(DisplayList* displayList, size_t slot, DisplayList* child);
+    ANDROID_API bool patchColor(DisplayList* displayList, size_t slot, int color);
+    ANDROID_API bool patchBitmap(DisplayList* displayList, size_t slot, SkBitmap* bitmap);
+
+    /**
+     * Destroys the specified display list once the updates posted before
+     * this call have been applied. Replaces destroyDisplayListDeferred()
+     * in render thread mode.
+     */
+    ANDROID_API void destroyDisplayList(DisplayList* displayList);
+
+    /**
+     * Hands the specified frame over to the render thread and waits until
+     * the render thread has applied the updates posted for this frame.
+     */
+    ANDROID_API void syncAndDrawFrame(DisplayList* displayList, const Rect& dirty, bool opaque);
+
+    /**
+     * Waits until the last frame handed over to the render thread has been
+     * drawn and swapped.
+     */
+    ANDROID_API void finishFrames();
+
+    /**
+     * Stops the render thread, destroys its renderer, terminates the Caches
+     * and releases the EGL context.
+     */
+    ANDROID_API void terminate();
+
+private:
+    enum State {
+        kState_Starting = 0,
+        kState_Running,
+        kState_Stopped
+    };
+
+    enum UpdateType {
+        kUpdate_Property = 0,
+        kUpdate_Content,
+        kUpdate_PatchDisplayList,
+        kUpdate_PatchColor,
+        kUpdate_PatchBitmap,
+        kUpdate_Destroy
+    };
+
+    struct Update {
+        UpdateType type;
+        DisplayList* displayList;
+        Property property;
+        float value;
+        // New content (kUpdate_Content) or child (kUpdate_PatchDisplayList)
+        DisplayList* other;
+        size_t slot;
+        int color;
+        SkBitmap* bitmap;
+    };
+
+    RenderThread(EGLDisplay display, EGLSurface surface, EGLContext context);
+
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+
+    void postUpdate(UpdateType type, DisplayList* displayList);
+    const DisplayList* getPendingContent(DisplayList* displayList) const;
+
+    void drawFrame();
+    void renderFrame(DisplayList* displayList, const Rect& dirty, bool opaque);
+    void invokeFunctors();
+    void release();
+
+    void applyUpdate(const Update& update);
+    static void applyProperty(const Update& update);
+
+    EGLDisplay mDisplay;
+    EGLSurface mSurface;
+    EGLContext mContext;
+
+    // Only accessed from the render thread
+    OpenGLRenderer* mRenderer;
+    DisplayList* mLastDisplayList;
+    bool mLastOpaque;
+    bool mFunctorsPending;
+
+    // The following fields are protected by mLock
+    Vector<Update> mUpdates;
+    DisplayList* mDisplayList;
+    Rect mDirty;
+    bool mOpaque;
+    int mWidth;
+    int mHeight;
+    bool mViewportDirty;
+    bool mFramePending;
+    uint32_t mFramesQueued;
+    uint32_t mFramesDrawn;
+    State mState;
+
+    Mutex mLock;
+    Condition mCondition;
+}; // class RenderThread
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_RENDER_THREAD_H
@@ -16,11 +16,24 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include "Caches.h"
 #include "ShapeCache.h"
 
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Statistics
+///////////////////////////////////////////////////////////////////////////////
+
+static inline void countLookup(PathTexture* texture) {
+    if (texture) {
+        Caches::getInstance().frameStats.countCacheHit();
+    } else {
+        Caches::getInstance().frameStats.countCacheMiss();
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Rounded rects
 ///////////////////////////////////////////////////////////////////////////////
@@ -33,6 +46,7 @@ PathTexture* RoundRectShapeCache::getRoundRect(float width, float height,
         float rx, float ry, SkPaint* paint) {
     RoundRectShapeCacheEntry entry(width, height, rx, ry, paint);
     PathTexture* texture = get(entry);
+    countLookup(texture);
 
     if (!texture) {
         SkPath path;
@@ -57,6 +71,7 @@ CircleShapeCache::CircleShapeCache(): ShapeCache<CircleShapeCacheEntry>(
 PathTexture* CircleShapeCache::getCircle(float radius, SkPaint* paint) {
     CircleShapeCacheEntry entry(radius, paint);
     PathTexture* texture = get(entry);
+    countLookup(texture);
 
     if (!texture) {
         SkPath path;
@@ -79,6 +94,7 @@ OvalShapeCache::OvalShapeCache(): ShapeCache<OvalShapeCacheEntry>(
 PathTexture* OvalShapeCache::getOval(float width, float height, SkPaint* paint) {
     OvalShapeCacheEntry entry(width, height, paint);
     PathTexture* texture = get(entry);
+    countLookup(texture);
 
     if (!texture) {
         SkPath path;
@@ -103,6 +119,7 @@ RectShapeCache::RectShapeCache(): ShapeCache<RectShapeCacheEntry>(
 PathTexture* RectShapeCache::getRect(float width, float height, SkPaint* paint) {
     RectShapeCacheEntry entry(width, height, paint);
     PathTexture* texture = get(entry);
+    countLookup(texture);
 
     if (!texture) {
         SkRect bounds;
@@ -145,6 +162,7 @@ PathTexture* ArcShapeCache::getArc(float width, float height,
         float startAngle, float sweepAngle, bool useCenter, SkPaint* paint) {
     ArcShapeCacheEntry entry(width, height, startAngle, sweepAngle, useCenter, paint);
     PathTexture* texture = get(entry);
+    countLookup(texture);
 
     if (!texture) {
         SkPath path;
@@ -333,6 +333,13 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
 
 protected:
     PathTexture* addTexture(const Entry& entry, const SkPath *path, const SkPaint* paint);
@@ -351,6 +358,7 @@ protected:
     bool checkTextureSize(uint32_t width, uint32_t height);
 
     PathTexture* get(Entry entry) {
+        mAccessCount++;
         return mCache.get(entry);
     }
 
@@ -360,6 +368,7 @@ protected:
     uint32_t mSize;
     uint32_t mMaxSize;
     GLuint mMaxTextureSize;
+    uint32_t mAccessCount;
 
     char* mName;
     bool mDebugEnabled;
@@ -416,7 +425,7 @@ public:
 template<class Entry>
 ShapeCache<Entry>::ShapeCache(const char* name, const char* propertyName, float defaultSize):
         mCache(GenerationCache<ShapeCacheEntry, PathTexture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(defaultSize)) {
+        mSize(0), mMaxSize(MB(defaultSize)), mAccessCount(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(propertyName, property, NULL) > 0) {
         INIT_LOGD("  Setting %s cache size to %sMB", name, property);
@@ -17,6 +17,7 @@
 #include "Snapshot.h"
 
 #include <SkCanvas.h>
+#include <SkPath.h>
 
 namespace android {
 namespace uirenderer {
@@ -57,7 +58,7 @@ Snapshot::Snapshot(const sp<Snapshot>& s, int saveFlags):
         clipRect = &mClipRectRoot;
 #if STENCIL_BUFFER_SIZE
         if (s->clipRegion) {
-            mClipRegionRoot.merge(*s->clipRegion);
+            mClipRegionRoot = *s->clipRegion;
             clipRegion = &mClipRegionRoot;
         }
 #endif
@@ -80,12 +81,43 @@ Snapshot::Snapshot(const sp<Snapshot>& s, int saveFlags):
 // Clipping
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * A snapshot saved without kClip_SaveFlag shares the clip of its parent.
+ * The clip region and the clip rect it is bounded by are copied into this
+ * snapshot before the region is modified, so that the parent's clip is
+ * left untouched.
+ */
+void Snapshot::copyClipOnWrite() {
+#if STENCIL_BUFFER_SIZE
+    if (clipRect != &mClipRectRoot) {
+        mClipRectRoot.set(*clipRect);
+        clipRect = &mClipRectRoot;
+    }
+    if (clipRegion && clipRegion != &mClipRegionRoot) {
+        mClipRegionRoot = *clipRegion;
+        clipRegion = &mClipRegionRoot;
+    }
+#endif
+}
+
+/**
+ * Drops the clip region. A region owned by another snapshot is left as is.
+ */
+void Snapshot::releaseClipRegion() {
+#if STENCIL_BUFFER_SIZE
+    if (clipRegion == &mClipRegionRoot) {
+        clipRegion->setEmpty();
+    }
+    clipRegion = NULL;
+#endif
+}
+
 void Snapshot::ensureClipRegion() {
 #if STENCIL_BUFFER_SIZE
     if (!clipRegion) {
+        copyClipOnWrite();
         clipRegion = &mClipRegionRoot;
-        android::Rect tmp(clipRect->left, clipRect->top, clipRect->right, clipRect->bottom);
-        clipRegion->set(tmp);
+        clipRegion->setRect(clipRect->left, clipRect->top, clipRect->right, clipRect->bottom);
     }
 #endif
 }
@@ -93,24 +125,27 @@ void Snapshot::ensureClipRegion() {
 void Snapshot::copyClipRectFromRegion() {
 #if STENCIL_BUFFER_SIZE
     if (!clipRegion->isEmpty()) {
-        android::Rect bounds(clipRegion->bounds());
-        clipRect->set(bounds.left, bounds.top, bounds.right, bounds.bottom);
+        const SkIRect& bounds = clipRegion->getBounds();
+        clipRect->set(bounds.fLeft, bounds.fTop, bounds.fRight, bounds.fBottom);
 
         if (clipRegion->isRect()) {
-            clipRegion->clear();
-            clipRegion = NULL;
+            releaseClipRegion();
         }
     } else {
         clipRect->setEmpty();
-        clipRegion = NULL;
+        releaseClipRegion();
     }
 #endif
 }
 
-bool Snapshot::clipRegionOr(float left, float top, float right, float bottom) {
+bool Snapshot::clipRegionOp(float left, float top, float right, float bottom, SkRegion::Op op) {
 #if STENCIL_BUFFER_SIZE
-    android::Rect tmp(left, top, right, bottom);
-    clipRegion->orSelf(tmp);
+    SkRect rect;
+    rect.set(left, top, right, bottom);
+    SkIRect tmp;
+    rect.roundOut(&tmp);
+    copyClipOnWrite();
+    clipRegion->op(tmp, op);
     copyClipRectFromRegion();
     return true;
 #else
@@ -118,10 +153,10 @@ bool Snapshot::clipRegionOr(float left, float top, float right, float bottom) {
 #endif
 }
 
-bool Snapshot::clipRegionXor(float left, float top, float right, float bottom) {
+bool Snapshot::clipRegionOp(const SkRegion& region, SkRegion::Op op) {
 #if STENCIL_BUFFER_SIZE
-    android::Rect tmp(left, top, right, bottom);
-    clipRegion->xorSelf(tmp);
+    copyClipOnWrite();
+    clipRegion->op(region, op);
     copyClipRectFromRegion();
     return true;
 #else
@@ -129,29 +164,47 @@ bool Snapshot::clipRegionXor(float left, float top, float right, float bottom) {
 #endif
 }
 
-bool Snapshot::clipRegionAnd(float left, float top, float right, float bottom) {
+/**
+ * Clips against a rectangle whose transform does not map rectangles to
+ * rectangles (rotation, skew, perspective.) The transformed rectangle is
+ * rasterized into a region instead of being approximated by its bounds.
+ */
+bool Snapshot::clipPath(float left, float top, float right, float bottom, SkRegion::Op op) {
 #if STENCIL_BUFFER_SIZE
-    android::Rect tmp(left, top, right, bottom);
-    clipRegion->andSelf(tmp);
-    copyClipRectFromRegion();
-    return true;
+    SkMatrix matrix;
+    transform->copyTo(matrix);
+
+    SkPath path;
+    path.addRect(left, top, right, bottom);
+    path.transform(matrix);
+
+    SkIRect bounds;
+    path.getBounds().roundOut(&bounds);
+
+    SkRegion clip(bounds);
+    SkRegion region;
+    region.setPath(path, clip);
+
+    ensureClipRegion();
+    bool clipped = clipRegionOp(region, op);
+
+    if (clipped) {
+        flags |= Snapshot::kFlagClipSet;
+    }
+
+    return clipped;
 #else
     return false;
 #endif
 }
 
-bool Snapshot::clipRegionNand(float left, float top, float right, float bottom) {
+bool Snapshot::clip(float left, float top, float right, float bottom, SkRegion::Op op) {
 #if STENCIL_BUFFER_SIZE
-    android::Rect tmp(left, top, right, bottom);
-    clipRegion->subtractSelf(tmp);
-    copyClipRectFromRegion();
-    return true;
-#else
-    return false;
+    if (CC_UNLIKELY(!transform->isSimple()) && op != SkRegion::kReplace_Op) {
+        return clipPath(left, top, right, bottom, op);
+    }
 #endif
-}
 
-bool Snapshot::clip(float left, float top, float right, float bottom, SkRegion::Op op) {
     Rect r(left, top, right, bottom);
     transform->mapRect(r);
     return clipTransformed(r, op);
@@ -161,14 +214,9 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
     bool clipped = false;
 
     switch (op) {
-        case SkRegion::kDifference_Op: {
-            ensureClipRegion();
-            clipped = clipRegionNand(r.left, r.top, r.right, r.bottom);
-            break;
-        }
         case SkRegion::kIntersect_Op: {
             if (CC_UNLIKELY(clipRegion)) {
-                clipped = clipRegionOr(r.left, r.top, r.right, r.bottom);
+                clipped = clipRegionOp(r.left, r.top, r.right, r.bottom, op);
             } else {
                 clipped = clipRect->intersect(r);
                 if (!clipped) {
@@ -179,25 +227,27 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
             break;
         }
         case SkRegion::kUnion_Op: {
-            if (CC_UNLIKELY(clipRegion)) {
-                clipped = clipRegionAnd(r.left, r.top, r.right, r.bottom);
-            } else {
+            ensureClipRegion();
+            clipped = clipRegionOp(r.left, r.top, r.right, r.bottom, op);
+            if (!clipped) {
+                // Without a stencil buffer the union is approximated by its bounds
                 clipped = clipRect->unionWith(r);
             }
             break;
         }
-        case SkRegion::kXOR_Op: {
-            ensureClipRegion();
-            clipped = clipRegionXor(r.left, r.top, r.right, r.bottom);
+        case SkRegion::kReplace_Op: {
+            setClip(r.left, r.top, r.right, r.bottom);
+            clipped = true;
             break;
         }
+        case SkRegion::kDifference_Op:
+        case SkRegion::kXOR_Op:
         case SkRegion::kReverseDifference_Op: {
-            // TODO!!!!!!!
+            ensureClipRegion();
+            clipped = clipRegionOp(r.left, r.top, r.right, r.bottom, op);
             break;
         }
-        case SkRegion::kReplace_Op: {
-            setClip(r.left, r.top, r.right, r.bottom);
-            clipped = true;
+        default: {
             break;
         }
     }
@@ -211,12 +261,7 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
 
 void Snapshot::setClip(float left, float top, float right, float bottom) {
     clipRect->set(left, top, right, bottom);
-#if STENCIL_BUFFER_SIZE
-    if (clipRegion) {
-        clipRegion->clear();
-        clipRegion = NULL;
-    }
-#endif
+    releaseClipRegion();
     flags |= Snapshot::kFlagClipSet;
 }
 
@@ -27,6 +27,7 @@
 
 #include "Layer.h"
 #include "Matrix.h"
+#include "Properties.h"
 #include "Rect.h"
 
 namespace android {
@@ -191,14 +192,17 @@ public:
 
     /**
      * Current clip region. The clip is stored in canvas-space coordinates,
-     * (screen-space coordinates in the regular case.)
+     * (screen-space coordinates in the regular case.) This field is only
+     * set when the clip cannot be represented by clipRect alone, in which
+     * case clipRect holds the bounds of the region and the renderer
+     * enforces the exact shape with the stencil buffer.
      *
      * This is a reference to a region owned by this snapshot or another
      * snapshot. This pointer must not be freed. See ::mClipRegionRoot.
      *
      * This field is used only if STENCIL_BUFFER_SIZE is > 0.
      */
-    Region* clipRegion;
+    SkRegion* clipRegion;
 
     /**
      * The ancestor layer's dirty region.
@@ -220,20 +224,22 @@ public:
     float alpha;
 
 private:
+    void copyClipOnWrite();
+    void releaseClipRegion();
     void ensureClipRegion();
     void copyClipRectFromRegion();
 
-    bool clipRegionOr(float left, float top, float right, float bottom);
-    bool clipRegionXor(float left, float top, float right, float bottom);
-    bool clipRegionAnd(float left, float top, float right, float bottom);
-    bool clipRegionNand(float left, float top, float right, float bottom);
+    bool clipRegionOp(float left, float top, float right, float bottom, SkRegion::Op op);
+    bool clipRegionOp(const SkRegion& region, SkRegion::Op op);
+
+    bool clipPath(float left, float top, float right, float bottom, SkRegion::Op op);
 
     mat4 mTransformRoot;
     Rect mClipRectRoot;
     Rect mLocalClip;
 
 #if STENCIL_BUFFER_SIZE
-    Region mClipRegionRoot;
+    SkRegion mClipRegionRoot;
 #endif
 
 }; // class Snapshot
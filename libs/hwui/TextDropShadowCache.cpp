@@ -16,6 +16,7 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include "Caches.h"
 #include "Debug.h"
 #include "TextDropShadowCache.h"
 #include "Properties.h"
@@ -29,7 +30,7 @@ namespace uirenderer {
 
 TextDropShadowCache::TextDropShadowCache():
         mCache(GenerationCache<ShadowText, ShadowTexture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(DEFAULT_DROP_SHADOW_CACHE_SIZE)) {
+        mSize(0), mMaxSize(MB(DEFAULT_DROP_SHADOW_CACHE_SIZE)), mAccessCount(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_DROP_SHADOW_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting drop shadow cache size to %sMB", property);
@@ -44,7 +45,7 @@ TextDropShadowCache::TextDropShadowCache():
 
 TextDropShadowCache::TextDropShadowCache(uint32_t maxByteSize):
         mCache(GenerationCache<ShadowText, ShadowTexture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(maxByteSize) {
+        mSize(0), mMaxSize(maxByteSize), mAccessCount(0) {
     init();
 }
 
@@ -105,8 +106,11 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
         int numGlyphs, uint32_t radius) {
     ShadowText entry(paint, radius, len, text);
     ShadowTexture* texture = mCache.get(entry);
+    mAccessCount++;
 
     if (!texture) {
+        Caches::getInstance().frameStats.countCacheMiss();
+
         FontRenderer::DropShadow shadow = mRenderer->renderDropShadow(paint, text, 0,
                 len, numGlyphs, radius);
 
@@ -155,6 +159,8 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
 
         // Cleanup shadow
         delete[] shadow.image;
+    } else {
+        Caches::getInstance().frameStats.countCacheHit();
     }
 
     return texture;
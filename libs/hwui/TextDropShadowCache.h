@@ -140,6 +140,13 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
 
 private:
     void init();
@@ -148,6 +155,7 @@ private:
 
     uint32_t mSize;
     uint32_t mMaxSize;
+    uint32_t mAccessCount;
     FontRenderer* mRenderer;
     bool mDebugEnabled;
 }; // class TextDropShadowCache
@@ -22,6 +22,7 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "TextureCache.h"
 #include "Properties.h"
 
@@ -68,6 +69,8 @@ TextureCache::~TextureCache() {
 
 void TextureCache::init() {
     mCache.setOnEntryRemovedListener(this);
+    mAccessCount = 0;
+    mUploaderThread = 0;
 
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
     INIT_LOGD("    Maximum texture dimension is %d pixels", mMaxTextureSize);
@@ -122,8 +125,11 @@ void TextureCache::operator()(SkBitmap*& bitmap, Texture*& texture) {
 
 Texture* TextureCache::get(SkBitmap* bitmap) {
     Texture* texture = mCache.get(bitmap);
+    mAccessCount++;
 
     if (!texture) {
+        Caches::getInstance().frameStats.countCacheMiss();
+
         if (bitmap->width() > mMaxTextureSize || bitmap->height() > mMaxTextureSize) {
             ALOGW("Bitmap too large to be uploaded into a texture (%dx%d, max=%dx%d)",
                     bitmap->width(), bitmap->height(), mMaxTextureSize, mMaxTextureSize);
@@ -138,9 +144,20 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
             }
         }
 
-        texture = new Texture;
-        texture->bitmapSize = size;
-        generateTexture(bitmap, texture, false);
+        texture = mUploader != NULL ? mUploader->claim(bitmap) : NULL;
+        if (texture) {
+            Caches::getInstance().frameStats.countAsyncTextureUpload();
+            // The bitmap was modified after the upload was queued
+            if (bitmap->getGenerationID() != texture->generation) {
+                generateTexture(bitmap, texture, true);
+                Caches::getInstance().frameStats.countTextureUpload();
+            }
+        } else {
+            texture = new Texture;
+            texture->bitmapSize = size;
+            generateTexture(bitmap, texture, false);
+            Caches::getInstance().frameStats.countTextureUpload();
+        }
 
         if (size < mMaxSize) {
             mSize += size;
@@ -155,6 +172,9 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
         }
     } else if (bitmap->getGenerationID() != texture->generation) {
         generateTexture(bitmap, texture, true);
+        Caches::getInstance().frameStats.countTextureUpload();
+    } else {
+        Caches::getInstance().frameStats.countCacheHit();
     }
 
     return texture;
@@ -166,10 +186,73 @@ Texture* TextureCache::getTransient(SkBitmap* bitmap) {
     texture->cleanup = true;
 
     generateTexture(bitmap, texture, false);
+    Caches::getInstance().frameStats.countTextureUpload();
 
     return texture;
 }
 
+void TextureCache::prefetch(SkBitmap* bitmap) {
+    if (mUploader == NULL) return;
+
+    // The cache can only be inspected from the thread owning the EGL
+    // context, other threads hand the bitmap over to clearGarbage()
+    if (androidGetThreadId() != mUploaderThread) {
+        Caches::getInstance().resourceCache.incrementRefcount(bitmap);
+
+        Mutex::Autolock _l(mLock);
+        mPrefetches.push(bitmap);
+        return;
+    }
+
+    if (bitmap->width() > mMaxTextureSize || bitmap->height() > mMaxTextureSize) {
+        return;
+    }
+
+    const uint32_t size = bitmap->rowBytes() * bitmap->height();
+    if (size >= mMaxSize || mCache.get(bitmap)) {
+        return;
+    }
+
+    mUploader->queue(bitmap, size);
+}
+
+void TextureCache::initUploader() {
+    if (mUploader != NULL) return;
+
+    char property[PROPERTY_VALUE_MAX];
+    property_get(PROPERTY_ASYNC_TEXTURE_UPLOAD, property, "true");
+    if (strcmp(property, "true")) {
+        INIT_LOGD("  Asynchronous texture uploads disabled");
+        return;
+    }
+
+    mUploaderThread = androidGetThreadId();
+    mUploader = TextureUploader::create(*this);
+    if (mUploader != NULL &&
+            mUploader->run("hwuiTextureUploader", ANDROID_PRIORITY_BACKGROUND) != NO_ERROR) {
+        ALOGW("Could not start the texture upload thread");
+        mUploader->terminate();
+        mUploader.clear();
+    }
+}
+
+void TextureCache::terminateUploader() {
+    if (mUploader != NULL) {
+        mUploader->terminate();
+        mUploader.clear();
+    }
+
+    Vector<SkBitmap*> prefetches;
+    {
+        Mutex::Autolock _l(mLock);
+        prefetches = mPrefetches;
+        mPrefetches.clear();
+    }
+    for (size_t i = 0; i < prefetches.size(); i++) {
+        Caches::getInstance().resourceCache.decrementRefcount(prefetches.itemAt(i));
+    }
+}
+
 void TextureCache::remove(SkBitmap* bitmap) {
     mCache.remove(bitmap);
 }
@@ -180,6 +263,26 @@ void TextureCache::removeDeferred(SkBitmap* bitmap) {
 }
 
 void TextureCache::clearGarbage() {
+    if (mUploader != NULL) {
+        Vector<SkBitmap*> prefetches;
+        {
+            Mutex::Autolock _l(mLock);
+            prefetches = mPrefetches;
+            mPrefetches.clear();
+        }
+
+        // Releasing prefetched bitmaps and expiring uploads may release
+        // bitmaps, and therefore add garbage
+        ResourceCache& resourceCache = Caches::getInstance().resourceCache;
+        for (size_t i = 0; i < prefetches.size(); i++) {
+            SkBitmap* bitmap = prefetches.itemAt(i);
+            prefetch(bitmap);
+            resourceCache.decrementRefcount(bitmap);
+        }
+
+        mUploader->expire();
+    }
+
     Mutex::Autolock _l(mLock);
     size_t count = mGarbage.size();
     for (size_t i = 0; i < count; i++) {
@@ -20,10 +20,12 @@
 #include <SkBitmap.h>
 
 #include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
 #include <utils/Vector.h>
 
 #include "Debug.h"
 #include "Texture.h"
+#include "TextureUploader.h"
 #include "utils/GenerationCache.h"
 
 namespace android {
@@ -71,6 +73,13 @@ public:
      * texture is not kept in the cache. The caller must destroy the texture.
      */
     Texture* getTransient(SkBitmap* bitmap);
+    /**
+     * Starts uploading the texture for the specified bitmap in the background
+     * if the bitmap is not in the cache yet. This is a no-op if asynchronous
+     * uploads are not available. When invoked from a thread other than the
+     * EGL context thread, the upload starts with the next clearGarbage().
+     */
+    void prefetch(SkBitmap* bitmap);
     /**
      * Removes the texture associated with the specified bitmap.
      * Upon remove the texture is freed.
@@ -103,6 +112,13 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the number of lookups made in the cache. Used by Caches to
+     * find the least recently used caches.
+     */
+    uint32_t getAccessCount() const {
+        return mAccessCount;
+    }
 
     /**
      * Partially flushes the cache. The amount of memory freed by a flush
@@ -115,6 +131,16 @@ public:
      */
     void setFlushRate(float flushRate);
 
+    /**
+     * Starts the background upload thread. Must be invoked with the
+     * renderer's EGL context current.
+     */
+    void initUploader();
+    /**
+     * Stops the background upload thread and destroys pending uploads.
+     */
+    void terminateUploader();
+
 private:
     /**
      * Generates the texture from a bitmap into the specified texture structure.
@@ -135,6 +161,7 @@ private:
     uint32_t mSize;
     uint32_t mMaxSize;
     GLint mMaxTextureSize;
+    uint32_t mAccessCount;
 
     float mFlushRate;
 
@@ -142,6 +169,13 @@ private:
 
     Vector<SkBitmap*> mGarbage;
     mutable Mutex mLock;
+
+    sp<TextureUploader> mUploader;
+    android_thread_id_t mUploaderThread;
+    // Bitmaps prefetched from other threads, protected by mLock
+    Vector<SkBitmap*> mPrefetches;
+
+    friend class TextureUploader;
 }; // class TextureCache
 
 }; // namespace uirenderer
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+#define EGL_EGLEXT_PROTOTYPES
+
+#include <string.h>
+
+#include <GLES2/gl2.h>
+
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "TextureUploader.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+TextureUploader* TextureUploader::create(TextureCache& cache) {
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLContext context = eglGetCurrentContext();
+    if (display == EGL_NO_DISPLAY || context == EGL_NO_CONTEXT) {
+        return NULL;
+    }
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_fence_sync")) {
+        INIT_LOGD("  EGL_KHR_fence_sync is not supported, textures will be uploaded synchronously");
+        return NULL;
+    }
+
+    EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount != 1) {
+        ALOGW("Could not find an EGL config for the texture uploader");
+        return NULL;
+    }
+
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLContext uploadContext = eglCreateContext(display, config, context, contextAttribs);
+    if (uploadContext == EGL_NO_CONTEXT) {
+        ALOGW("Could not create the texture uploader's EGL context: 0x%x", eglGetError());
+        return NULL;
+    }
+
+    EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE) {
+        ALOGW("Could not create the texture uploader's EGL surface: 0x%x", eglGetError());
+        eglDestroyContext(display, uploadContext);
+        return NULL;
+    }
+
+    INIT_LOGD("  Textures will be uploaded asynchronously");
+    return new TextureUploader(cache, display, uploadContext, surface);
+}
+
+TextureUploader::TextureUploader(TextureCache& cache, EGLDisplay display, EGLContext context,
+        EGLSurface surface): Thread(false), mCache(cache), mDisplay(display),
+        mContext(context), mSurface(surface), mFrame(0), mSize(0), mFailed(false) {
+    // Don't let prefetched textures use more than a quarter of the cache
+    mMaxSize = cache.getMaxSize() / 4;
+}
+
+TextureUploader::~TextureUploader() {
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Upload thread
+///////////////////////////////////////////////////////////////////////////////
+
+status_t TextureUploader::readyToRun() {
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGW("Could not make the texture uploader's EGL context current: 0x%x", eglGetError());
+
+        Mutex::Autolock _l(mLock);
+        mFailed = true;
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+bool TextureUploader::threadLoop() {
+    Upload* upload;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mQueue.isEmpty() && !exitPending()) {
+            mQueueCondition.wait(mLock);
+        }
+
+        if (exitPending()) {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglReleaseThread();
+            return false;
+        }
+
+        upload = mQueue.itemAt(0);
+        mQueue.removeAt(0);
+        upload->state = kState_Uploading;
+    }
+
+    Texture* texture = new Texture;
+    texture->bitmapSize = upload->size;
+    mCache.generateTexture(upload->bitmap, texture, false);
+
+    EGLSyncKHR fence = eglCreateSyncKHR(mDisplay, EGL_SYNC_FENCE_KHR, NULL);
+    if (fence != EGL_NO_SYNC_KHR) {
+        // Make sure the upload and the fence reach the GPU
+        glFlush();
+    } else {
+        glFinish();
+    }
+
+    Mutex::Autolock _l(mLock);
+    upload->texture = texture;
+    upload->fence = fence;
+    upload->state = kState_Done;
+    mUploadCondition.broadcast();
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Uploads
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureUploader::queue(SkBitmap* bitmap, uint32_t size) {
+    Mutex::Autolock _l(mLock);
+    if (mFailed || mSize + size > mMaxSize || mUploads.indexOfKey(bitmap) >= 0) {
+        return false;
+    }
+
+    Upload* upload = new Upload;
+    upload->bitmap = bitmap;
+    upload->texture = NULL;
+    upload->size = size;
+    upload->frame = mFrame;
+    upload->fence = EGL_NO_SYNC_KHR;
+    upload->state = kState_Queued;
+
+    // The bitmap must survive until the texture is claimed
+    Caches::getInstance().resourceCache.incrementRefcount(bitmap);
+
+    mUploads.add(bitmap, upload);
+    mQueue.push(upload);
+    mSize += size;
+
+    mQueueCondition.signal();
+    return true;
+}
+
+Texture* TextureUploader::claim(SkBitmap* bitmap) {
+    Upload* upload;
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mUploads.indexOfKey(bitmap);
+        if (index < 0) return NULL;
+
+        upload = mUploads.valueAt(index);
+        while (upload->state == kState_Uploading) {
+            mUploadCondition.wait(mLock);
+        }
+        removeLocked(upload);
+    }
+
+    // The upload had not started yet, it is cheaper to let the caller upload
+    // the bitmap than to wait for the upload thread
+    if (upload->state != kState_Done) {
+        destroy(upload);
+        return NULL;
+    }
+
+    if (upload->fence != EGL_NO_SYNC_KHR) {
+        eglClientWaitSyncKHR(mDisplay, upload->fence, 0, EGL_FOREVER_KHR);
+        eglDestroySyncKHR(mDisplay, upload->fence);
+        upload->fence = EGL_NO_SYNC_KHR;
+    }
+
+    Texture* texture = upload->texture;
+    upload->texture = NULL;
+    destroy(upload);
+
+    return texture;
+}
+
+void TextureUploader::cancel(SkBitmap* bitmap) {
+    Upload* upload;
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mUploads.indexOfKey(bitmap);
+        if (index < 0) return;
+
+        upload = mUploads.valueAt(index);
+        while (upload->state == kState_Uploading) {
+            mUploadCondition.wait(mLock);
+        }
+        removeLocked(upload);
+    }
+    destroy(upload);
+}
+
+void TextureUploader::expire() {
+    Vector<Upload*> expired;
+    {
+        Mutex::Autolock _l(mLock);
+        mFrame++;
+
+        for (ssize_t i = mUploads.size() - 1; i >= 0; i--) {
+            Upload* upload = mUploads.valueAt(i);
+            if (upload->state != kState_Uploading &&
+                    mFrame - upload->frame > UPLOAD_EXPIRATION_FRAMES) {
+                removeLocked(upload);
+                expired.push(upload);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < expired.size(); i++) {
+        destroy(expired.itemAt(i));
+    }
+}
+
+void TextureUploader::terminate() {
+    requestExit();
+    {
+        Mutex::Autolock _l(mLock);
+        mQueueCondition.signal();
+    }
+    join();
+
+    Vector<Upload*> uploads;
+    {
+        Mutex::Autolock _l(mLock);
+        for (size_t i = 0; i < mUploads.size(); i++) {
+            uploads.push(mUploads.valueAt(i));
+        }
+        mUploads.clear();
+        mQueue.clear();
+        mSize = 0;
+        mFailed = true;
+    }
+
+    for (size_t i = 0; i < uploads.size(); i++) {
+        destroy(uploads.itemAt(i));
+    }
+
+    eglDestroySurface(mDisplay, mSurface);
+    eglDestroyContext(mDisplay, mContext);
+    mSurface = EGL_NO_SURFACE;
+    mContext = EGL_NO_CONTEXT;
+}
+
+void TextureUploader::removeLocked(Upload* upload) {
+    mUploads.removeItem(upload->bitmap);
+    if (upload->state == kState_Queued) {
+        for (size_t i = 0; i < mQueue.size(); i++) {
+            if (mQueue.itemAt(i) == upload) {
+                mQueue.removeAt(i);
+                break;
+            }
+        }
+    }
+    mSize -= upload->size;
+}
+
+void TextureUploader::destroy(Upload* upload) {
+    if (upload->fence != EGL_NO_SYNC_KHR) {
+        eglDestroySyncKHR(mDisplay, upload->fence);
+    }
+    if (upload->texture) {
+        glDeleteTextures(1, &upload->texture->id);
+        delete upload->texture;
+    }
+    Caches::getInstance().resourceCache.decrementRefcount(upload->bitmap);
+    delete upload;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_TEXTURE_UPLOADER_H
+#define ANDROID_HWUI_TEXTURE_UPLOADER_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <SkBitmap.h>
+
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+#include <utils/Vector.h>
+
+#include "Texture.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames after which an upload that was never used is discarded
+#define UPLOAD_EXPIRATION_FRAMES 8
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+class TextureCache;
+
+/**
+ * Uploads bitmaps to textures on a background thread, using an EGL context
+ * that shares its objects with the renderer's context. Each upload is
+ * followed by a fence; the renderer only waits on the fence if the upload
+ * has not completed by the time the texture is needed.
+ *
+ * Bitmaps are kept alive by the resource cache until their texture is
+ * claimed or the upload expires.
+ */
+class TextureUploader: public Thread {
+public:
+    /**
+     * Creates an uploader sharing objects with the current EGL context.
+     * Returns NULL if the current context cannot be shared or if
+     * EGL_KHR_fence_sync is not supported.
+     */
+    static TextureUploader* create(TextureCache& cache);
+
+    virtual ~TextureUploader();
+
+    /**
+     * Queues the upload of the specified bitmap. Returns false if the
+     * bitmap is already queued or if too much data is already in flight.
+     */
+    bool queue(SkBitmap* bitmap, uint32_t size);
+
+    /**
+     * Returns the texture uploaded for the specified bitmap, waiting for
+     * the upload to complete if needed. Returns NULL if the bitmap was not
+     * queued or if its upload has not started yet, in which case the upload
+     * is cancelled and the caller must upload the bitmap itself.
+     *
+     * The caller becomes the owner of the returned texture.
+     */
+    Texture* claim(SkBitmap* bitmap);
+
+    /**
+     * Cancels the upload of the specified bitmap and destroys its texture.
+     */
+    void cancel(SkBitmap* bitmap);
+
+    /**
+     * Discards the uploads that have not been claimed for the last
+     * UPLOAD_EXPIRATION_FRAMES frames. Must be invoked once per frame.
+     */
+    void expire();
+
+    /**
+     * Stops the upload thread and destroys all pending uploads. Must be
+     * invoked from the thread owning the renderer's EGL context.
+     */
+    void terminate();
+
+private:
+    enum State {
+        kState_Queued = 0,
+        kState_Uploading,
+        kState_Done
+    };
+
+    struct Upload {
+        SkBitmap* bitmap;
+        Texture* texture;
+        uint32_t size;
+        uint32_t frame;
+        EGLSyncKHR fence;
+        State state;
+    };
+
+    TextureUploader(TextureCache& cache, EGLDisplay display, EGLContext context,
+            EGLSurface surface);
+
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+
+    // Must be invoked with mLock held
+    void removeLocked(Upload* upload);
+    // Must be invoked without holding mLock
+    void destroy(Upload* upload);
+
+    TextureCache& mCache;
+
+    EGLDisplay mDisplay;
+    EGLContext mContext;
+    EGLSurface mSurface;
+
+    KeyedVector<SkBitmap*, Upload*> mUploads;
+    Vector<Upload*> mQueue;
+
+    uint32_t mFrame;
+    uint32_t mSize;
+    uint32_t mMaxSize;
+
+    bool mFailed;
+
+    Mutex mLock;
+    Condition mQueueCondition;
+    Condition mUploadCondition;
+}; // class TextureUploader
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_TEXTURE_UPLOADER_H
@@ -0,0 +1,70 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+# Offscreen benchmark of the recording and replay of representative
+# scenes. Renders into an EGL pbuffer and can therefore run on any
+# EGL/GLES 2.0 implementation, including software ones.
+LOCAL_SRC_FILES:= \
+	HwuiBenchmark.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/.. \
+	$(LOCAL_PATH)/../../../include/utils \
+	external/skia/include/core \
+	external/skia/include/effects \
+	external/skia/include/images \
+	external/skia/src/ports \
+	external/skia/include/utils
+
+LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER -DGL_GLEXT_PROTOTYPES
+LOCAL_SHARED_LIBRARIES := libcutils libutils libEGL libGLESv2 libskia libui libhwui
+LOCAL_MODULE := hwuibench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# Microbenchmark of Matrix4 against the scalar implementation it replaced.
+# Checks that both compute the same results before measuring them.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	MatrixBenchmark.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/.. \
+	external/skia/include/core \
+	external/skia/src/ports
+
+LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+LOCAL_SHARED_LIBRARIES := libcutils libutils libskia libhwui
+LOCAL_MODULE := hwuimatrixbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# Unit tests of the clip handling of Snapshot. Snapshot is not exported
+# by libhwui and is therefore built into the test.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	Snapshot_test.cpp \
+	../Snapshot.cpp
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/.. \
+	external/skia/include/core \
+	external/skia/src/ports
+
+LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
+LOCAL_SHARED_LIBRARIES := libcutils libutils libskia libui libGLESv2 libhwui libstlport
+LOCAL_STATIC_LIBRARIES := libgtest libgtest_main
+LOCAL_MODULE := Snapshot_test
+
+include $(BUILD_NATIVE_TEST)
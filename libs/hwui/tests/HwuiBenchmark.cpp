@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "HwuiBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <SkBitmap.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "OpenGLRenderer.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_WIDTH 720
+#define BENCH_HEIGHT 1280
+
+// Frames drawn before measuring, to populate the caches
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_DEFAULT_FRAMES 100
+
+///////////////////////////////////////////////////////////////////////////////
+// Scenes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A scene records its content into a display list. Scenes are re-recorded
+ * for every frame, as a view invalidated on each frame would be.
+ */
+class Scene {
+public:
+    virtual ~Scene() { }
+
+    virtual const char* getName() const = 0;
+    virtual void record(DisplayListRenderer& renderer) = 0;
+}; // class Scene
+
+/**
+ * A scrolling list of two lines items with a divider.
+ */
+class TextListScene: public Scene {
+public:
+    TextListScene() {
+        mTitlePaint.setAntiAlias(true);
+        mTitlePaint.setTextSize(32.0f);
+        mTitlePaint.setColor(0xff000000);
+
+        mSubtitlePaint.setAntiAlias(true);
+        mSubtitlePaint.setTextSize(22.0f);
+        mSubtitlePaint.setColor(0xff808080);
+
+        mDividerPaint.setColor(0xffe0e0e0);
+    }
+
+    virtual const char* getName() const {
+        return "text-list";
+    }
+
+    virtual void record(DisplayListRenderer& renderer) {
+        static const char* sTitles[] = {
+                "Inbox", "Meeting notes from Tuesday", "Re: weekend plans",
+                "Your order has shipped", "Build results", "Photos from the trip"
+        };
+        static const char* sSubtitles[] = {
+                "The quick brown fox jumps over the lazy dog",
+                "Pack my box with five dozen liquor jugs",
+                "How vexingly quick daft zebras jump",
+                "Sphinx of black quartz, judge my vow"
+        };
+
+        renderer.drawColor(0xffffffff, SkXfermode::kSrcOver_Mode);
+        for (int i = 0; i < BENCH_HEIGHT / 96; i++) {
+            const float top = i * 96.0f;
+            drawText(renderer, sTitles[i % 6], 24.0f, top + 40.0f, &mTitlePaint);
+            drawText(renderer, sSubtitles[i % 4], 24.0f, top + 76.0f, &mSubtitlePaint);
+            renderer.drawRect(0.0f, top + 95.0f, BENCH_WIDTH, top + 96.0f, &mDividerPaint);
+        }
+    }
+
+private:
+    // The renderer expects glyphs, shaping is normally done by the caller
+    static void drawText(DisplayListRenderer& renderer, const char* text,
+            float x, float y, SkPaint* paint) {
+        const size_t length = strlen(text);
+        uint16_t glyphs[length];
+
+        paint->setTextEncoding(SkPaint::kUTF8_TextEncoding);
+        const int count = paint->textToGlyphs(text, length, glyphs);
+        paint->setTextEncoding(SkPaint::kGlyphID_TextEncoding);
+
+        renderer.drawText((const char*) glyphs, count * sizeof(uint16_t), count, x, y, paint);
+    }
+
+    SkPaint mTitlePaint;
+    SkPaint mSubtitlePaint;
+    SkPaint mDividerPaint;
+}; // class TextListScene
+
+/**
+ * A launcher-like grid of icons.
+ */
+class IconGridScene: public Scene {
+public:
+    IconGridScene() {
+        for (int i = 0; i < kIconCount; i++) {
+            mIcons[i].setConfig(SkBitmap::kARGB_8888_Config, kIconSize, kIconSize);
+            mIcons[i].allocPixels();
+            mIcons[i].eraseARGB(0xff, (i * 37) & 0xff, (i * 91) & 0xff, (i * 53) & 0xff);
+        }
+        mPaint.setFilterBitmap(true);
+    }
+
+    virtual const char* getName() const {
+        return "icon-grid";
+    }
+
+    virtual void record(DisplayListRenderer& renderer) {
+        renderer.drawColor(0xff202020, SkXfermode::kSrcOver_Mode);
+
+        const int columns = BENCH_WIDTH / (kIconSize * 2);
+        const int rows = BENCH_HEIGHT / (kIconSize * 2);
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < columns; x++) {
+                SkBitmap* icon = &mIcons[(y * columns + x) % kIconCount];
+                renderer.drawBitmap(icon, x * kIconSize * 2.0f + kIconSize / 2,
+                        y * kIconSize * 2.0f + kIconSize / 2, &mPaint);
+            }
+        }
+    }
+
+private:
+    static const int kIconCount = 16;
+    static const int kIconSize = 64;
+
+    SkBitmap mIcons[kIconCount];
+    SkPaint mPaint;
+}; // class IconGridScene
+
+/**
+ * Buttons and cards drawn with stretchable 9-patches of varying sizes.
+ */
+class NinePatchScene: public Scene {
+public:
+    NinePatchScene() {
+        mBitmap.setConfig(SkBitmap::kARGB_8888_Config, 32, 32);
+        mBitmap.allocPixels();
+        mBitmap.eraseARGB(0xff, 0x33, 0xb5, 0xe5);
+    }
+
+    virtual const char* getName() const {
+        return "nine-patch";
+    }
+
+    virtual void record(DisplayListRenderer& renderer) {
+        static const int32_t sDivs[] = { 8, 24 };
+
+        renderer.drawColor(0xffffffff, SkXfermode::kSrcOver_Mode);
+        for (int i = 0; i < 60; i++) {
+            const float left = (i % 3) * (BENCH_WIDTH / 3.0f) + 8.0f;
+            const float top = (i / 3) * 64.0f + 8.0f;
+            const float width = BENCH_WIDTH / 3.0f - 16.0f - (i % 5) * 12.0f;
+            renderer.drawPatch(&mBitmap, sDivs, sDivs, NULL, 2, 2, 0,
+                    left, top, left + width, top + 48.0f, NULL);
+        }
+    }
+
+private:
+    SkBitmap mBitmap;
+}; // class NinePatchScene
+
+/**
+ * Charts and decorations made of paths and simple shapes.
+ */
+class PathScene: public Scene {
+public:
+    PathScene() {
+        mFillPaint.setAntiAlias(true);
+        mFillPaint.setColor(0xff99cc00);
+
+        mStrokePaint.setAntiAlias(true);
+        mStrokePaint.setStyle(SkPaint::kStroke_Style);
+        mStrokePaint.setStrokeWidth(4.0f);
+        mStrokePaint.setColor(0xffff4444);
+
+        for (int i = 0; i < kPathCount; i++) {
+            SkPath& path = mPaths[i];
+            path.moveTo(0.0f, 0.0f);
+            for (int j = 1; j <= 8; j++) {
+                path.quadTo(j * 20.0f - 10.0f, ((i + j) % 4) * 20.0f,
+                        j * 20.0f, ((i * j) % 5) * 16.0f);
+            }
+        }
+    }
+
+    virtual const char* getName() const {
+        return "path";
+    }
+
+    virtual void record(DisplayListRenderer& renderer) {
+        renderer.drawColor(0xffffffff, SkXfermode::kSrcOver_Mode);
+        for (int i = 0; i < 40; i++) {
+            const float left = (i % 4) * (BENCH_WIDTH / 4.0f);
+            const float top = (i / 4) * 120.0f;
+
+            renderer.save(SkCanvas::kMatrix_SaveFlag);
+            renderer.translate(left + 8.0f, top + 8.0f);
+            renderer.drawPath(&mPaths[i % kPathCount], &mStrokePaint);
+            renderer.restore();
+
+            renderer.drawCircle(left + 40.0f, top + 100.0f, 12.0f, &mFillPaint);
+            renderer.drawRoundRect(left + 64.0f, top + 88.0f, left + 160.0f, top + 112.0f,
+                    8.0f, 8.0f, &mFillPaint);
+        }
+    }
+
+private:
+    static const int kPathCount = 8;
+
+    SkPath mPaths[kPathCount];
+    SkPaint mFillPaint;
+    SkPaint mStrokePaint;
+}; // class PathScene
+
+///////////////////////////////////////////////////////////////////////////////
+// EGL
+///////////////////////////////////////////////////////////////////////////////
+
+struct Context {
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+};
+
+static bool createContext(Context& context) {
+    context.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (context.display == EGL_NO_DISPLAY || !eglInitialize(context.display, NULL, NULL)) {
+        fprintf(stderr, "Could not initialize EGL: 0x%x\n", eglGetError());
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_STENCIL_SIZE, 8,
+            EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(context.display, configAttribs, &config, 1, &configCount) ||
+            configCount == 0) {
+        fprintf(stderr, "Could not find a suitable EGL config: 0x%x\n", eglGetError());
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = {
+            EGL_WIDTH, BENCH_WIDTH,
+            EGL_HEIGHT, BENCH_HEIGHT,
+            EGL_NONE
+    };
+    context.surface = eglCreatePbufferSurface(context.display, config, surfaceAttribs);
+
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    context.context = eglCreateContext(context.display, config, EGL_NO_CONTEXT,
+            contextAttribs);
+
+    if (context.surface == EGL_NO_SURFACE || context.context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(context.display, context.surface, context.surface,
+                    context.context)) {
+        fprintf(stderr, "Could not create an offscreen GL context: 0x%x\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+static void destroyContext(Context& context) {
+    eglMakeCurrent(context.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(context.display, context.context);
+    eglDestroySurface(context.display, context.surface);
+    eglTerminate(context.display);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+struct SceneResult {
+    double recordTime;
+    double replayTime;
+    double replayCpuTime;
+    uint64_t drawCalls;
+    uint64_t programSwitches;
+    uint64_t textureUploads;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+};
+
+static void runScene(Scene& scene, OpenGLRenderer& renderer, int frames, SceneResult& result) {
+    Caches& caches = Caches::getInstance();
+    DisplayListRenderer recorder;
+    DisplayList* displayList = NULL;
+
+    memset(&result, 0, sizeof(SceneResult));
+
+    for (int i = -BENCH_WARMUP_FRAMES; i < frames; i++) {
+        const nsecs_t recordStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        recorder.reset();
+        recorder.setViewport(BENCH_WIDTH, BENCH_HEIGHT);
+        recorder.prepare(false);
+        scene.record(recorder);
+        recorder.finish();
+        displayList = recorder.getDisplayList(displayList);
+        const nsecs_t recordEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        const nsecs_t replayCpuStart = systemTime(SYSTEM_TIME_THREAD);
+        renderer.prepare(true);
+        Rect dirty;
+        renderer.drawDisplayList(displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+        renderer.finish();
+        const nsecs_t replayCpuEnd = systemTime(SYSTEM_TIME_THREAD);
+
+        // Include the GPU work in the replay time, which matters mostly
+        // with software implementations
+        glFinish();
+        const nsecs_t replayEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        FrameInfo info;
+        if (i < 0 || !caches.frameStats.getLastFrame(info)) continue;
+
+        result.recordTime += (recordEnd - recordStart) / 1000000.0;
+        result.replayTime += (replayEnd - recordEnd) / 1000000.0;
+        result.replayCpuTime += (replayCpuEnd - replayCpuStart) / 1000000.0;
+        result.drawCalls += info.drawCalls;
+        result.programSwitches += info.programSwitches;
+        result.textureUploads += info.textureUploads + info.asyncTextureUploads;
+        result.cacheHits += info.cacheHits;
+        result.cacheMisses += info.cacheMisses;
+    }
+
+    delete displayList;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: hwuibench [-n frames] [-m] [scene...]\n");
+    fprintf(stderr, "  -n frames  number of measured frames per scene (default %d)\n",
+            BENCH_DEFAULT_FRAMES);
+    fprintf(stderr, "  -m         dump the memory usage of the caches after each scene\n");
+    fprintf(stderr, "Scenes: text-list icon-grid nine-patch path (default: all)\n");
+}
+
+int main(int argc, char** argv) {
+    int frames = BENCH_DEFAULT_FRAMES;
+    bool dumpMemory = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+            frames = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "-m")) {
+            dumpMemory = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (frames <= 0) {
+        usage();
+        return 1;
+    }
+
+    Context context;
+    if (!createContext(context)) return 1;
+
+    // The renderers initialize the caches and must be created once
+    // the context is current
+    OpenGLRenderer* renderer = new OpenGLRenderer();
+    renderer->setViewport(BENCH_WIDTH, BENCH_HEIGHT);
+
+    Scene* scenes[] = {
+            new TextListScene(), new IconGridScene(), new NinePatchScene(), new PathScene()
+    };
+    const int sceneCount = sizeof(scenes) / sizeof(Scene*);
+
+    printf("%-12s %10s %10s %10s %8s %8s %8s %8s\n", "Scene", "Record", "Replay",
+            "ReplayCPU", "Draws", "Programs", "Uploads", "HitRate");
+
+    for (int i = 0; i < sceneCount; i++) {
+        Scene* scene = scenes[i];
+
+        bool selected = arg == argc;
+        for (int j = arg; j < argc && !selected; j++) {
+            selected = !strcmp(argv[j], scene->getName());
+        }
+        if (!selected) continue;
+
+        SceneResult result;
+        runScene(*scene, *renderer, frames, result);
+
+        const uint64_t lookups = result.cacheHits + result.cacheMisses;
+        printf("%-12s %8.3fms %8.3fms %8.3fms %8.1f %8.1f %8.1f %7.1f%%\n", scene->getName(),
+                result.recordTime / frames, result.replayTime / frames,
+                result.replayCpuTime / frames, result.drawCalls / double(frames),
+                result.programSwitches / double(frames),
+                result.textureUploads / double(frames),
+                lookups > 0 ? 100.0 * result.cacheHits / lookups : 100.0);
+
+        if (dumpMemory) {
+            String8 log;
+            Caches::getInstance().dumpMemoryUsage(log);
+            printf("%s", log.string());
+        }
+    }
+
+    for (int i = 0; i < sceneCount; i++) {
+        delete scenes[i];
+    }
+    delete renderer;
+
+    Caches::getInstance().flush(Caches::kFlushMode_Full);
+    Caches::getInstance().terminate();
+
+    destroyContext(context);
+    return 0;
+}
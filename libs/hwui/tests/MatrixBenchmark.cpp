@@ -0,0 +1,409 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MatrixBenchmark"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utils/Timers.h>
+
+#include "Matrix.h"
+#include "Rect.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+// Maximum relative error between Matrix4 and the scalar reference
+#define BENCH_EPSILON 1e-4f
+
+#if defined(__ARM_HAVE_NEON)
+    #define GENERIC_PATH "NEON"
+#elif defined(__SSE__)
+    #define GENERIC_PATH "SSE"
+#else
+    #define GENERIC_PATH "scalar"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The scalar implementations Matrix4 used before it gained its SIMD and
+ * fast paths. They are used both to validate the results of Matrix4 and
+ * as the baseline of the measurements.
+ */
+static void __attribute__((noinline)) scalarMultiply(float* data,
+        const float* u, const float* v) {
+    for (int i = 0 ; i < 4 ; i++) {
+        float x = 0;
+        float y = 0;
+        float z = 0;
+        float w = 0;
+
+        for (int j = 0 ; j < 4 ; j++) {
+            const float e = v[i * 4 + j];
+            x += u[j * 4] * e;
+            y += u[j * 4 + 1] * e;
+            z += u[j * 4 + 2] * e;
+            w += u[j * 4 + 3] * e;
+        }
+
+        data[i * 4] = x;
+        data[i * 4 + 1] = y;
+        data[i * 4 + 2] = z;
+        data[i * 4 + 3] = w;
+    }
+}
+
+static void __attribute__((noinline)) scalarInverse(float* data, const float* v) {
+    double scale = 1.0 /
+            (v[Matrix4::kScaleX] * ((double) v[Matrix4::kScaleY]  * v[Matrix4::kPerspective2] -
+                    (double) v[Matrix4::kTranslateY] * v[Matrix4::kPerspective1]) +
+             v[Matrix4::kSkewX] * ((double) v[Matrix4::kTranslateY] * v[Matrix4::kPerspective0] -
+                     (double) v[Matrix4::kSkewY] * v[Matrix4::kPerspective2]) +
+             v[Matrix4::kTranslateX] * ((double) v[Matrix4::kSkewY] * v[Matrix4::kPerspective1] -
+                     (double) v[Matrix4::kScaleY] * v[Matrix4::kPerspective0]));
+
+    data[Matrix4::kScaleX] = (v[Matrix4::kScaleY] * v[Matrix4::kPerspective2] -
+            v[Matrix4::kTranslateY] * v[Matrix4::kPerspective1])  * scale;
+    data[Matrix4::kSkewX] = (v[Matrix4::kTranslateX] * v[Matrix4::kPerspective1] -
+            v[Matrix4::kSkewX]  * v[Matrix4::kPerspective2]) * scale;
+    data[Matrix4::kTranslateX] = (v[Matrix4::kSkewX] * v[Matrix4::kTranslateY] -
+            v[Matrix4::kTranslateX] * v[Matrix4::kScaleY])  * scale;
+
+    data[Matrix4::kSkewY] = (v[Matrix4::kTranslateY] * v[Matrix4::kPerspective0] -
+            v[Matrix4::kSkewY]  * v[Matrix4::kPerspective2]) * scale;
+    data[Matrix4::kScaleY] = (v[Matrix4::kScaleX] * v[Matrix4::kPerspective2] -
+            v[Matrix4::kTranslateX] * v[Matrix4::kPerspective0])  * scale;
+    data[Matrix4::kTranslateY] = (v[Matrix4::kTranslateX] * v[Matrix4::kSkewY] -
+            v[Matrix4::kScaleX]  * v[Matrix4::kTranslateY]) * scale;
+
+    data[Matrix4::kPerspective0] = (v[Matrix4::kSkewY] * v[Matrix4::kPerspective1] -
+            v[Matrix4::kScaleY] * v[Matrix4::kPerspective0]) * scale;
+    data[Matrix4::kPerspective1] = (v[Matrix4::kSkewX] * v[Matrix4::kPerspective0] -
+            v[Matrix4::kScaleX] * v[Matrix4::kPerspective1]) * scale;
+    data[Matrix4::kPerspective2] = (v[Matrix4::kScaleX] * v[Matrix4::kScaleY] -
+            v[Matrix4::kSkewX] * v[Matrix4::kSkewY]) * scale;
+}
+
+static void __attribute__((noinline)) scalarMapRect(const float* data, bool simple, Rect& r) {
+    if (simple) {
+        r.left = r.left * data[Matrix4::kScaleX] + data[Matrix4::kTranslateX];
+        r.right = r.right * data[Matrix4::kScaleX] + data[Matrix4::kTranslateX];
+        r.top = r.top * data[Matrix4::kScaleY] + data[Matrix4::kTranslateY];
+        r.bottom = r.bottom * data[Matrix4::kScaleY] + data[Matrix4::kTranslateY];
+
+        if (r.left > r.right) {
+            float x = r.left;
+            r.left = r.right;
+            r.right = x;
+        }
+
+        if (r.top > r.bottom) {
+            float y = r.top;
+            r.top = r.bottom;
+            r.bottom = y;
+        }
+
+        return;
+    }
+
+    float vertices[] = {
+        r.left, r.top,
+        r.right, r.top,
+        r.right, r.bottom,
+        r.left, r.bottom
+    };
+
+    float x, y, z;
+
+    for (int i = 0; i < 8; i+= 2) {
+        float px = vertices[i];
+        float py = vertices[i + 1];
+
+        x = px * data[Matrix4::kScaleX] + py * data[Matrix4::kSkewX] + data[Matrix4::kTranslateX];
+        y = px * data[Matrix4::kSkewY] + py * data[Matrix4::kScaleY] + data[Matrix4::kTranslateY];
+        z = px * data[Matrix4::kPerspective0] + py * data[Matrix4::kPerspective1] +
+                data[Matrix4::kPerspective2];
+        if (z) z = 1.0f / z;
+
+        vertices[i] = x * z;
+        vertices[i + 1] = y * z;
+    }
+
+    r.left = r.right = vertices[0];
+    r.top = r.bottom = vertices[1];
+
+    for (int i = 2; i < 8; i += 2) {
+        x = vertices[i];
+        y = vertices[i + 1];
+
+        if (x < r.left) r.left = x;
+        else if (x > r.right) r.right = x;
+        if (y < r.top) r.top = y;
+        else if (y > r.bottom) r.bottom = y;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Matrices
+///////////////////////////////////////////////////////////////////////////////
+
+enum MatrixKind {
+    kIdentity,
+    kTranslate,
+    kScaleTranslate,
+    kGeneric
+};
+
+static const char* sKindNames[] = { "identity", "translate", "scale", "generic" };
+
+#define KIND_COUNT 4
+
+static void loadMatrix(Matrix4& m, MatrixKind kind, float seed) {
+    switch (kind) {
+        case kIdentity:
+            m.loadIdentity();
+            break;
+        case kTranslate:
+            m.loadTranslate(12.0f + seed, -7.5f + seed, 0.0f);
+            break;
+        case kScaleTranslate:
+            m.loadScale(1.5f + seed, 0.75f, 1.0f);
+            m.translate(-20.0f, 33.0f + seed, 0.0f);
+            break;
+        case kGeneric:
+            m.loadRotate(30.0f + seed, 0.0f, 0.0f, 1.0f);
+            m.translate(10.0f, 5.0f + seed, 0.0f);
+            m.scale(2.0f, 0.5f + seed, 1.0f);
+            break;
+    }
+}
+
+static bool isSimple(MatrixKind kind) {
+    return kind != kGeneric;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Validation
+///////////////////////////////////////////////////////////////////////////////
+
+static bool nearlyEqual(float a, float b) {
+    return fabsf(a - b) <= BENCH_EPSILON * fmaxf(1.0f, fmaxf(fabsf(a), fabsf(b)));
+}
+
+static bool compareData(const char* name, const float* expected, const float* actual) {
+    for (int i = 0; i < 16; i++) {
+        if (!nearlyEqual(expected[i], actual[i])) {
+            fprintf(stderr, "%s: entry %d is %f, expected %f\n", name, i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compareRect(const char* name, const Rect& expected, const Rect& actual) {
+    if (!nearlyEqual(expected.left, actual.left) || !nearlyEqual(expected.top, actual.top) ||
+            !nearlyEqual(expected.right, actual.right) ||
+            !nearlyEqual(expected.bottom, actual.bottom)) {
+        fprintf(stderr, "%s: rect is (%f, %f, %f, %f), expected (%f, %f, %f, %f)\n", name,
+                actual.left, actual.top, actual.right, actual.bottom,
+                expected.left, expected.top, expected.right, expected.bottom);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Checks that Matrix4 computes the same results as the scalar reference
+ * for every kind of operand.
+ */
+static bool validate() {
+    bool valid = true;
+
+    for (int i = 0; i < KIND_COUNT; i++) {
+        Matrix4 u;
+        loadMatrix(u, MatrixKind(i), 0.25f);
+
+        for (int j = 0; j < KIND_COUNT; j++) {
+            Matrix4 v;
+            loadMatrix(v, MatrixKind(j), 0.5f);
+
+            Matrix4 m;
+            m.loadMultiply(u, v);
+            float expected[16];
+            scalarMultiply(expected, u.data, v.data);
+            valid &= compareData("loadMultiply", expected, m.data);
+        }
+
+        Matrix4 inverse;
+        inverse.loadInverse(u);
+        float expected[16];
+        scalarInverse(expected, u.data);
+        valid &= compareData("loadInverse", expected, inverse.data);
+
+        Rect r(-10.0f, 20.0f, 130.0f, 85.5f);
+        Rect expectedRect(r);
+        u.mapRect(r);
+        scalarMapRect(u.data, isSimple(MatrixKind(i)), expectedRect);
+        valid &= compareRect("mapRect", expectedRect, r);
+    }
+
+    return valid;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Measurements
+///////////////////////////////////////////////////////////////////////////////
+
+// Written after each operation so that the compiler cannot drop any
+static volatile float sSink;
+
+struct Result {
+    double matrix;
+    double scalar;
+};
+
+static double elapsed(nsecs_t start, int iterations) {
+    return double(systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations;
+}
+
+static Result benchMultiply(MatrixKind kind, int iterations) {
+    Matrix4 u, v, m;
+    loadMatrix(u, kind, 0.25f);
+    loadMatrix(v, kind, 0.5f);
+    Result result;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        m.loadMultiply(u, v);
+        sSink = m.data[Matrix4::kTranslateX];
+    }
+    result.matrix = elapsed(start, iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        scalarMultiply(m.data, u.data, v.data);
+        sSink = m.data[Matrix4::kTranslateX];
+    }
+    result.scalar = elapsed(start, iterations);
+
+    return result;
+}
+
+static Result benchInverse(MatrixKind kind, int iterations) {
+    Matrix4 u, m;
+    loadMatrix(u, kind, 0.25f);
+    Result result;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        m.loadInverse(u);
+        sSink = m.data[Matrix4::kTranslateX];
+    }
+    result.matrix = elapsed(start, iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        scalarInverse(m.data, u.data);
+        sSink = m.data[Matrix4::kTranslateX];
+    }
+    result.scalar = elapsed(start, iterations);
+
+    return result;
+}
+
+static Result benchMapRect(MatrixKind kind, int iterations) {
+    Matrix4 u;
+    loadMatrix(u, kind, 0.25f);
+    const bool simple = isSimple(kind);
+    Result result;
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Rect r(0.0f, 0.0f, 100.0f, 48.0f);
+        u.mapRect(r);
+        sSink = r.left;
+    }
+    result.matrix = elapsed(start, iterations);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterations; i++) {
+        Rect r(0.0f, 0.0f, 100.0f, 48.0f);
+        scalarMapRect(u.data, simple, r);
+        sSink = r.left;
+    }
+    result.scalar = elapsed(start, iterations);
+
+    return result;
+}
+
+static void printResult(const char* operation, MatrixKind kind, const Result& result) {
+    printf("%-14s %-10s %9.1fns %9.1fns %7.2fx\n", operation, sKindNames[kind],
+            result.matrix, result.scalar, result.scalar / result.matrix);
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: hwuimatrixbench [-n iterations]\n");
+    fprintf(stderr, "  -n iterations  number of calls per measurement (default %d)\n",
+            BENCH_DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char** argv) {
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+            iterations = atoi(argv[++arg]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (iterations <= 0) {
+        usage();
+        return 1;
+    }
+
+    if (!validate()) {
+        fprintf(stderr, "Matrix4 does not match the scalar reference\n");
+        return 1;
+    }
+
+    printf("Matrix4 generic path: %s\n", GENERIC_PATH);
+    printf("%-14s %-10s %11s %11s %8s\n", "Operation", "Matrix", "Matrix4", "Scalar", "Speedup");
+
+    for (int i = 0; i < KIND_COUNT; i++) {
+        printResult("loadMultiply", MatrixKind(i), benchMultiply(MatrixKind(i), iterations));
+    }
+    for (int i = 0; i < KIND_COUNT; i++) {
+        printResult("loadInverse", MatrixKind(i), benchInverse(MatrixKind(i), iterations));
+    }
+    for (int i = 0; i < KIND_COUNT; i++) {
+        printResult("mapRect", MatrixKind(i), benchMapRect(MatrixKind(i), iterations));
+    }
+
+    return 0;
+}
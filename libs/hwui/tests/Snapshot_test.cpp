@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Snapshot_test"
+
+#include "Snapshot.h"
+
+#include <SkCanvas.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace uirenderer {
+
+#if STENCIL_BUFFER_SIZE
+
+class SnapshotTest : public testing::Test {
+protected:
+    sp<Snapshot> mParent;
+
+    /**
+     * Sets up a parent snapshot whose clip is a 100x100 rect with a hole,
+     * which can only be represented by a clip region.
+     */
+    virtual void SetUp() {
+        mParent = new Snapshot();
+        mParent->transform->loadIdentity();
+        mParent->setClip(0.0f, 0.0f, 100.0f, 100.0f);
+        mParent->clip(40.0f, 40.0f, 60.0f, 60.0f, SkRegion::kDifference_Op);
+        ASSERT_TRUE(mParent->clipRegion != NULL);
+    }
+
+    virtual void TearDown() {
+        mParent.clear();
+    }
+
+    void expectParentClipUnchanged() {
+        ASSERT_TRUE(mParent->clipRegion != NULL);
+        EXPECT_FALSE(mParent->clipRegion->isEmpty());
+        EXPECT_FALSE(mParent->clipRegion->isRect());
+        EXPECT_TRUE(mParent->clipRegion->contains(10, 10));
+        EXPECT_FALSE(mParent->clipRegion->contains(50, 50));
+
+        EXPECT_EQ(Rect(0.0f, 0.0f, 100.0f, 100.0f), *mParent->clipRect);
+    }
+};
+
+TEST_F(SnapshotTest, ResetClipWithoutClipFlag) {
+    // As OpenGLRenderer::createFboLayer() does
+    sp<Snapshot> child = new Snapshot(mParent, SkCanvas::kMatrix_SaveFlag);
+    child->resetClip(0.0f, 0.0f, 20.0f, 20.0f);
+
+    EXPECT_TRUE(child->clipRegion == NULL);
+    EXPECT_EQ(Rect(0.0f, 0.0f, 20.0f, 20.0f), *child->clipRect);
+
+    // Restore
+    child.clear();
+    expectParentClipUnchanged();
+}
+
+TEST_F(SnapshotTest, IntersectToRectWithoutClipFlag) {
+    // The intersection does not overlap the hole and collapses to a rect
+    sp<Snapshot> child = new Snapshot(mParent, SkCanvas::kMatrix_SaveFlag);
+    child->clip(0.0f, 0.0f, 20.0f, 20.0f, SkRegion::kIntersect_Op);
+
+    EXPECT_TRUE(child->clipRegion == NULL);
+    EXPECT_EQ(Rect(0.0f, 0.0f, 20.0f, 20.0f), *child->clipRect);
+
+    child.clear();
+    expectParentClipUnchanged();
+}
+
+TEST_F(SnapshotTest, RegionOpWithoutClipFlag) {
+    sp<Snapshot> child = new Snapshot(mParent, SkCanvas::kMatrix_SaveFlag);
+    child->clip(0.0f, 0.0f, 10.0f, 10.0f, SkRegion::kDifference_Op);
+
+    ASSERT_TRUE(child->clipRegion != NULL);
+    EXPECT_FALSE(child->clipRegion->contains(5, 5));
+
+    child.clear();
+    expectParentClipUnchanged();
+}
+
+TEST_F(SnapshotTest, SetClipWithClipFlag) {
+    sp<Snapshot> child = new Snapshot(mParent,
+            SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
+    child->setClip(0.0f, 0.0f, 20.0f, 20.0f);
+
+    EXPECT_TRUE(child->clipRegion == NULL);
+
+    child.clear();
+    expectParentClipUnchanged();
+}
+
+TEST(SnapshotRegionTest, NewRegionWithoutClipFlag) {
+    sp<Snapshot> parent = new Snapshot();
+    parent->transform->loadIdentity();
+    parent->setClip(0.0f, 0.0f, 100.0f, 100.0f);
+
+    // The region is built by the child from the parent's clip rect
+    sp<Snapshot> child = new Snapshot(parent, SkCanvas::kMatrix_SaveFlag);
+    child->clip(40.0f, 40.0f, 60.0f, 60.0f, SkRegion::kDifference_Op);
+
+    ASSERT_TRUE(child->clipRegion != NULL);
+    EXPECT_EQ(Rect(0.0f, 0.0f, 100.0f, 100.0f), *child->clipRect);
+
+    child.clear();
+    EXPECT_TRUE(parent->clipRegion == NULL);
+    EXPECT_EQ(Rect(0.0f, 0.0f, 100.0f, 100.0f), *parent->clipRect);
+}
+
+#endif // STENCIL_BUFFER_SIZE
+
+}; // namespace uirenderer
+}; // namespace android